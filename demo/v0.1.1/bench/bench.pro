@@ -0,0 +1,48 @@
+TEMPLATE = app
+TARGET = bench
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+HEADERS   += perfcounters.h \
+    perfgate.h \
+    reference.h \
+    verify.h
+
+SOURCES   += main.cpp \
+    perfcounters.cpp \
+    perfgate.cpp \
+    reference.cpp \
+    verify.cpp
+
+include(../player/pipeline.pri)
+
+INCLUDEPATH += /usr/local/include/opencv
+INCLUDEPATH += /usr/local/include/opencv2
+INCLUDEPATH += /usr/local/include
+
+LIBS += -L/usr/local/lib
+LIBS += -lopencv_core
+LIBS += -lopencv_imgproc
+
+# Performance regression gate: `make perfgate` fails when a kernel is
+# slower than tests/data/bench-baseline.json by more than the noise allows;
+# `make perfbaseline` records that file (on the reference machine only).
+# There is no perfgate target until a baseline has been committed.
+BASELINE = $$PWD/../../../tests/data/bench-baseline.json
+
+perfbaseline.commands = $$OUT_PWD/$$TARGET --write-baseline=$$BASELINE --settings=$$PWD/../player
+perfbaseline.depends = $(TARGET)
+QMAKE_EXTRA_TARGETS += perfbaseline
+
+exists($$BASELINE) {
+    perfgate.commands = $$OUT_PWD/$$TARGET --gate=$$BASELINE --settings=$$PWD/../player
+    perfgate.depends = $(TARGET)
+    QMAKE_EXTRA_TARGETS += perfgate
+}
+
+# Differential check of the optimised filter paths against the reference
+# implementations: `make verify`.
+verify.commands = $$OUT_PWD/$$TARGET --verify --settings=$$PWD/../player
+verify.depends = $(TARGET)
+QMAKE_EXTRA_TARGETS += verify
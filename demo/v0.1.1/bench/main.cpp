@@ -0,0 +1,534 @@
+// Times the filter stages on synthetic frames, outside the player.
+//
+//   bench [--size=WxH | --corpus=FILE] [--frames=N] [--settings=DIR] [--perf]
+//   bench --conversions [--write=FILE]
+//   bench --gate=BASELINE | --write-baseline=FILE [--repeats=N] [--size=WxH | --corpus=FILE]
+//   bench --verify [--corpus=FILE]
+//   bench --tuning [--size=WxH | --corpus=FILE] [--repeats=N]
+//
+// --corpus runs the stages over the frames of a raw frame corpus (written
+// by the capture tool) in turn instead, so every run sees the same real
+// footage and decoding stays out of the numbers.
+//
+// Every stage runs over whole frames and, where supported, in L2-sized
+// bands (line-buffered). "model DRAM B/px" is not measured but modelled
+// from what the frame allocates: input and output go through memory once,
+// and the arena temporaries are written and read back once more when
+// together they do not fit in L2. --perf measures it (see below).
+//
+// "allocs/f" and "heap KiB/f" count the Mats a stage allocates on the heap
+// per frame, outside the arena (AllocStats); "peak KiB" is the most it held
+// at once. A new temporary in a filter shows up here first.
+//
+// --perf also reads the CPU's counters around every measured call (Linux
+// perf_event) and prints, per frame: cycles per pixel, IPC, L1d and LLC
+// misses and branch misses per thousand pixels, LLC bytes per cycle
+// (misses x 64 B lines) and per pixel. The last is the measured
+// counterpart of the modelled DRAM column: every LLC miss is a line read
+// from memory. Write-backs are not counted, so it is a lower bound. Low IPC with high LLC B/cycle means the stage
+// waits on memory; high IPC means it is compute bound. Counters only cover
+// the calling thread, so OpenCV runs on one thread in this mode and the
+// timings are single-threaded too. Where counters are unavailable the
+// table is skipped with the reason.
+//
+// --gate times every stage in both modes --repeats times (default 7),
+// compares the medians with BASELINE (see PerfBaseline::compare()) and
+// exits with 1 on a regression; `make perfgate` runs it against
+// tests/data/bench-baseline.json once that has been recorded. A baseline
+// that does not parse or has no kernels fails the gate too.
+// --write-baseline records a new baseline the same way, on the reference
+// machine.
+//
+// --verify checks every stage's optimised paths (whole-frame and
+// line-buffered with arena temporaries, bands on a task pool, and
+// memoised) against a frozen copy of its original code (reference.cpp)
+// instead of timing them: odd-sized synthetic frames, plus
+// the corpus frames if given, through a sweep of parameters out to the
+// slider limits. It prints the largest and mean per-channel error and the
+// lowest PSNR, and exits with 1 when any case is outside the stage's
+// tolerance(); `make verify` runs it.
+//
+// --tuning measures what one slider move costs on a still frame: each
+// stage in full against processMemoised() after moving only that slider
+// by one step from its default, which reruns only the steps that read it
+// ("rerun" counts them out of the stage's steps).
+//
+// --conversions measures the pixel format conversion cost table on this
+// CPU instead; --write saves it where the player picks it up
+// (ConversionCosts.json next to the player).
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+#include <vector>
+
+#include "allocstats.h"
+#include "cacheinfo.h"
+#include "conversioncost.h"
+#include "framecorpus.h"
+#include "filterstage.h"
+#include "filtermemo.h"
+#include "framearena.h"
+#include "imageconvert.h"
+#include "perfcounters.h"
+#include "perfgate.h"
+#include "verify.h"
+
+struct BenchResult
+{
+    double medianMs;
+    double meanMs;
+    double modelledDramBytesPerPixel;
+    double allocationsPerFrame;
+    double heapBytesPerFrame;
+    qint64 peakHeapBytes;
+    // Per frame; -1 where the counter is unavailable.
+    double counters[PerfCounters::EventCount];
+};
+
+static cv::Mat syntheticFrame(int width, int height)
+{
+    // Smoothed noise: enough structure for the edge filters to have work,
+    // and the same frame on every run.
+    cv::Mat frame(height, width, CV_8UC3);
+    cv::theRNG().state = 0x5eed;
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(frame, frame, cv::Size(7, 7), 0);
+    return frame;
+}
+
+// Converted up front, so the conversion is not part of the stage timings.
+static QList<cv::Mat> corpusFrames(const FrameCorpus &corpus)
+{
+    QList<cv::Mat> frames;
+    for (int i = 0; i < corpus.frameCount(); ++i) {
+        const cv::Mat frame = frame_to_mat(corpus.frame(i));
+        if (!frame.empty()) {
+            frames.append(frame);
+        }
+    }
+    return frames;
+}
+
+static BenchResult run(FilterStage *stage, const FilterParams &params, const QList<cv::Mat> &sources, int frames,
+                       PerfCounters *perf)
+{
+    FrameArena arena;
+    std::vector<double> times;
+    double counterSums[PerfCounters::EventCount] = { 0 };
+    bool counted[PerfCounters::EventCount];
+    std::fill(counted, counted + PerfCounters::EventCount, true);
+    size_t arenaBytes = 0;
+    size_t ioBytes = 0;
+
+    for(int i = -2; i < frames; ++i) {
+        cv::Mat frame = sources[(i + 2) % sources.size()].clone();
+        if(i == 0) {
+            AllocStats::takeCounts();
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        cv::Mat result;
+        {
+            ALLOC_SCOPE(stage->traceName());
+            if(perf) {
+                perf->start();
+            }
+            result = stage->process(frame, params, &arena);
+            if(perf) {
+                perf->stop();
+            }
+        }
+        const double ms = timer.nsecsElapsed() / 1e6;
+
+        arenaBytes = arena.used() + arena.spilled();
+        ioBytes = frame.total() * frame.elemSize() + result.total() * result.elemSize();
+        arena.reset();
+
+        // The first two runs only warm the caches and size the arena.
+        if(i >= 0) {
+            times.push_back(ms);
+            for(int e = 0; perf && e < PerfCounters::EventCount; ++e) {
+                const qint64 value = perf->value(static_cast<PerfCounters::Event>(e));
+                counted[e] = counted[e] && value >= 0;
+                counterSums[e] += value;
+            }
+        }
+    }
+
+    BenchResult result;
+    std::sort(times.begin(), times.end());
+    result.medianMs = times[times.size() / 2];
+    result.meanMs = 0;
+    for(size_t i = 0; i < times.size(); ++i) {
+        result.meanMs += times[i];
+    }
+    result.meanMs /= times.size();
+
+    const double pixels = sources.first().total();
+    const size_t spill = arenaBytes > l2_cache_size() ? 2 * arenaBytes : 0;
+    result.modelledDramBytesPerPixel = (ioBytes + spill) / pixels;
+
+    for(int e = 0; e < PerfCounters::EventCount; ++e) {
+        result.counters[e] = perf && counted[e] ? counterSums[e] / frames : -1;
+    }
+
+    result.allocationsPerFrame = 0;
+    result.heapBytesPerFrame = 0;
+    result.peakHeapBytes = 0;
+    foreach (const AllocStats::Counts &counts, AllocStats::takeCounts()) {
+        if(counts.name == stage->traceName()) {
+            result.allocationsPerFrame = double(counts.allocations) / frames;
+            result.heapBytesPerFrame = double(counts.bytes) / frames;
+            result.peakHeapBytes = counts.peakLiveBytes;
+        }
+    }
+    return result;
+}
+
+static int runGate(QTextStream &out, const QList<FilterStage*> &stages, const QString &settingsDir,
+                   const QList<cv::Mat> &sources, const QString &source, int frames, int repeats,
+                   const QString &baselineFile, bool record)
+{
+    // Before timing anything, which takes minutes.
+    PerfBaseline baseline;
+    if(!record && !baseline.load(baselineFile)) {
+        out << baseline.errorString() << endl;
+        return 1;
+    }
+
+    PerfBaseline current;
+    current.source = source;
+    current.frames = frames;
+
+    foreach (FilterStage *stage, stages) {
+        const QString settings = settingsDir + (stage->role() == FilterStage::Optics
+                                                ? "/OpticalSettings.json" : "/MethodSettings.json");
+        const FilterParams params = loadDefaultParams(settings, stage->name());
+
+        for(int lineBuffered = 0; lineBuffered < 2; ++lineBuffered) {
+            stage->setLineBuffered(lineBuffered);
+            std::vector<double> medians;
+            for(int r = 0; r < repeats; ++r) {
+                medians.push_back(run(stage, params, sources, frames, 0).medianMs);
+            }
+            current.kernels.insert(stage->name() + (lineBuffered ? "/strips" : "/frame"),
+                                   KernelTiming::fromRuns(medians));
+        }
+    }
+
+    if(record) {
+        if(!current.save(baselineFile)) {
+            out << "cannot write " << baselineFile << endl;
+            return 1;
+        }
+        out << "baseline for " << source << " written to " << baselineFile << endl;
+        return 0;
+    }
+
+    out << "gate: " << source << ", " << repeats << " runs of " << frames << " frames per kernel" << endl;
+    return baseline.compare(current, out) ? 0 : 1;
+}
+
+static int runVerify(QTextStream &out, const QList<FilterStage*> &stages, const QString &settingsDir,
+                     const QList<VerifyFrame> &frames)
+{
+    out << "differential check, " << frames.size() << " frames" << endl;
+    out << qSetFieldWidth(16) << left << "stage" << "mode" << "cases" << "max error" << "mean error"
+        << "min PSNR dB" << "allowed" << "result" << qSetFieldWidth(0) << endl;
+
+    bool passed = true;
+    foreach (FilterStage *stage, stages) {
+        const QString settings = settingsDir + (stage->role() == FilterStage::Optics
+                                                ? "/OpticalSettings.json" : "/MethodSettings.json");
+        passed = verifyStage(stage, parameterSweep(settings, stage->name()), frames, out) && passed;
+    }
+    return passed ? 0 : 1;
+}
+
+static int runTuning(QTextStream &out, const QList<FilterStage*> &stages, const QString &settingsDir,
+                     const cv::Mat &frame, int repeats)
+{
+    out << "slider moves on a still " << frame.cols << "x" << frame.rows << " frame, median of "
+        << repeats << " runs" << endl;
+    out << qSetFieldWidth(16) << left << "stage" << "slider" << "full ms" << "memo ms" << "share"
+        << "rerun" << qSetFieldWidth(0) << endl;
+
+    foreach (FilterStage *stage, stages) {
+        const QString settings = settingsDir + (stage->role() == FilterStage::Optics
+                                                ? "/OpticalSettings.json" : "/MethodSettings.json");
+        const FilterParams defaults = loadDefaultParams(settings, stage->name());
+        const FilterParams maximum = loadParamField(settings, stage->name(), "max");
+        FrameArena arena;
+
+        foreach (const QString &name, defaults.keys()) {
+            FilterParams moved = defaults;
+            moved[name] += defaults[name] < maximum.value(name) ? 1 : -1;
+
+            std::vector<double> full, memoised;
+            FilterMemo memo;
+            for(int r = 0; r < repeats; ++r) {
+                memo.begin(1);
+                stage->processMemoised(frame, defaults, &memo);
+
+                QElapsedTimer timer;
+                timer.start();
+                memo.begin(1);
+                stage->processMemoised(frame, moved, &memo);
+                memoised.push_back(timer.nsecsElapsed() / 1e6);
+
+                cv::Mat input = frame.clone();
+                timer.restart();
+                stage->process(input, moved, &arena);
+                full.push_back(timer.nsecsElapsed() / 1e6);
+                arena.reset();
+            }
+
+            const double fullMs = KernelTiming::fromRuns(full).medianMs;
+            const double memoMs = KernelTiming::fromRuns(memoised).medianMs;
+            out << qSetFieldWidth(16) << left << stage->name() << name
+                << QString::number(fullMs, 'f', 2) << QString::number(memoMs, 'f', 2)
+                << QString("%1%").arg(qRound(100 * memoMs / std::max(fullMs, 1e-6)))
+                << QString("%1/%2").arg(memo.computed()).arg(memo.computed() + memo.reused())
+                << qSetFieldWidth(0) << endl;
+        }
+    }
+    return 0;
+}
+
+static QString perfRow(const QString &stage, const QString &mode, const BenchResult &result, double pixels)
+{
+    const double cycles = result.counters[PerfCounters::Cycles];
+    const double instructions = result.counters[PerfCounters::Instructions];
+    const double llcMisses = result.counters[PerfCounters::LlcMisses];
+
+    QStringList columns;
+    columns << stage << mode;
+    columns << (cycles > 0 ? QString::number(cycles / pixels, 'f', 2) : QString("n/a"));
+    columns << (cycles > 0 && instructions >= 0 ? QString::number(instructions / cycles, 'f', 2) : QString("n/a"));
+    const PerfCounters::Event perKilopixel[] = { PerfCounters::L1dMisses, PerfCounters::LlcMisses,
+                                                 PerfCounters::BranchMisses };
+    for(PerfCounters::Event event : perKilopixel) {
+        const double value = result.counters[event];
+        columns << (value >= 0 ? QString::number(value * 1000 / pixels, 'f', 2) : QString("n/a"));
+    }
+    columns << (cycles > 0 && llcMisses >= 0 ? QString::number(llcMisses * 64 / cycles, 'f', 3) : QString("n/a"));
+    columns << (llcMisses >= 0 ? QString::number(llcMisses * 64 / pixels, 'f', 1) : QString("n/a"));
+
+    QString row;
+    foreach (const QString &column, columns) {
+        row += column.leftJustified(16);
+    }
+    return row;
+}
+
+static int runConversions(QTextStream &out, const QString &filename)
+{
+    const ConversionCostTable builtin = ConversionCostTable::builtin();
+    const ConversionCostTable measured = ConversionCostTable::measure();
+
+    out << "conversion to working layout, ns/pixel (builtin in brackets)" << endl;
+    out << qSetFieldWidth(24) << left << "format" << "SD" << "HD" << "UHD" << qSetFieldWidth(0) << endl;
+
+    foreach (QVideoFrame::PixelFormat format, measured.formats()) {
+        const ConversionCostTable::Entry entry = measured.entry(format);
+        out << qSetFieldWidth(24) << left << ConversionCostTable::formatName(format);
+        for (int c = 0; c < ConversionCostTable::SizeClassCount; ++c) {
+            out << QString("%1 (%2)").arg(entry.nsPerPixel[c], 0, 'f', 2)
+                   .arg(builtin.entry(format).nsPerPixel[c], 0, 'f', 2);
+        }
+        out << qSetFieldWidth(0) << endl;
+    }
+
+    const QSize hd = ConversionCostTable::representativeSize(ConversionCostTable::HD);
+    QStringList order;
+    foreach (QVideoFrame::PixelFormat format, measured.rank(measured.formats(), hd)) {
+        order << ConversionCostTable::formatName(format);
+    }
+    out << "advertised order at HD: " << order.join(" ") << endl;
+
+    if (!filename.isEmpty() && !measured.save(filename)) {
+        out << "cannot write " << filename << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    int width = 1920;
+    int height = 1080;
+    int frames = 30;
+    QString settingsDir = "../player";
+    bool conversions = false;
+    QString conversionsFile;
+    QString corpusFile;
+    bool perfCounters = false;
+    QString baselineFile;
+    bool recordBaseline = false;
+    int repeats = 7;
+    bool verify = false;
+    bool tuning = false;
+
+    foreach (const QString &arg, app.arguments().mid(1)) {
+        if(arg.startsWith("--size=")) {
+            QStringList size = arg.mid(7).split('x');
+            if(size.size() == 2) {
+                width = size[0].toInt();
+                height = size[1].toInt();
+            }
+        } else if(arg.startsWith("--frames=")) {
+            frames = std::max(1, arg.mid(9).toInt());
+        } else if(arg.startsWith("--settings=")) {
+            settingsDir = arg.mid(11);
+        } else if(arg == "--conversions") {
+            conversions = true;
+        } else if(arg.startsWith("--write=")) {
+            conversionsFile = arg.mid(8);
+        } else if(arg.startsWith("--corpus=")) {
+            corpusFile = arg.mid(9);
+        } else if(arg == "--perf") {
+            perfCounters = true;
+        } else if(arg.startsWith("--gate=")) {
+            baselineFile = arg.mid(7);
+        } else if(arg.startsWith("--write-baseline=")) {
+            baselineFile = arg.mid(17);
+            recordBaseline = true;
+        } else if(arg.startsWith("--repeats=")) {
+            repeats = std::max(3, arg.mid(10).toInt());
+        } else if(arg == "--verify") {
+            verify = true;
+        } else if(arg == "--tuning") {
+            tuning = true;
+        } else {
+            out << "usage: bench [--size=WxH | --corpus=FILE] [--frames=N] [--settings=DIR] [--perf]" << endl
+                << "       bench --conversions [--write=FILE]" << endl
+                << "       bench --gate=BASELINE | --write-baseline=FILE [--repeats=N]"
+                << " [--size=WxH | --corpus=FILE] [--frames=N]" << endl
+                << "       bench --verify [--corpus=FILE] [--settings=DIR]" << endl
+                << "       bench --tuning [--size=WxH | --corpus=FILE] [--repeats=N]" << endl;
+            return 2;
+        }
+    }
+
+    if(conversions) {
+        return runConversions(out, conversionsFile);
+    }
+
+    QList<cv::Mat> sources;
+    if(corpusFile.isEmpty()) {
+        sources << syntheticFrame(width, height);
+    } else {
+        FrameCorpus corpus;
+        if(!corpus.open(corpusFile)) {
+            out << corpus.errorString() << endl;
+            return 1;
+        }
+        sources = corpusFrames(corpus);
+        if(sources.isEmpty()) {
+            out << corpusFile << ": no frames in a supported format" << endl;
+            return 1;
+        }
+        width = sources.first().cols;
+        height = sources.first().rows;
+    }
+    const double pixels = sources.first().total();
+
+    QList<FilterStage*> stages;
+    stages << createOpticStage("SharpContrast") << createMethodStage("NeonEdge");
+
+    if(verify) {
+        QList<VerifyFrame> frames = verificationFrames();
+        if(!corpusFile.isEmpty()) {
+            for(int i = 0; i < sources.size(); ++i) {
+                VerifyFrame frame = { QString("%1 #%2").arg(QFileInfo(corpusFile).fileName()).arg(i), sources[i] };
+                frames.append(frame);
+            }
+        }
+        const int code = runVerify(out, stages, settingsDir, frames);
+        qDeleteAll(stages);
+        return code;
+    }
+
+    if(tuning) {
+        const int code = runTuning(out, stages, settingsDir, sources.first(), repeats);
+        qDeleteAll(stages);
+        return code;
+    }
+
+    if(!baselineFile.isEmpty()) {
+        const QString source = corpusFile.isEmpty() ? QString("synthetic %1x%2").arg(width).arg(height)
+                                                    : QFileInfo(corpusFile).fileName();
+        const int code = runGate(out, stages, settingsDir, sources, source, frames, repeats,
+                                 baselineFile, recordBaseline);
+        qDeleteAll(stages);
+        return code;
+    }
+
+    out << "frame " << width << "x" << height << ", " << frames << " frames"
+        << (corpusFile.isEmpty() ? QString() : QString(" from %1 (%2 distinct)").arg(corpusFile).arg(sources.size()))
+        << ", L2 "
+        << l2_cache_size() / 1024 << " KiB" << endl;
+    out << qSetFieldWidth(16) << left << "stage" << "mode" << "median ms" << "mean ms"
+        << "MPix/s" << "model DRAM B/px" << "allocs/f" << "heap KiB/f" << "peak KiB" << qSetFieldWidth(0) << endl;
+
+    AllocStats::setEnabled(true);
+
+    PerfCounters counters;
+    PerfCounters *perf = 0;
+    if(perfCounters) {
+        if(counters.open()) {
+            perf = &counters;
+            cv::setNumThreads(1);
+        } else {
+            out << "hardware counters unavailable: " << counters.errorString() << endl;
+        }
+    }
+    QStringList perfRows;
+
+    foreach (FilterStage *stage, stages) {
+        const QString settings = settingsDir + (stage->role() == FilterStage::Optics
+                                                ? "/OpticalSettings.json" : "/MethodSettings.json");
+        const FilterParams params = loadDefaultParams(settings, stage->name());
+
+        for(int lineBuffered = 0; lineBuffered < 2; ++lineBuffered) {
+            stage->setLineBuffered(lineBuffered);
+            const BenchResult result = run(stage, params, sources, frames, perf);
+            out << qSetFieldWidth(16) << left << stage->name() << (lineBuffered ? "strips" : "frame")
+                << QString::number(result.medianMs, 'f', 2)
+                << QString::number(result.meanMs, 'f', 2)
+                << QString::number(pixels / (result.medianMs * 1000), 'f', 1)
+                << QString::number(result.modelledDramBytesPerPixel, 'f', 1)
+                << QString::number(result.allocationsPerFrame, 'f', 1)
+                << QString::number(result.heapBytesPerFrame / 1024, 'f', 0)
+                << QString::number(result.peakHeapBytes / 1024.0, 'f', 0)
+                << qSetFieldWidth(0) << endl;
+
+            if(perf) {
+                perfRows << perfRow(stage->name(), lineBuffered ? "strips" : "frame", result, pixels);
+            }
+        }
+    }
+    out << "peak RSS " << AllocStats::peakResidentBytes() / (1024 * 1024) << " MiB" << endl;
+
+    if(perf) {
+        out << endl << "hardware counters per frame, single-threaded (n/a: not offered here)" << endl;
+        out << qSetFieldWidth(16) << left << "stage" << "mode" << "cycles/px" << "IPC"
+            << "L1d miss/kpx" << "LLC miss/kpx" << "br miss/kpx" << "LLC B/cycle" << "LLC B/px" << qSetFieldWidth(0)
+            << endl;
+        foreach (const QString &row, perfRows) {
+            out << row << endl;
+        }
+    }
+
+    qDeleteAll(stages);
+    return 0;
+}
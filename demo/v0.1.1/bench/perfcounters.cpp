@@ -0,0 +1,127 @@
+#include "perfcounters.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+
+#if defined(__linux__)
+struct EventConfig
+{
+    quint32 type;
+    quint64 config;
+};
+
+const EventConfig eventConfigs[PerfCounters::EventCount] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+int open_event(const EventConfig &event, int groupFd)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.disabled = groupFd < 0;
+    // User space only: allowed at perf_event_paranoid 2, and the kernels
+    // are all user code anyway.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+#endif
+
+}
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < EventCount; ++i) {
+        fds[i] = -1;
+        values[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+#if defined(__linux__)
+    for (int i = 0; i < EventCount; ++i) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::open()
+{
+#if defined(__linux__)
+    if (isOpen()) {
+        return true;
+    }
+
+    // One group, so all counters cover exactly the same instructions.
+    fds[Cycles] = open_event(eventConfigs[Cycles], -1);
+    if (fds[Cycles] < 0) {
+        error = QString("perf_event_open: %1").arg(QString::fromLocal8Bit(std::strerror(errno)));
+        if (errno == EACCES || errno == EPERM) {
+            error += " (check /proc/sys/kernel/perf_event_paranoid)";
+        }
+        return false;
+    }
+    for (int i = Cycles + 1; i < EventCount; ++i) {
+        fds[i] = open_event(eventConfigs[i], fds[Cycles]);
+    }
+    return true;
+#else
+    error = "hardware counters need Linux perf_event";
+    return false;
+#endif
+}
+
+void PerfCounters::start()
+{
+#if defined(__linux__)
+    if (isOpen()) {
+        ioctl(fds[Cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[Cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+void PerfCounters::stop()
+{
+#if defined(__linux__)
+    if (!isOpen()) {
+        return;
+    }
+    ioctl(fds[Cycles], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    for (int i = 0; i < EventCount; ++i) {
+        values[i] = -1;
+        quint64 reading[3];
+        if (fds[i] < 0 || read(fds[i], reading, sizeof(reading)) != sizeof(reading)) {
+            continue;
+        }
+        // reading: value, time enabled, time running.
+        if (reading[2] == 0) {
+            continue;
+        }
+        values[i] = static_cast<qint64>(reading[0] * (double(reading[1]) / reading[2]));
+    }
+#endif
+}
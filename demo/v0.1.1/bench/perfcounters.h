@@ -0,0 +1,48 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <QString>
+
+// Linux perf_event hardware counters for the calling thread, read around a
+// measured call:
+//
+//   counters.start();
+//   stage->process(...);
+//   counters.stop();
+//   counters.value(PerfCounters::Cycles);
+//
+// Only the calling thread is counted, so work OpenCV hands to its own
+// threads is missed; callers that want whole kernels run OpenCV on one
+// thread. Counters the CPU or hypervisor does not offer read as -1, and
+// without perf_event at all (not Linux, a VM without a PMU, or
+// perf_event_paranoid too strict) open() fails and everything reads -1.
+class PerfCounters
+{
+public:
+    enum Event { Cycles, Instructions, L1dMisses, LlcMisses, BranchMisses, EventCount };
+
+    PerfCounters();
+    ~PerfCounters();
+
+    // True if at least cycles can be counted.
+    bool open();
+    bool isOpen() const { return fds[Cycles] >= 0; }
+    QString errorString() const { return error; }
+
+    void start();
+    void stop();
+
+    // Count between the last start() and stop(), scaled up if the kernel
+    // had to multiplex the counters; -1 if unavailable.
+    qint64 value(Event event) const { return values[event]; }
+
+private:
+    PerfCounters(const PerfCounters &);
+    PerfCounters &operator=(const PerfCounters &);
+
+    int fds[EventCount];
+    qint64 values[EventCount];
+    QString error;
+};
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,157 @@
+#include "perfgate.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+double median_of(std::vector<double> values)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+// MAD x 1.4826 estimates the standard deviation of normal noise, without
+// letting one descheduled run dominate it.
+const double mad_to_sigma = 1.4826;
+const double noise_sigmas = 3;
+
+}
+
+KernelTiming KernelTiming::fromRuns(const std::vector<double> &ms)
+{
+    KernelTiming timing;
+    timing.runs = static_cast<int>(ms.size());
+    timing.medianMs = median_of(ms);
+
+    std::vector<double> deviations;
+    for (size_t i = 0; i < ms.size(); ++i) {
+        deviations.push_back(std::fabs(ms[i] - timing.medianMs));
+    }
+    timing.madMs = median_of(deviations);
+    return timing;
+}
+
+PerfBaseline::PerfBaseline()
+    : frames(0)
+{
+}
+
+bool PerfBaseline::load(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QFile::ReadOnly)) {
+        error = QString("cannot read %1").arg(filename);
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+        error = QString("%1: not a baseline (%2 at offset %3)")
+                .arg(filename).arg(parseError.errorString()).arg(parseError.offset);
+        return false;
+    }
+
+    const QJsonObject root = document.object();
+    source = root["source"].toString();
+    frames = root["frames"].toInt();
+
+    kernels.clear();
+    const QJsonObject kernelObj = root["kernels"].toObject();
+    foreach (const QString &name, kernelObj.keys()) {
+        const QJsonObject entry = kernelObj[name].toObject();
+        KernelTiming timing;
+        timing.medianMs = entry["median_ms"].toDouble();
+        timing.madMs = entry["mad_ms"].toDouble();
+        timing.runs = entry["runs"].toInt();
+        if (timing.medianMs <= 0) {
+            error = QString("%1: kernel %2 has no median").arg(filename, name);
+            return false;
+        }
+        kernels.insert(name, timing);
+    }
+
+    // An empty baseline would let every run pass.
+    if (kernels.isEmpty()) {
+        error = QString("%1: no kernels recorded; run `make perfbaseline` on the reference machine")
+                .arg(filename);
+        return false;
+    }
+    return true;
+}
+
+bool PerfBaseline::save(const QString &filename) const
+{
+    QJsonObject kernelObj;
+    for (auto it = kernels.constBegin(); it != kernels.constEnd(); ++it) {
+        QJsonObject entry;
+        entry["median_ms"] = it.value().medianMs;
+        entry["mad_ms"] = it.value().madMs;
+        entry["runs"] = it.value().runs;
+        kernelObj[it.key()] = entry;
+    }
+
+    QJsonObject root;
+    root["source"] = source;
+    root["frames"] = frames;
+    root["kernels"] = kernelObj;
+
+    QFile file(filename);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson());
+    return true;
+}
+
+bool PerfBaseline::compare(const PerfBaseline &current, QTextStream &out, double minRegression) const
+{
+    if (!source.isEmpty() && source != current.source) {
+        out << "warning: baseline measured " << source << ", this run " << current.source << endl;
+    }
+
+    out << qSetFieldWidth(20) << left << "kernel" << qSetFieldWidth(12) << right
+        << "base ms" << "now ms" << "delta %" << "limit %" << qSetFieldWidth(0) << "  verdict" << endl;
+
+    bool ok = true;
+    for (auto it = current.kernels.constBegin(); it != current.kernels.constEnd(); ++it) {
+        const KernelTiming &now = it.value();
+        out << qSetFieldWidth(20) << left << it.key() << qSetFieldWidth(12) << right;
+
+        if (!kernels.contains(it.key())) {
+            out << "-" << QString::number(now.medianMs, 'f', 2) << "-" << "-"
+                << qSetFieldWidth(0) << "  no baseline" << endl;
+            continue;
+        }
+
+        const KernelTiming base = kernels[it.key()];
+        const double noise = noise_sigmas * mad_to_sigma
+                             * std::sqrt(base.madMs * base.madMs + now.madMs * now.madMs);
+        const double limitMs = std::max(minRegression * base.medianMs, noise);
+        const double delta = now.medianMs - base.medianMs;
+
+        QString verdict = "ok";
+        if (delta > limitMs) {
+            verdict = "REGRESSION";
+            ok = false;
+        } else if (-delta > limitMs) {
+            verdict = "faster";
+        }
+
+        out << QString::number(base.medianMs, 'f', 2)
+            << QString::number(now.medianMs, 'f', 2)
+            << QString::number(delta / base.medianMs * 100, 'f', 1)
+            << QString::number(limitMs / base.medianMs * 100, 'f', 1)
+            << qSetFieldWidth(0) << "  " << verdict << endl;
+    }
+    return ok;
+}
@@ -0,0 +1,51 @@
+#ifndef PERFGATE_H
+#define PERFGATE_H
+
+#include <QMap>
+#include <QString>
+#include <QTextStream>
+
+#include <vector>
+
+// Median and median absolute deviation of repeated runs of one kernel.
+struct KernelTiming
+{
+    KernelTiming() : medianMs(0), madMs(0), runs(0) {}
+
+    static KernelTiming fromRuns(const std::vector<double> &ms);
+
+    double medianMs;
+    double madMs;
+    int runs;
+};
+
+// Kernel timings recorded on a reference machine, and the check of a new
+// run against them. Kernels are named "Stage/mode", e.g. "NeonEdge/strips".
+//
+// A kernel regresses when its median is slower than the baseline's by
+// more than minRegression (5%) and by more than three standard deviations
+// of the combined run-to-run noise, estimated from both MADs. Kernels
+// missing from the baseline are reported but never fail; a baseline that
+// does not parse or records no kernels at all does not load.
+class PerfBaseline
+{
+public:
+    PerfBaseline();
+
+    bool load(const QString &filename);
+    bool save(const QString &filename) const;
+    QString errorString() const { return error; }
+
+    // What was measured: "synthetic 1920x1080" or the corpus file name.
+    QString source;
+    int frames;
+    QMap<QString, KernelTiming> kernels;
+
+    // Prints the per-kernel delta table; returns false on any regression.
+    bool compare(const PerfBaseline &current, QTextStream &out, double minRegression = 0.05) const;
+
+private:
+    QString error;
+};
+
+#endif // PERFGATE_H
@@ -0,0 +1,195 @@
+#include "reference.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace cv;
+
+// Copied from the original neonedge.h and sharpcontrast.h. The only change
+// is that the lookup tables are locals instead of globals.
+namespace {
+
+Scalar get_rgb_from_hsv(int hue, int sat, int val, bool white_black = false) {
+    Mat color_mat(1, 1, CV_8UC3, Scalar(hue, sat, val));
+    Mat temp;
+    cvtColor(color_mat, temp, COLOR_HSV2RGB);
+    Vec3b color = temp.at<Vec3b>(0, 0);
+
+    if (white_black) {
+        if (hue == 0) {
+            return Scalar(0, 0, 0);
+        }
+        else if (hue == 179) {
+            return Scalar(255, 255, 255);
+        }
+        return Scalar(color.val[0], color.val[1], color.val[2]);
+    }
+    else {
+        return Scalar(color.val[0], color.val[1], color.val[2]);
+    }
+}
+
+void calculate_lut(Mat& lut, Scalar color) {
+    for ( int i = 0; i < 256; ++i) {
+        float f = (i / 255.0f);
+        lut.at<Vec3b>(i)[0] = saturate_cast<uchar>(color[0] * f);
+        lut.at<Vec3b>(i)[1] = saturate_cast<uchar>(color[1] * f);
+        lut.at<Vec3b>(i)[2] = saturate_cast<uchar>(color[2] * f);
+    }
+}
+
+void calculate_sobel(Mat& gray, Mat& sobel, int scale, double weight,int bold) {
+    Mat sobel_x, sobel_y;
+    Sobel( gray, sobel_x, CV_16S, 1, 0, bold, scale, 11);
+    convertScaleAbs(sobel_x, sobel_x);
+    Sobel( gray, sobel_y, CV_16S, 0, 1, bold, scale, 11);
+    convertScaleAbs(sobel_y, sobel_y);
+    addWeighted( sobel_x, weight, sobel_y, weight, 0, sobel );
+}
+
+Mat EdgeAugumentation(Mat& src, const Mat& lut, int kernel,int scale, double weight_d, int bold, int cut,
+                      int intensity) {
+    Mat  gray, sobel, edges, color_edges,dst;
+
+    cvtColor(src, gray, COLOR_BGR2GRAY );
+    GaussianBlur(gray, gray, Size(kernel, kernel), 0, 0, BORDER_DEFAULT);
+    calculate_sobel(gray, sobel, scale, weight_d,bold);
+    cv::threshold(sobel, sobel, cut, 255, THRESH_TOZERO);
+    cvtColor(sobel, edges, COLOR_GRAY2BGR );
+    LUT(edges, lut, color_edges);
+    src.copyTo(edges, sobel);
+    src.setTo(Scalar(0, 0, 0), sobel);
+    addWeighted( edges, (intensity * 0.01), color_edges, (1 - (intensity * 0.01)), 0, edges );
+    add(src, edges, dst);
+
+    return dst;
+}
+
+Mat NeonEdge(Mat frame, int intensity, int kernel, int weight, int scale, int cut, int hue) {
+    int bold = 1;
+    Mat lut(1, 256, CV_8UC3);
+
+    (kernel > 3 && kernel % 2 == 0) ? kernel++ : kernel < 3 ? kernel = 3 : kernel;
+    (bold > 3 && bold % 2 == 0) ? bold++ : bold < 3 ? bold = 1 : bold;
+    const double weight_d = weight * 0.05;
+    calculate_lut(lut, get_rgb_from_hsv(hue, 255, 255, true));
+
+    return EdgeAugumentation(frame, lut, kernel, scale, weight_d, bold, cut, intensity);
+}
+
+Mat vibrance(Mat& src, const Mat& lutC) {
+    Mat dst, HSV;
+    src.copyTo(dst);
+
+    std::vector<Mat> hsv_planes;
+    cvtColor(src, HSV, COLOR_BGR2HSV);
+    split(HSV, hsv_planes);
+
+    LUT(hsv_planes[1], lutC, hsv_planes[1]);
+
+    merge(hsv_planes, HSV);
+    cvtColor(HSV, dst, COLOR_HSV2BGR);
+    return dst;
+}
+
+void calculate_lutC(Mat& lutC, float gamma) {
+    uchar* p = lutC.ptr();
+    for ( int i = 0; i < 256; ++i)
+        p[i] = saturate_cast<uchar>(std::pow((float)(i / 255.0f), 1/gamma) * 255.0f);
+}
+
+void calculate_lutDark(Mat& lutL, float gamma) {
+    uchar* p = lutL.ptr();
+    for ( int i = 0; i < 256; ++i)
+        p[i] = saturate_cast<uchar>(std::pow((float)(i / 255.0f), gamma) * 255.0f);
+}
+
+void calculate_lutLight(Mat& lutL, float gamma) {
+    uchar* p = lutL.ptr();
+    for ( int i = 0; i < 256; ++i)
+        p[i] = saturate_cast<uchar>(std::pow((float)(i / 255.0f), 1/gamma) * 255.0f);
+}
+
+Mat GammaVibrancePreprocessing(Mat& src,double gammal,double gammac,int DarkLight) {
+    Mat tmp,dst;
+    Mat lutL(1, 256, CV_8U);
+    Mat lutC(1, 256, CV_8U);
+
+    calculate_lutC(lutC, gammac);
+    if (DarkLight==0) {calculate_lutDark(lutL, gammal);}
+    if (DarkLight==1) {calculate_lutLight(lutL, gammal);}
+
+    LUT(src, lutL, tmp);
+    dst = vibrance(tmp, lutC);
+
+    return dst;
+}
+
+Mat SharpnessPreprocessing(Mat& src,double sigma,double threshold,double amount,int cliplimit,int Contrast ) {
+    Mat dst,tmp;
+
+    Mat lowContrastMask,sharpened,blurred;
+    GaussianBlur(src, blurred, Size(), sigma, sigma);
+    lowContrastMask = abs(src - blurred) < threshold;
+    sharpened = src*(1+amount) + blurred*(-(amount));
+    src.copyTo(sharpened, lowContrastMask);
+
+    cv::Mat lab_image;
+    cv::cvtColor(sharpened, lab_image, cv::COLOR_BGR2Lab);
+
+    std::vector<cv::Mat> lab_planes(3);
+    cv::split(lab_image, lab_planes);
+
+    cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
+    clahe->setClipLimit(cliplimit);
+    clahe->setTilesGridSize(Size(Contrast,Contrast));
+    clahe->apply(lab_planes[0], tmp);
+
+    tmp.copyTo(lab_planes[0]);
+    cv::merge(lab_planes, lab_image);
+
+    cv::cvtColor(lab_image, dst, cv::COLOR_Lab2BGR);
+
+    return dst;
+}
+
+Mat SharpContrast(Mat frame, int DarkLight, int Intensity, int Vibrance, int Sharpness, int Contrast) {
+    const int cliplimit=1;
+    const int sharpthreshold=1, sharpamount=1;
+
+    Intensity < 1 ? Intensity = 1 : Intensity;
+    Vibrance < 1 ? Vibrance = 1 : Vibrance;
+
+    const float gammal = 1+Intensity / 1000.f;
+    const float gammac = 1+Vibrance / 1000.f;
+
+    if (Sharpness==0) Sharpness=1;
+    if (Contrast==0) Contrast=1;
+
+    const double sigma = Sharpness+Sharpness/10.f;
+    const double threshold = sharpthreshold+sharpthreshold/10.f;
+    const double amount = sharpamount+sharpamount/10.f;
+
+    Mat final = GammaVibrancePreprocessing(frame, gammal, gammac, DarkLight);
+    return SharpnessPreprocessing(final, sigma,threshold,amount,cliplimit,Contrast);
+}
+
+}
+
+bool hasReference(const QString &stageName)
+{
+    return stageName == "NeonEdge" || stageName == "SharpContrast";
+}
+
+cv::Mat referenceProcess(const QString &stageName, cv::Mat frame, const FilterParams &params)
+{
+    if (stageName == "NeonEdge") {
+        return NeonEdge(frame, params.value("intensity"), params.value("kernel"), params.value("weight"),
+                        params.value("scale"), params.value("cut"), params.value("hue"));
+    }
+    if (stageName == "SharpContrast") {
+        return SharpContrast(frame, params.value("DarkLight"), params.value("Intensity"),
+                             params.value("Vibrance"), params.value("Sharpness"), params.value("Contrast"));
+    }
+    return cv::Mat();
+}
@@ -0,0 +1,19 @@
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include <QString>
+
+#include <opencv/cv.hpp>
+
+#include "filterstage.h"
+
+// The filters as they were before any of the optimised paths existed: one
+// whole-frame pass, heap temporaries, nothing shared with the player's
+// kernels. bench --verify checks every stage against these, so a change to
+// those kernels cannot move the reference along with it. Do not optimise.
+//
+// frame may be written to.
+bool hasReference(const QString &stageName);
+cv::Mat referenceProcess(const QString &stageName, cv::Mat frame, const FilterParams &params);
+
+#endif // REFERENCE_H
@@ -0,0 +1,218 @@
+#include "verify.h"
+#include "filtermemo.h"
+#include "reference.h"
+#include "taskscheduler.h"
+
+#include <QSize>
+#include <QStringList>
+#include <QThread>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+QString describe(const FilterParams &params)
+{
+    QStringList parts;
+    for (FilterParams::const_iterator it = params.constBegin(); it != params.constEnd(); ++it) {
+        parts << QString("%1=%2").arg(it.key()).arg(it.value());
+    }
+    return parts.join(" ");
+}
+
+QString decibels(double psnr)
+{
+    return std::isinf(psnr) ? QString("inf") : QString::number(psnr, 'f', 1);
+}
+
+}
+
+FrameError::FrameError()
+    : maxError(0)
+    , meanError(0)
+    , psnr(std::numeric_limits<double>::infinity())
+    , comparable(true)
+{
+}
+
+FrameError FrameError::between(const cv::Mat &reference, const cv::Mat &result)
+{
+    FrameError error;
+    if (reference.size() != result.size() || reference.type() != result.type()) {
+        error.comparable = false;
+        return error;
+    }
+
+    cv::Mat diff;
+    cv::absdiff(reference, result, diff);
+    diff = diff.reshape(1);
+    cv::minMaxLoc(diff, 0, &error.maxError);
+    error.meanError = cv::mean(diff)[0];
+
+    const double mse = cv::norm(reference, result, cv::NORM_L2SQR) / diff.total();
+    if (mse > 0) {
+        error.psnr = 10 * std::log10(255.0 * 255.0 / mse);
+    }
+    return error;
+}
+
+QList<VerifyFrame> verificationFrames()
+{
+    const QSize sizes[] = { QSize(33, 17), QSize(641, 479), QSize(1917, 1079) };
+
+    QList<VerifyFrame> frames;
+    cv::theRNG().state = 0x5eed;
+    for (const QSize &size : sizes) {
+        const QString name = QString("%1x%2 ").arg(size.width()).arg(size.height());
+
+        cv::Mat noise(size.height(), size.width(), CV_8UC3);
+        cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(256));
+        cv::Mat smooth;
+        cv::GaussianBlur(noise, smooth, cv::Size(7, 7), 0);
+
+        // 7x7 blocks of saturated colours: full-scale steps in every
+        // direction, and block edges that never line up with a band.
+        cv::Mat blocks(size.height(), size.width(), CV_8UC3);
+        for (int y = 0; y < blocks.rows; ++y) {
+            for (int x = 0; x < blocks.cols; ++x) {
+                const int block = (y / 7) * 5 + x / 7;
+                blocks.at<cv::Vec3b>(y, x) = cv::Vec3b(block & 1 ? 255 : 0, block & 2 ? 255 : 0,
+                                                       block & 4 ? 255 : 0);
+            }
+        }
+
+        VerifyFrame cases[] = {
+            { name + "noise", noise },
+            { name + "smooth", smooth },
+            { name + "black", cv::Mat(size.height(), size.width(), CV_8UC3, cv::Scalar::all(0)) },
+            { name + "white", cv::Mat(size.height(), size.width(), CV_8UC3, cv::Scalar::all(255)) },
+            { name + "blocks", blocks }
+        };
+        for (const VerifyFrame &frame : cases) {
+            frames.append(frame);
+        }
+    }
+    return frames;
+}
+
+QList<FilterParams> parameterSweep(const QString &settingsFile, const QString &stageName, int randomSets)
+{
+    const FilterParams defaults = loadDefaultParams(settingsFile, stageName);
+    const FilterParams minimum = loadParamField(settingsFile, stageName, "min");
+    const FilterParams maximum = loadParamField(settingsFile, stageName, "max");
+
+    QList<FilterParams> sweep;
+    sweep << defaults;
+    foreach (const QString &name, defaults.keys()) {
+        FilterParams low = defaults;
+        low[name] = minimum.value(name);
+        FilterParams high = defaults;
+        high[name] = maximum.value(name);
+        sweep << low << high;
+    }
+    sweep << minimum << maximum;
+
+    cv::RNG rng(0x5eed);
+    for (int i = 0; i < randomSets; ++i) {
+        FilterParams params;
+        foreach (const QString &name, defaults.keys()) {
+            params[name] = rng.uniform(minimum.value(name), maximum.value(name) + 1);
+        }
+        sweep << params;
+    }
+    return sweep;
+}
+
+bool verifyStage(FilterStage *stage, const QList<FilterParams> &sweep, const QList<VerifyFrame> &frames,
+                 QTextStream &out)
+{
+    const FilterTolerance tolerance = stage->tolerance();
+    const QString allowed = QString("%1 / %2 dB").arg(tolerance.maxError).arg(decibels(tolerance.minPsnr));
+    bool passed = true;
+
+    if (!hasReference(stage->name())) {
+        out << qSetFieldWidth(16) << left << stage->name() << qSetFieldWidth(0)
+            << "no reference implementation in bench/reference.cpp  FAIL" << endl;
+        return false;
+    }
+
+    enum Mode { WholeFrame, Strips, Bands, Memoised };
+    const char *modeNames[] = { "frame", "strips", "bands", "memo" };
+    // Bands only go to the pool when there is more than one worker.
+    TaskScheduler pool(qMax(2, QThread::idealThreadCount()));
+
+    for (int mode = WholeFrame; mode <= Memoised; ++mode) {
+        stage->setLineBuffered(mode == Strips || mode == Bands);
+        stage->setTaskScheduler(mode == Bands ? &pool : 0);
+        // One arena for the whole sweep, as in the player, so a temporary
+        // that depends on what an earlier frame left behind shows up here.
+        FrameArena arena;
+        // Likewise one memo: each parameter set reuses what the previous
+        // set on the same frame left, as when a slider moves.
+        FilterMemo memo;
+        quint64 frameKey = 0;
+
+        int cases = 0;
+        int compared = 0;
+        double maxError = 0;
+        double meanError = 0;
+        double minPsnr = std::numeric_limits<double>::infinity();
+        QString firstFailure;
+
+        foreach (const VerifyFrame &frame, frames) {
+            ++frameKey;
+            foreach (const FilterParams &params, sweep) {
+                FrameError error;
+                error.comparable = false;
+                QString problem;
+                try {
+                    // Both get their own copy: the filters may write to the input.
+                    const cv::Mat expected = referenceProcess(stage->name(), frame.image.clone(), params);
+                    cv::Mat result;
+                    if (mode == Memoised) {
+                        memo.begin(frameKey);
+                        result = stage->processMemoised(frame.image, params, &memo);
+                    } else {
+                        result = stage->process(frame.image.clone(), params, &arena);
+                    }
+                    error = FrameError::between(expected, result);
+                    if (!error.comparable) {
+                        problem = "size or type differs from reference";
+                    } else if (error.maxError > tolerance.maxError || error.psnr < tolerance.minPsnr) {
+                        problem = QString("max error %1, PSNR %2 dB").arg(error.maxError)
+                                  .arg(decibels(error.psnr));
+                    }
+                } catch (const cv::Exception &e) {
+                    problem = QString("threw: %1").arg(QString::fromLocal8Bit(e.what()).trimmed());
+                }
+                arena.reset();
+                ++cases;
+
+                if (error.comparable) {
+                    ++compared;
+                    maxError = std::max(maxError, error.maxError);
+                    meanError += error.meanError;
+                    minPsnr = std::min(minPsnr, error.psnr);
+                }
+                if (!problem.isEmpty()) {
+                    passed = false;
+                    if (firstFailure.isEmpty()) {
+                        firstFailure = QString("  first failure: %1, %2: %3").arg(frame.label)
+                                       .arg(describe(params)).arg(problem);
+                    }
+                }
+            }
+        }
+
+        out << qSetFieldWidth(16) << left << stage->name() << modeNames[mode]
+            << cases << QString::number(maxError, 'f', 0) << QString::number(meanError / std::max(1, compared), 'f', 4)
+            << decibels(minPsnr) << allowed << (firstFailure.isEmpty() ? "ok" : "FAIL")
+            << qSetFieldWidth(0) << endl;
+        if (!firstFailure.isEmpty()) {
+            out << firstFailure << endl;
+        }
+    }
+    return passed;
+}
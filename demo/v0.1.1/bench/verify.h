@@ -0,0 +1,50 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <QList>
+#include <QString>
+#include <QTextStream>
+
+#include <opencv/cv.hpp>
+
+#include "filterstage.h"
+
+// How far one optimised result is from its reference, per channel value.
+struct FrameError
+{
+    FrameError();
+
+    static FrameError between(const cv::Mat &reference, const cv::Mat &result);
+
+    double maxError;
+    double meanError;
+    // Infinite for identical frames.
+    double psnr;
+    // False when size or type differ; nothing else is meaningful then.
+    bool comparable;
+};
+
+struct VerifyFrame
+{
+    QString label;
+    cv::Mat image;
+};
+
+// Synthetic frames at odd sizes (so no row is a multiple of the SIMD width
+// and the last band is short), each as noise, smoothed noise, flat black,
+// flat white and hard-edged blocks. The same frames on every run.
+QList<VerifyFrame> verificationFrames();
+
+// Every parameter at its default, each slider alone at its min and at its
+// max, all at min, all at max, and a few seeded random combinations, from
+// the limits the settings file gives the sliders.
+QList<FilterParams> parameterSweep(const QString &settingsFile, const QString &stageName, int randomSets = 4);
+
+// Runs process(), whole-frame and line-buffered with a reused arena, and
+// processMemoised() with a reused memo, against referenceProcess() on every frame with every parameter set. Prints one
+// row per mode and the first failing case; false if any case exceeds the
+// stage's tolerance() or either path throws.
+bool verifyStage(FilterStage *stage, const QList<FilterParams> &sweep, const QList<VerifyFrame> &frames,
+                 QTextStream &out);
+
+#endif // VERIFY_H
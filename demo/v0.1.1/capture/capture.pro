@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = capture
+
+CONFIG += console c++11 native_decoder
+CONFIG -= app_bundle
+
+SOURCES   += main.cpp
+
+include(../player/pipeline.pri)
+
+INCLUDEPATH += /usr/local/include/opencv
+INCLUDEPATH += /usr/local/include/opencv2
+INCLUDEPATH += /usr/local/include
+
+LIBS += -L/usr/local/lib
+LIBS += -lopencv_core
+LIBS += -lopencv_imgproc
@@ -0,0 +1,93 @@
+// Decodes a video file once and stores the decoded frames as a raw frame
+// corpus (framecorpus.h), for bench --corpus and headless --corpus to
+// replay without the decoder.
+//
+//   capture [--input=FILE] --output=FILE [--frames=N] [--decode-threads=N]
+//
+// The input defaults to the clip in tests/data. Frames are kept in the
+// format the decoder hands out (ARGB32), so a corpus is about
+// width * height * 4 bytes per frame.
+
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QThread>
+
+#include "framecorpus.h"
+#include "nativedecoder.h"
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QString input = "../../../tests/data/videoplayback.mp4";
+    QString output;
+    int maxFrames = -1;
+    int decodeThreads = 0;
+
+    foreach (const QString &arg, app.arguments().mid(1)) {
+        if(arg.startsWith("--input=")) {
+            input = arg.mid(8);
+        } else if(arg.startsWith("--output=")) {
+            output = arg.mid(9);
+        } else if(arg.startsWith("--frames=")) {
+            maxFrames = arg.mid(9).toInt();
+        } else if(arg.startsWith("--decode-threads=")) {
+            decodeThreads = arg.mid(17).toInt();
+        } else {
+            output.clear();
+            break;
+        }
+    }
+
+    if(output.isEmpty()) {
+        err << "usage: capture [--input=FILE] --output=FILE [--frames=N] [--decode-threads=N]" << endl;
+        return 2;
+    }
+
+    NativeDecoder decoder;
+    decoder.setPaced(false);
+    decoder.setDecodeThreads(decodeThreads);
+    if(!decoder.open(input)) {
+        err << decoder.errorString() << endl;
+        return 1;
+    }
+
+    FrameCorpusWriter writer;
+    if(!writer.open(output)) {
+        err << writer.errorString() << endl;
+        return 1;
+    }
+
+    FrameRing ring(16);
+    decoder.setFrameRing(&ring);
+    decoder.start();
+
+    FrameHandle frame;
+    while(maxFrames < 0 || writer.frameCount() < maxFrames) {
+        if(ring.pop(&frame)) {
+            if(!writer.write(frame)) {
+                err << writer.errorString() << endl;
+                return 1;
+            }
+            frame = FrameHandle();
+            continue;
+        }
+        if(decoder.atEnd() && ring.size() == 0) {
+            break;
+        }
+        QThread::usleep(100);
+    }
+    decoder.stop();
+
+    if(!writer.finish()) {
+        err << writer.errorString() << endl;
+        return 1;
+    }
+
+    const QSize size = decoder.frameSize();
+    out << output << ": " << writer.frameCount() << " frames of "
+        << size.width() << "x" << size.height() << " from " << input << endl;
+    return writer.frameCount() > 0 ? 0 : 1;
+}
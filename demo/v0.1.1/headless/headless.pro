@@ -0,0 +1,20 @@
+TEMPLATE = app
+TARGET = headless
+
+CONFIG += console c++11 native_decoder
+CONFIG -= app_bundle
+
+HEADERS   += soak.h
+
+SOURCES   += main.cpp \
+    soak.cpp
+
+include(../player/pipeline.pri)
+
+INCLUDEPATH += /usr/local/include/opencv
+INCLUDEPATH += /usr/local/include/opencv2
+INCLUDEPATH += /usr/local/include
+
+LIBS += -L/usr/local/lib
+LIBS += -lopencv_core
+LIBS += -lopencv_imgproc
@@ -0,0 +1,313 @@
+// Runs a video file through the filter chain without a window or playback
+// pacing: frames are decoded by NativeDecoder as fast as the scheduler takes
+// them, and none are dropped.
+//
+//   headless --input=FILE [--decode-threads=N] [--threads=N] [--buffered-io]
+//            [--optics=NAME] [--method=NAME] [--settings=DIR]
+//   headless --corpus=FILE [--threads=N] ...
+//   headless --synthetic=SPEC [--threads=N] ...
+//
+// --corpus replays a raw frame corpus from the capture tool instead, so the
+// run measures the filters alone. --synthetic generates the frames (see
+// SyntheticSource::configure(); SPEC must include a frame count).
+//
+// --trace=FILE records the run as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev). --metrics=FILE writes the latency histograms and frame
+// counters as JSON, or as CSV when FILE ends in .csv.
+//
+// Heap use is reported per stage: Mat allocations per frame, bytes per
+// frame and the peak held at once (see AllocStats; build with
+// CONFIG+=count_allocations to count every allocation, not only Mats).
+//
+// --soak=DURATION (e.g. 90m, 12h; plain numbers are seconds) loops the
+// input until DURATION is up. Every --soak-interval=SECONDS (default 60)
+// it samples RSS, live heap and per-stage p99, and at the end fails the
+// run if memory grows faster than --max-memory-growth=MIB per hour
+// (default 8) or any p99 faster than --max-latency-growth=PERCENT per hour
+// (default 10). It also fails if frames stop flowing between two samples,
+// and exits with 2 when too few samples were taken to fit a trend. In a
+// soak, latencies in the final table cover the last interval only.
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThread>
+
+#include <atomic>
+
+#include "allocstats.h"
+#include "corpussource.h"
+#include "filterstage.h"
+#include "framescheduler.h"
+#include "metrics.h"
+#include "syncmonitor.h"
+#include "nativedecoder.h"
+#include "soak.h"
+#include "syntheticsource.h"
+#include "taskscheduler.h"
+#include "tracing.h"
+
+// "90m" -> 5400; 0 if unreadable.
+static qint64 durationSeconds(QString text)
+{
+    qint64 scale = 1;
+    if(text.endsWith("h")) {
+        scale = 3600;
+    } else if(text.endsWith("m")) {
+        scale = 60;
+    }
+    if(text.endsWith("h") || text.endsWith("m") || text.endsWith("s")) {
+        text.chop(1);
+    }
+    return qMax<qint64>(0, text.toLongLong() * scale);
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QString input;
+    QString corpusFile;
+    QString syntheticSpec;
+    QString traceFile;
+    QString metricsFile;
+    qint64 soakSeconds = 0;
+    int soakInterval = 60;
+    SoakMonitor soak;
+    QString opticName = "SharpContrast";
+    QString methodName = "NeonEdge";
+    QString settingsDir = "../player";
+    int decodeThreads = 0;
+    int threads = 0;
+    bool bufferedIo = false;
+
+    foreach (const QString &arg, app.arguments().mid(1)) {
+        if(arg.startsWith("--input=")) {
+            input = arg.mid(8);
+        } else if(arg.startsWith("--corpus=")) {
+            corpusFile = arg.mid(9);
+        } else if(arg.startsWith("--synthetic=")) {
+            syntheticSpec = arg.mid(12);
+        } else if(arg.startsWith("--trace=")) {
+            traceFile = arg.mid(8);
+        } else if(arg.startsWith("--metrics=")) {
+            metricsFile = arg.mid(10);
+        } else if(arg.startsWith("--soak=")) {
+            soakSeconds = durationSeconds(arg.mid(7));
+        } else if(arg.startsWith("--soak-interval=")) {
+            soakInterval = qMax(1, arg.mid(16).toInt());
+        } else if(arg.startsWith("--max-memory-growth=")) {
+            soak.setMaxMemoryGrowth(arg.mid(20).toDouble());
+        } else if(arg.startsWith("--max-latency-growth=")) {
+            soak.setMaxLatencyGrowth(arg.mid(21).toDouble());
+        } else if(arg.startsWith("--decode-threads=")) {
+            decodeThreads = arg.mid(17).toInt();
+        } else if(arg.startsWith("--threads=")) {
+            threads = arg.mid(10).toInt();
+        } else if(arg == "--buffered-io") {
+            bufferedIo = true;
+        } else if(arg.startsWith("--optics=")) {
+            opticName = arg.mid(9);
+        } else if(arg.startsWith("--method=")) {
+            methodName = arg.mid(9);
+        } else if(arg.startsWith("--settings=")) {
+            settingsDir = arg.mid(11);
+        } else {
+            input.clear();
+            corpusFile.clear();
+            syntheticSpec.clear();
+            break;
+        }
+    }
+
+    const int inputs = !input.isEmpty() + !corpusFile.isEmpty() + !syntheticSpec.isEmpty();
+    if(inputs != 1) {
+        err << "usage: headless --input=FILE [--decode-threads=N] [--threads=N] [--buffered-io]" << endl
+            << "                [--optics=NAME] [--method=NAME] [--settings=DIR]" << endl
+            << "       headless --corpus=FILE | --synthetic=SPEC" << endl
+            << "                [--threads=N] [--optics=NAME] [--method=NAME] [--settings=DIR]" << endl
+            << "       any of the above with [--trace=FILE] [--metrics=FILE]" << endl
+            << "                [--soak=DURATION [--soak-interval=SECONDS]" << endl
+            << "                 [--max-memory-growth=MIB] [--max-latency-growth=PERCENT]]" << endl;
+        return 2;
+    }
+
+    QScopedPointer<FilterStage> optic(createOpticStage(opticName));
+    QScopedPointer<FilterStage> method(createMethodStage(methodName));
+
+    FilterChain chain;
+    if(optic) {
+        FilterInvocation step = { optic.data(), loadDefaultParams(settingsDir + "/OpticalSettings.json", opticName) };
+        chain.append(step);
+    }
+    if(method) {
+        FilterInvocation step = { method.data(), loadDefaultParams(settingsDir + "/MethodSettings.json", methodName) };
+        chain.append(step);
+    }
+
+    NativeDecoder decoder;
+    CorpusSource corpus;
+    SyntheticSource synthetic;
+    FrameSource *source = &decoder;
+    QSize size;
+
+    if(!syntheticSpec.isEmpty()) {
+        if(!synthetic.configure(syntheticSpec) || synthetic.duration() < 0) {
+            err << (synthetic.errorString().isEmpty() ? QString("--synthetic needs a frame count")
+                                                      : synthetic.errorString()) << endl;
+            return 1;
+        }
+        size = synthetic.frameSize();
+        source = &synthetic;
+        input = "synthetic " + syntheticSpec;
+    } else if(corpusFile.isEmpty()) {
+        decoder.setDecodeThreads(decodeThreads);
+        decoder.setMemoryMapped(!bufferedIo);
+        if(!decoder.open(input)) {
+            err << decoder.errorString() << endl;
+            return 1;
+        }
+        size = decoder.frameSize();
+    } else {
+        if(!corpus.open(corpusFile)) {
+            err << corpus.errorString() << endl;
+            return 1;
+        }
+        if(corpus.frames().frameCount() > 0) {
+            size = QSize(corpus.frames().record(0).width, corpus.frames().record(0).height);
+        }
+        source = &corpus;
+        input = corpusFile;
+    }
+
+    FrameRing ring(16);
+    source->setPaced(false);
+    source->setFrameRing(&ring);
+
+    TaskScheduler tasks(threads);
+    FrameScheduler scheduler(&tasks);
+
+    std::atomic<quint64> processed(0);
+    // There is no paint here; a frame is done when it leaves the scheduler.
+    QObject::connect(&scheduler, &FrameScheduler::frameProcessed, [&processed](QImage, qint64 startTime) {
+        SyncMonitor::instance().markPainted(startTime, -1);
+        ++processed;
+    });
+
+    Tracing::setEnabled(!traceFile.isEmpty());
+    AllocStats::setEnabled(true);
+    AllocStats::takeCounts();
+
+    QElapsedTimer timer;
+    timer.start();
+    source->start();
+
+    // Only take a frame off the ring when a slot is free, so the scheduler
+    // never drops and the source waits on the ring instead.
+    FrameHandle frame;
+    qint64 nextSample = soakInterval * 1000LL;
+    int passes = 1;
+    for(;;) {
+        if(soakSeconds > 0) {
+            if(timer.elapsed() >= nextSample) {
+                soak.sample(timer.elapsed() / 3600000.0, processed.load(), out);
+                nextSample += soakInterval * 1000LL;
+            }
+            if(timer.elapsed() >= soakSeconds * 1000) {
+                break;
+            }
+        }
+        if(scheduler.hasCapacity() && ring.pop(&frame)) {
+            scheduler.submit(frame, chain);
+            frame = FrameHandle();
+            continue;
+        }
+        if(source->atEnd() && ring.size() == 0) {
+            if(soakSeconds == 0) {
+                break;
+            }
+            // Starts over once the last frames of this pass are through,
+            // so timestamps never go backwards inside the scheduler.
+            scheduler.waitForDone();
+            source->seek(0);
+            ++passes;
+            continue;
+        }
+        // The source wakes the ring when it ends; the timeout only bounds
+        // how late a soak sample is taken.
+        const int wait = soakSeconds > 0 ? int(qBound<qint64>(1, nextSample - timer.elapsed(), 1000)) : 1000;
+        if(!scheduler.hasCapacity()) {
+            scheduler.waitForCapacity(wait);
+        } else {
+            ring.waitForFrames(wait);
+        }
+    }
+    scheduler.waitForDone();
+
+    const double seconds = timer.nsecsElapsed() / 1e9;
+    out << input << ": " << size.width() << "x" << size.height() << endl
+        << (source == &decoder ? "decoded " : source == &corpus ? "replayed " : "generated ")
+        << source->deliveredFrames()
+        << " frames, processed " << processed.load()
+        << " in " << QString::number(seconds, 'f', 2) << " s ("
+        << QString::number(processed.load() / seconds, 'f', 1) << " fps)" << endl
+        << "decode threads " << (source != &decoder ? QString("none")
+                                 : decodeThreads > 0 ? QString::number(decodeThreads) : QString("auto"))
+        << ", worker threads " << tasks.threadCount() << endl;
+    if(soakSeconds > 0) {
+        out << "soak: " << passes << " passes over the input" << endl;
+    }
+
+    const MetricsSnapshot metrics = Metrics::instance().snapshot();
+    out << qSetFieldWidth(24) << left << "stage" << qSetFieldWidth(0)
+        << "  count     p50 ms     p99 ms     max ms" << endl;
+    for(auto it = metrics.histograms.constBegin(); it != metrics.histograms.constEnd(); ++it) {
+        const HistogramSnapshot &h = it.value();
+        out << qSetFieldWidth(24) << left << it.key() << qSetFieldWidth(7) << right << h.count
+            << qSetFieldWidth(11) << QString::number(h.percentile(50) / 1e6, 'f', 2)
+            << QString::number(h.percentile(99) / 1e6, 'f', 2)
+            << QString::number(h.max / 1e6, 'f', 2) << qSetFieldWidth(0) << endl;
+    }
+    const double frames = qMax<quint64>(1, processed.load());
+    out << qSetFieldWidth(24) << left << "allocations" << qSetFieldWidth(12) << right
+        << "allocs/frame" << "KiB/frame" << "peak KiB" << qSetFieldWidth(0) << endl;
+    foreach (const AllocStats::Counts &counts, AllocStats::takeCounts()) {
+        if(counts.allocations == 0) {
+            continue;
+        }
+        out << qSetFieldWidth(24) << left << counts.name << qSetFieldWidth(12) << right
+            << QString::number(counts.allocations / frames, 'f', 1)
+            << QString::number(counts.bytes / frames / 1024, 'f', 1)
+            << QString::number(counts.peakLiveBytes / 1024.0, 'f', 0) << qSetFieldWidth(0) << endl;
+    }
+    out << "peak RSS " << AllocStats::peakResidentBytes() / (1024 * 1024) << " MiB" << endl;
+    AllocStats::setEnabled(false);
+
+    if(!metricsFile.isEmpty() && !metrics.save(metricsFile)) {
+        err << "cannot write " << metricsFile << endl;
+    }
+
+    if(!traceFile.isEmpty()) {
+        Tracing::setEnabled(false);
+        if(!Tracing::writeChromeTrace(traceFile)) {
+            err << "cannot write " << traceFile << endl;
+        } else if(Tracing::droppedEvents() > 0) {
+            err << "trace: " << Tracing::droppedEvents() << " events dropped (buffers full)" << endl;
+        }
+    }
+
+    // A soak stops mid-pass, with frames still on the ring.
+    if(soakSeconds > 0) {
+        switch(soak.evaluate(out)) {
+        case SoakMonitor::Passed:
+            return 0;
+        case SoakMonitor::Failed:
+            return 1;
+        case SoakMonitor::Inconclusive:
+            return 2;
+        }
+    }
+    return processed.load() == source->deliveredFrames() ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+#include "soak.h"
+
+#include "allocstats.h"
+#include "metrics.h"
+
+#include <QStringList>
+
+#include <functional>
+
+namespace {
+
+// Samples before this are warm-up and not fitted.
+const int warmup_samples = 2;
+// Fewer fitted samples than this say nothing about a trend.
+const int min_fitted_samples = 3;
+
+struct Line
+{
+    double slope;
+    double intercept;
+};
+
+// Least-squares fit of value against hours.
+Line fit(const QList<SoakSample> &samples, const std::function<double(const SoakSample &)> &value)
+{
+    const int n = samples.size();
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    foreach (const SoakSample &s, samples) {
+        const double y = value(s);
+        sx += s.hours;
+        sy += y;
+        sxx += s.hours * s.hours;
+        sxy += s.hours * y;
+    }
+
+    Line line;
+    const double denominator = n * sxx - sx * sx;
+    line.slope = denominator != 0 ? (n * sxy - sx * sy) / denominator : 0;
+    line.intercept = (sy - line.slope * sx) / n;
+    return line;
+}
+
+}
+
+SoakMonitor::SoakMonitor()
+    : maxMemoryGrowth(8)
+    , maxLatencyGrowth(10)
+{
+}
+
+void SoakMonitor::sample(double hours, quint64 frames, QTextStream &out)
+{
+    SoakSample s;
+    s.hours = hours;
+    s.frames = frames;
+    s.rssMiB = AllocStats::residentBytes() / (1024.0 * 1024.0);
+    s.heapLiveMiB = AllocStats::liveBytes() / (1024.0 * 1024.0);
+
+    const MetricsSnapshot metrics = Metrics::instance().snapshot(true);
+    for (auto it = metrics.histograms.constBegin(); it != metrics.histograms.constEnd(); ++it) {
+        if ((it.key().startsWith("stage.") || it.key().startsWith("filter.")) && it.value().count > 0) {
+            s.p99Ms.insert(it.key(), it.value().percentile(99) / 1e6);
+        }
+    }
+
+    const quint64 previousFrames = samples.isEmpty() ? 0 : samples.last().frames;
+    const double previousHours = samples.isEmpty() ? 0 : samples.last().hours;
+    const double fps = hours > previousHours ? (frames - previousFrames) / ((hours - previousHours) * 3600) : 0;
+    samples.append(s);
+
+    QStringList p99;
+    for (auto it = s.p99Ms.constBegin(); it != s.p99Ms.constEnd(); ++it) {
+        p99 << QString("%1 %2").arg(it.key()).arg(it.value(), 0, 'f', 2);
+    }
+    out << "soak " << QString::number(hours * 60, 'f', 0) << " min: "
+        << frames << " frames, " << QString::number(fps, 'f', 1) << " fps, RSS "
+        << QString::number(s.rssMiB, 'f', 1) << " MiB, heap live "
+        << QString::number(s.heapLiveMiB, 'f', 1) << " MiB, p99 ms: " << p99.join(", ") << endl;
+}
+
+SoakMonitor::Verdict SoakMonitor::evaluate(QTextStream &out) const
+{
+    const QList<SoakSample> fitted = samples.mid(warmup_samples);
+    if (fitted.size() < min_fitted_samples) {
+        out << "soak: " << samples.size() << " samples, too few to judge a trend (need "
+            << warmup_samples + min_fitted_samples << ")  INCONCLUSIVE" << endl;
+        return Inconclusive;
+    }
+
+    bool ok = true;
+    for (int i = 1; i < samples.size(); ++i) {
+        if (samples[i].frames <= samples[i - 1].frames) {
+            out << "soak: no frames processed between " << QString::number(samples[i - 1].hours * 60, 'f', 0)
+                << " and " << QString::number(samples[i].hours * 60, 'f', 0) << " min  FAIL" << endl;
+            ok = false;
+            break;
+        }
+    }
+
+    auto report = [&](const QString &what, double growth, double limit, const QString &unit) {
+        const bool over = growth > limit;
+        out << "soak trend " << what << ": " << (growth >= 0 ? "+" : "") << QString::number(growth, 'f', 2)
+            << " " << unit << " (limit " << limit << ")" << (over ? "  FAIL" : "") << endl;
+        ok = ok && !over;
+    };
+
+    if (fitted.first().rssMiB >= 0) {
+        report("RSS", fit(fitted, [](const SoakSample &s) { return s.rssMiB; }).slope,
+               maxMemoryGrowth, "MiB/h");
+    }
+    report("heap live", fit(fitted, [](const SoakSample &s) { return s.heapLiveMiB; }).slope,
+           maxMemoryGrowth, "MiB/h");
+
+    // Relative to where the fitted line starts, so fast and slow stages are
+    // held to the same limit.
+    foreach (const QString &stage, fitted.first().p99Ms.keys()) {
+        bool everywhere = true;
+        foreach (const SoakSample &s, fitted) {
+            everywhere = everywhere && s.p99Ms.contains(stage);
+        }
+        if (!everywhere) {
+            continue;
+        }
+        const Line line = fit(fitted, [stage](const SoakSample &s) { return s.p99Ms.value(stage); });
+        const double start = line.intercept + line.slope * fitted.first().hours;
+        if (start > 0) {
+            report(stage + " p99", line.slope / start * 100, maxLatencyGrowth, "%/h");
+        }
+    }
+
+    return ok ? Passed : Failed;
+}
@@ -0,0 +1,49 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QTextStream>
+
+struct SoakSample
+{
+    double hours;
+    quint64 frames;
+    double rssMiB;
+    double heapLiveMiB;
+    // p99 per stage and filter over the interval since the previous sample.
+    QMap<QString, double> p99Ms;
+};
+
+// Samples resident memory, live heap (AllocStats) and per-stage p99
+// latency at regular intervals of a long run, then fits a straight line
+// through each series and fails the run if any of them climbs faster than
+// its limit. The first samples are left out of the fit: caches, pools and
+// arenas are still growing to their working size then.
+class SoakMonitor
+{
+public:
+    enum Verdict { Passed, Failed, Inconclusive };
+
+    SoakMonitor();
+
+    // Limits per hour of run time; growth below them is taken as noise.
+    void setMaxMemoryGrowth(double mibPerHour) { maxMemoryGrowth = mibPerHour; }
+    void setMaxLatencyGrowth(double percentPerHour) { maxLatencyGrowth = percentPerHour; }
+
+    // Takes a sample now, printing it; frames is the total processed so far.
+    void sample(double hours, quint64 frames, QTextStream &out);
+
+    // Prints the trends. Failed if any is over its limit or no frames were
+    // processed between two samples (flat memory then proves nothing);
+    // Inconclusive if there are too few samples to fit a trend.
+    Verdict evaluate(QTextStream &out) const;
+
+private:
+    QList<SoakSample> samples;
+    double maxMemoryGrowth;
+    double maxLatencyGrowth;
+};
+
+#endif // SOAK_H
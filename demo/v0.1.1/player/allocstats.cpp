@@ -0,0 +1,331 @@
+#include "allocstats.h"
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+
+#include <opencv/cv.hpp>
+
+#include <cstdlib>
+#include <new>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_MAC
+#include <mach/mach.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <cstdio>
+#endif
+
+namespace AllocStats {
+
+std::atomic<bool> enabledFlag(false);
+
+class Account
+{
+public:
+    explicit Account(const QString &name)
+        : name(name)
+        , allocations(0)
+        , bytes(0)
+        , live(0)
+        , peak(0)
+    {
+    }
+
+    void allocated(size_t size)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        const qint64 now = live.fetch_add(size, std::memory_order_relaxed) + size;
+        qint64 high = peak.load(std::memory_order_relaxed);
+        while (now > high && !peak.compare_exchange_weak(high, now, std::memory_order_relaxed)) {
+        }
+    }
+
+    void freed(size_t size)
+    {
+        live.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    Counts take()
+    {
+        Counts counts;
+        counts.name = name;
+        counts.allocations = allocations.exchange(0, std::memory_order_relaxed);
+        counts.bytes = bytes.exchange(0, std::memory_order_relaxed);
+        counts.liveBytes = live.load(std::memory_order_relaxed);
+        counts.peakLiveBytes = peak.exchange(counts.liveBytes, std::memory_order_relaxed);
+        return counts;
+    }
+
+    qint64 liveBytes() const { return live.load(std::memory_order_relaxed); }
+
+private:
+    const QString name;
+    std::atomic<quint64> allocations;
+    std::atomic<quint64> bytes;
+    std::atomic<qint64> live;
+    std::atomic<qint64> peak;
+};
+
+}
+
+using AllocStats::Account;
+
+namespace {
+
+QMutex registryMutex;
+// Never freed: blocks charged to an account may outlive every scope.
+QMap<QString, Account*> accounts;
+
+// Set while the bookkeeping below allocates, so operator new leaves those
+// blocks uncharged instead of re-entering current() and registryMutex.
+thread_local bool bookkeeping = false;
+
+class Bookkeeping
+{
+public:
+    Bookkeeping() : outer(bookkeeping) { bookkeeping = true; }
+    ~Bookkeeping() { bookkeeping = outer; }
+
+private:
+    const bool outer;
+};
+
+Account *registered(const QString &name)
+{
+    Bookkeeping guard;
+    QMutexLocker locker(&registryMutex);
+    Account *&account = accounts[name];
+    if (!account) {
+        account = new Account(name);
+    }
+    return account;
+}
+
+Account *unscoped()
+{
+    static Account *account = registered("unscoped");
+    return account;
+}
+
+thread_local Account *currentAccount = 0;
+
+Account *current()
+{
+    return currentAccount ? currentAccount : unscoped();
+}
+
+// Charges each Mat's block to the account current when it was created,
+// via UMatData::userdata, which the CPU allocator leaves unused.
+class CountingAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data0,
+                           size_t *step, int flags, cv::UMatUsageFlags usageFlags) const
+    {
+        cv::MatAllocator *heap = cv::Mat::getStdAllocator();
+        cv::UMatData *u = heap->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        // Wrapping user memory allocates nothing worth counting.
+        if (!u || data0) {
+            return u;
+        }
+
+        Account *account = current();
+        account->allocated(u->size);
+        u->userdata = account;
+        u->currAllocator = u->prevAllocator = this;
+        return u;
+    }
+
+    bool allocate(cv::UMatData *data, int accessFlags, cv::UMatUsageFlags usageFlags) const
+    {
+        Q_UNUSED(accessFlags);
+        Q_UNUSED(usageFlags);
+        return data != 0;
+    }
+
+    void deallocate(cv::UMatData *data) const
+    {
+        if (!data) {
+            return;
+        }
+        static_cast<Account*>(data->userdata)->freed(data->size);
+        data->userdata = 0;
+
+        cv::MatAllocator *heap = cv::Mat::getStdAllocator();
+        data->currAllocator = data->prevAllocator = heap;
+        heap->deallocate(data);
+    }
+};
+
+CountingAllocator countingAllocator;
+
+}
+
+namespace AllocStats {
+
+void setEnabled(bool enabled)
+{
+    // Registered before anything is counted, not from inside operator new.
+    unscoped();
+    enabledFlag = enabled;
+    cv::Mat::setDefaultAllocator(enabled ? &countingAllocator : 0);
+}
+
+Account *enter(const char *name)
+{
+    // Scopes re-enter with the same few names on every frame; only the
+    // first time on each thread takes the lock.
+    thread_local QHash<const char*, Account*> cache;
+
+    Bookkeeping guard;
+    Account *previous = currentAccount;
+    Account *&account = cache[name];
+    if (!account) {
+        account = registered(QString::fromUtf8(name));
+    }
+    currentAccount = account;
+    return previous;
+}
+
+void leave(Account *previous)
+{
+    currentAccount = previous;
+}
+
+QList<Counts> takeCounts()
+{
+    unscoped();
+
+    QMutexLocker locker(&registryMutex);
+    QList<Counts> counts;
+    foreach (Account *account, accounts) {
+        counts.append(account->take());
+    }
+    return counts;
+}
+
+qint64 liveBytes()
+{
+    QMutexLocker locker(&registryMutex);
+    qint64 total = 0;
+    foreach (Account *account, accounts) {
+        total += account->liveBytes();
+    }
+    return total;
+}
+
+qint64 residentBytes()
+{
+#if defined(Q_OS_LINUX)
+    // Second field of statm: resident pages.
+    long pages = -1;
+    FILE *statm = std::fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return -1;
+    }
+    const bool ok = std::fscanf(statm, "%*s %ld", &pages) == 1;
+    std::fclose(statm);
+    return ok ? qint64(pages) * sysconf(_SC_PAGESIZE) : -1;
+#elif defined(Q_OS_MAC)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+        return -1;
+    }
+    return info.resident_size;
+#else
+    return -1;
+#endif
+}
+
+qint64 peakResidentBytes()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#ifdef Q_OS_MAC
+    return usage.ru_maxrss;
+#else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return -1;
+#endif
+}
+
+}
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+
+// Every block carries the size and account it was charged to, so a delete
+// on another thread or outside the scope still credits the right account.
+namespace {
+
+struct alignas(16) BlockHeader
+{
+    size_t size;
+    Account *account;
+};
+
+void *counted_new(size_t size)
+{
+    BlockHeader *header = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + size));
+    if (!header) {
+        throw std::bad_alloc();
+    }
+    header->size = size;
+    header->account = AllocStats::isEnabled() && !bookkeeping ? current() : 0;
+    if (header->account) {
+        header->account->allocated(size);
+    }
+    return header + 1;
+}
+
+void counted_delete(void *pointer)
+{
+    if (!pointer) {
+        return;
+    }
+    BlockHeader *header = static_cast<BlockHeader*>(pointer) - 1;
+    if (header->account) {
+        header->account->freed(header->size);
+    }
+    std::free(header);
+}
+
+}
+
+void *operator new(size_t size) { return counted_new(size); }
+void *operator new[](size_t size) { return counted_new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return counted_new(size);
+    } catch (...) {
+        return 0;
+    }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return counted_new(size);
+    } catch (...) {
+        return 0;
+    }
+}
+void operator delete(void *pointer) noexcept { counted_delete(pointer); }
+void operator delete[](void *pointer) noexcept { counted_delete(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { counted_delete(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { counted_delete(pointer); }
+void operator delete(void *pointer, size_t) noexcept { counted_delete(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { counted_delete(pointer); }
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <QList>
+#include <QString>
+
+#include <atomic>
+
+// Heap use per pipeline stage: how many allocations a stage makes, how many
+// bytes, and the most it holds at once.
+//
+//   ALLOC_SCOPE("NeonEdge");
+//
+// charges what this thread allocates until the end of the block to the
+// named account; anything outside a scope goes to "unscoped". Like
+// TRACE_SCOPE the name is kept as a pointer and must outlive the run.
+//
+// While enabled, OpenCV's default allocator is replaced by a counting one,
+// so every Mat a stage creates is seen. Mats built on a FrameArena are not:
+// that memory is reused rather than allocated. Builds with
+// CONFIG+=count_allocations (DEFINES += COUNT_HEAP_ALLOCATIONS) also replace
+// the global operator new and delete and count every other heap allocation
+// in the scope, at the cost of a header per block.
+namespace AllocStats {
+
+struct Counts
+{
+    Counts() : allocations(0), bytes(0), liveBytes(0), peakLiveBytes(0) {}
+
+    QString name;
+    quint64 allocations;
+    quint64 bytes;
+    qint64 liveBytes;
+    qint64 peakLiveBytes;
+};
+
+class Account;
+
+extern std::atomic<bool> enabledFlag;
+
+inline bool isEnabled() { return enabledFlag.load(std::memory_order_relaxed); }
+void setEnabled(bool enabled);
+
+// Per account since the previous call: allocations and bytes restart from
+// zero and the peak from what is live now.
+QList<Counts> takeCounts();
+
+// Bytes all accounts hold right now, without taking the counts.
+qint64 liveBytes();
+
+// The process's resident set now and at its high-water mark; -1 where
+// unknown.
+qint64 residentBytes();
+qint64 peakResidentBytes();
+
+Account *enter(const char *name);
+void leave(Account *previous);
+
+class Scope
+{
+public:
+    explicit Scope(const char *name)
+        : active(isEnabled())
+        , previous(active ? enter(name) : 0)
+    {
+    }
+
+    ~Scope()
+    {
+        if (active) {
+            leave(previous);
+        }
+    }
+
+private:
+    Scope(const Scope &);
+    Scope &operator=(const Scope &);
+
+    bool active;
+    Account *previous;
+};
+
+}
+
+#define ALLOC_CONCAT2(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT2(a, b)
+#define ALLOC_SCOPE(name) AllocStats::Scope ALLOC_CONCAT(allocScope, __LINE__)(name)
+
+#endif // ALLOCSTATS_H
@@ -0,0 +1,130 @@
+#include "benchmarkrun.h"
+
+#include <algorithm>
+
+static double percentile_ms(const std::vector<qint64> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const size_t rank = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[rank] / 1e6;
+}
+
+BenchmarkRun::BenchmarkRun()
+    : submitted(0)
+    , presented(0)
+    , presentBusy(0)
+    , finishing(false)
+{
+}
+
+void BenchmarkRun::start()
+{
+    clock.start();
+}
+
+void BenchmarkRun::frameSubmitted(qint64 startTime)
+{
+    ++submitted;
+    if (startTime >= 0) {
+        submittedAt.insert(startTime, clock.nsecsElapsed());
+    }
+}
+
+void BenchmarkRun::framePresented(qint64 startTime, qint64 presentNsecs)
+{
+    ++presented;
+    presentBusy += presentNsecs;
+
+    // Frames without a timestamp still count, they just have no latency.
+    QHash<qint64, qint64>::iterator it = submittedAt.find(startTime);
+    if (it != submittedAt.end()) {
+        latencies.push_back(clock.nsecsElapsed() - it.value());
+        submittedAt.erase(it);
+    }
+}
+
+void BenchmarkRun::addStageTime(const QString &name, qint64 nsecs, quint64 frames)
+{
+    for (int i = 0; i < stages.size(); ++i) {
+        if (stages[i].name == name) {
+            stages[i].busyNsecs += nsecs;
+            stages[i].frames += frames;
+            return;
+        }
+    }
+
+    StageStats stage;
+    stage.name = name;
+    stage.busyNsecs = nsecs;
+    stage.frames = frames;
+    stages.append(stage);
+}
+
+void BenchmarkRun::addStageStats(const QList<StageStats> &stats)
+{
+    // Decode and present are timed by the run itself; the pipeline's entries
+    // for them are frame counts only.
+    foreach (const StageStats &stage, stats) {
+        if (stage.name == "decode" || stage.name == "present") {
+            continue;
+        }
+        addStageTime(stage.name, stage.busyNsecs, stage.frames);
+    }
+}
+
+void BenchmarkRun::fail(const QString &message)
+{
+    failure = message;
+}
+
+bool BenchmarkRun::beginFinish()
+{
+    if (finishing) {
+        return false;
+    }
+    finishing = true;
+    return true;
+}
+
+int BenchmarkRun::exitCode(quint64 decoded) const
+{
+    return (!hasFailed() && decoded > 0 && presented == decoded) ? 0 : 1;
+}
+
+void BenchmarkRun::report(QTextStream &out, quint64 decoded) const
+{
+    const double seconds = clock.nsecsElapsed() / 1e9;
+
+    std::vector<qint64> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+
+    out << "frames: decoded " << decoded
+        << " submitted " << submitted
+        << " presented " << presented << endl;
+    out << "wall: " << QString::number(seconds, 'f', 3) << " s, "
+        << QString::number(seconds > 0 ? presented / seconds : 0, 'f', 1) << " fps" << endl;
+    out << "latency ms: p50 " << QString::number(percentile_ms(sorted, 0.50), 'f', 2)
+        << " p90 " << QString::number(percentile_ms(sorted, 0.90), 'f', 2)
+        << " p99 " << QString::number(percentile_ms(sorted, 0.99), 'f', 2)
+        << " max " << QString::number(sorted.empty() ? 0 : sorted.back() / 1e6, 'f', 2) << endl;
+
+    // Stages run concurrently, so these add up to more than the wall time.
+    StageStats present;
+    present.name = "present";
+    present.busyNsecs = presentBusy;
+    present.frames = presented;
+
+    out << "stage ms/frame:" << endl;
+    foreach (const StageStats &stage, stages + (QList<StageStats>() << present)) {
+        const double perFrame = stage.frames > 0 ? stage.busyNsecs / 1e6 / stage.frames : 0;
+        out << "  " << qSetFieldWidth(16) << left << stage.name << qSetFieldWidth(0)
+            << QString::number(perFrame, 'f', 3)
+            << " (" << stage.frames << " frames)" << endl;
+    }
+
+    if (hasFailed()) {
+        out << "error: " << failure << endl;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef BENCHMARKRUN_H
+#define BENCHMARKRUN_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QTextStream>
+
+#include <vector>
+
+#include "stagestats.h"
+
+// Bookkeeping for `player --benchmark=FILE`: every decoded frame goes through
+// the full GUI path with no pacing and no drops, and the run ends with one
+// report and an exit status.
+class BenchmarkRun
+{
+public:
+    BenchmarkRun();
+
+    void start();
+    qint64 elapsedNsecs() const { return clock.nsecsElapsed(); }
+
+    void frameSubmitted(qint64 startTime);
+    // presentNsecs is the GUI thread's time putting the frame on screen.
+    void framePresented(qint64 startTime, qint64 presentNsecs);
+    quint64 presentedFrames() const { return presented; }
+
+    // Accumulates busy time per stage name, keeping first-seen order;
+    // "present" is tracked by framePresented() and always reported last.
+    void addStageTime(const QString &name, qint64 nsecs, quint64 frames);
+    void addStageStats(const QList<StageStats> &stats);
+
+    void fail(const QString &message);
+    bool hasFailed() const { return !failure.isEmpty(); }
+
+    // Guards against queueing the end of the run twice.
+    bool beginFinish();
+
+    // 0 when every decoded frame was presented, 1 otherwise.
+    int exitCode(quint64 decoded) const;
+    void report(QTextStream &out, quint64 decoded) const;
+
+private:
+    QElapsedTimer clock;
+    QHash<qint64, qint64> submittedAt;
+    std::vector<qint64> latencies;
+    QList<StageStats> stages;
+    QString failure;
+    quint64 submitted;
+    quint64 presented;
+    qint64 presentBusy;
+    bool finishing;
+};
+
+#endif // BENCHMARKRUN_H
@@ -0,0 +1,44 @@
+#ifndef CACHEINFO_H
+#define CACHEINFO_H
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+inline size_t detect_l2_cache_size()
+{
+    long long size = 0;
+#if defined(__APPLE__)
+    size_t length = sizeof(size);
+    if (sysctlbyname("hw.l2cachesize", &size, &length, 0, 0) != 0) {
+        size = 0;
+    }
+#elif defined(_SC_LEVEL2_CACHE_SIZE)
+    size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    // Conservative default when the platform won't tell us.
+    return size > 0 ? static_cast<size_t>(size) : 256 * 1024;
+}
+
+// Per-core L2 size in bytes.
+inline size_t l2_cache_size()
+{
+    static const size_t size = detect_l2_cache_size();
+    return size;
+}
+
+// Rows per band so that one band of every intermediate, at bytesPerPixel in
+// total, takes about half of L2 and leaves room for the kernels' own state.
+inline int strip_rows_for(int cols, int bytesPerPixel, int minRows)
+{
+    const size_t budget = l2_cache_size() / 2;
+    const size_t rowBytes = static_cast<size_t>(std::max(1, cols)) * bytesPerPixel;
+    return std::max(minRows, static_cast<int>(budget / rowBytes));
+}
+
+#endif // CACHEINFO_H
@@ -0,0 +1,245 @@
+#include "conversioncost.h"
+#include "imageconvert.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace {
+
+struct FormatName
+{
+    QVideoFrame::PixelFormat format;
+    const char *name;
+};
+
+const FormatName formatNames[] = {
+    { QVideoFrame::Format_ARGB32, "ARGB32" },
+    { QVideoFrame::Format_ARGB32_Premultiplied, "ARGB32_Premultiplied" },
+    { QVideoFrame::Format_RGB32, "RGB32" },
+    { QVideoFrame::Format_RGB24, "RGB24" },
+    { QVideoFrame::Format_RGB565, "RGB565" },
+    { QVideoFrame::Format_RGB555, "RGB555" },
+    { QVideoFrame::Format_ARGB8565_Premultiplied, "ARGB8565_Premultiplied" },
+    { QVideoFrame::Format_BGRA32, "BGRA32" },
+    { QVideoFrame::Format_BGRA32_Premultiplied, "BGRA32_Premultiplied" },
+    { QVideoFrame::Format_BGR32, "BGR32" },
+    { QVideoFrame::Format_BGR24, "BGR24" },
+    { QVideoFrame::Format_BGR565, "BGR565" },
+    { QVideoFrame::Format_BGR555, "BGR555" },
+    { QVideoFrame::Format_BGRA5658_Premultiplied, "BGRA5658_Premultiplied" },
+    { QVideoFrame::Format_AYUV444, "AYUV444" },
+    { QVideoFrame::Format_AYUV444_Premultiplied, "AYUV444_Premultiplied" },
+    { QVideoFrame::Format_YUV444, "YUV444" },
+    { QVideoFrame::Format_YUV420P, "YUV420P" },
+    { QVideoFrame::Format_YV12, "YV12" },
+    { QVideoFrame::Format_UYVY, "UYVY" },
+    { QVideoFrame::Format_YUYV, "YUYV" },
+    { QVideoFrame::Format_NV12, "NV12" },
+    { QVideoFrame::Format_NV21, "NV21" },
+    { QVideoFrame::Format_IMC1, "IMC1" },
+    { QVideoFrame::Format_IMC2, "IMC2" },
+    { QVideoFrame::Format_IMC3, "IMC3" },
+    { QVideoFrame::Format_IMC4, "IMC4" },
+    { QVideoFrame::Format_Y8, "Y8" },
+    { QVideoFrame::Format_Y16, "Y16" },
+    { QVideoFrame::Format_Jpeg, "Jpeg" },
+    { QVideoFrame::Format_CameraRaw, "CameraRaw" },
+    { QVideoFrame::Format_AdobeDng, "AdobeDng" },
+};
+
+struct BuiltinCost
+{
+    QVideoFrame::PixelFormat format;
+    double sd, hd, uhd;
+    bool lossy;
+};
+
+// One swizzle pass each; the 32-bit formats drop a byte per pixel on the
+// way, the 16-bit ones unpack bitfields, Y8 only replicates.
+const BuiltinCost builtinCosts[] = {
+    { QVideoFrame::Format_RGB32, 0.35, 0.55, 0.70, false },
+    { QVideoFrame::Format_ARGB32, 0.35, 0.55, 0.70, false },
+    { QVideoFrame::Format_ARGB32_Premultiplied, 0.35, 0.55, 0.70, false },
+    { QVideoFrame::Format_RGB24, 0.30, 0.50, 0.65, false },
+    { QVideoFrame::Format_RGB565, 0.60, 0.75, 0.90, true },
+    { QVideoFrame::Format_RGB555, 0.60, 0.75, 0.90, true },
+    { QVideoFrame::Format_Y8, 0.25, 0.40, 0.55, true },
+};
+
+const int sizeClassWidths[ConversionCostTable::SizeClassCount] = { 640, 1920, 3840 };
+const int sizeClassHeights[ConversionCostTable::SizeClassCount] = { 480, 1080, 2160 };
+
+}
+
+ConversionCostTable ConversionCostTable::builtin()
+{
+    ConversionCostTable table;
+    for (const BuiltinCost &cost : builtinCosts) {
+        Entry entry;
+        entry.nsPerPixel[SD] = cost.sd;
+        entry.nsPerPixel[HD] = cost.hd;
+        entry.nsPerPixel[UHD] = cost.uhd;
+        entry.lossy = cost.lossy;
+        table.insert(cost.format, entry);
+    }
+    return table;
+}
+
+ConversionCostTable ConversionCostTable::measure(int repeats)
+{
+    const ConversionCostTable defaults = builtin();
+    ConversionCostTable table;
+
+    foreach (QVideoFrame::PixelFormat format, defaults.formats()) {
+        Entry entry = defaults.entry(format);
+
+        for (int c = 0; c < SizeClassCount; ++c) {
+            const QSize size = representativeSize(SizeClass(c));
+            cv::Mat pixels(pixel_format_mat_rows(format, size.height()), size.width(),
+                           pixel_format_mat_type(format));
+            cv::randu(pixels, cv::Scalar::all(0), cv::Scalar::all(255));
+
+            std::vector<qint64> times;
+            for (int i = -1; i < repeats; ++i) {
+                QElapsedTimer timer;
+                timer.start();
+                const cv::Mat converted = pixels_to_mat(pixels, format);
+                const qint64 elapsed = timer.nsecsElapsed();
+                // First run only faults the output pages in.
+                if (i >= 0 && !converted.empty()) {
+                    times.push_back(elapsed);
+                }
+            }
+            if (times.empty()) {
+                break;
+            }
+
+            std::sort(times.begin(), times.end());
+            entry.nsPerPixel[c] = double(times[times.size() / 2]) / (size.width() * size.height());
+        }
+        table.insert(format, entry);
+    }
+    return table;
+}
+
+ConversionCostTable ConversionCostTable::load(const QString &filename)
+{
+    ConversionCostTable table = builtin();
+
+    QFile jsonFile(filename);
+    if (!jsonFile.open(QFile::ReadOnly)) {
+        return table;
+    }
+
+    foreach (const QJsonValue &value, QJsonDocument::fromJson(jsonFile.readAll()).object()["conversions"].toArray()) {
+        const QJsonObject obj = value.toObject();
+        const QVideoFrame::PixelFormat format = formatFromName(obj["format"].toString());
+        const QJsonArray costs = obj["ns_per_pixel"].toArray();
+        if (format == QVideoFrame::Format_Invalid || costs.size() != SizeClassCount) {
+            continue;
+        }
+
+        Entry entry;
+        for (int c = 0; c < SizeClassCount; ++c) {
+            entry.nsPerPixel[c] = costs[c].toDouble();
+        }
+        entry.lossy = obj["lossy"].toBool();
+        table.insert(format, entry);
+    }
+    return table;
+}
+
+bool ConversionCostTable::save(const QString &filename) const
+{
+    QJsonArray conversions;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        QJsonArray costs;
+        for (int c = 0; c < SizeClassCount; ++c) {
+            costs.append(it.value().nsPerPixel[c]);
+        }
+
+        QJsonObject obj;
+        obj["format"] = formatName(it.key());
+        obj["ns_per_pixel"] = costs;
+        obj["lossy"] = it.value().lossy;
+        conversions.append(obj);
+    }
+
+    QJsonObject root;
+    root["conversions"] = conversions;
+
+    QFile jsonFile(filename);
+    if (!jsonFile.open(QFile::WriteOnly | QFile::Truncate)) {
+        return false;
+    }
+    return jsonFile.write(QJsonDocument(root).toJson()) >= 0;
+}
+
+ConversionCostTable::SizeClass ConversionCostTable::sizeClass(const QSize &size)
+{
+    // Split halfway between the representative sizes.
+    const qint64 pixels = qint64(size.width()) * size.height();
+    if (pixels <= (640 * 480 + 1920 * 1080) / 2) {
+        return SD;
+    }
+    if (pixels <= (1920 * 1080 + 3840 * 2160) / 2) {
+        return HD;
+    }
+    return UHD;
+}
+
+QSize ConversionCostTable::representativeSize(SizeClass sizeClass)
+{
+    return QSize(sizeClassWidths[sizeClass], sizeClassHeights[sizeClass]);
+}
+
+QString ConversionCostTable::formatName(QVideoFrame::PixelFormat format)
+{
+    for (const FormatName &entry : formatNames) {
+        if (entry.format == format) {
+            return entry.name;
+        }
+    }
+    return QString::number(int(format));
+}
+
+QVideoFrame::PixelFormat ConversionCostTable::formatFromName(const QString &name)
+{
+    for (const FormatName &entry : formatNames) {
+        if (name == entry.name) {
+            return entry.format;
+        }
+    }
+    return QVideoFrame::Format_Invalid;
+}
+
+double ConversionCostTable::frameCost(QVideoFrame::PixelFormat format, const QSize &size) const
+{
+    if (!entries.contains(format)) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return entries.value(format).nsPerPixel[sizeClass(size)] * size.width() * size.height();
+}
+
+QList<QVideoFrame::PixelFormat> ConversionCostTable::rank(const QList<QVideoFrame::PixelFormat> &formats,
+                                                          const QSize &size) const
+{
+    QList<QVideoFrame::PixelFormat> ranked = formats;
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [this, &size](QVideoFrame::PixelFormat a, QVideoFrame::PixelFormat b) {
+        const bool lossyA = !entries.contains(a) || entries.value(a).lossy;
+        const bool lossyB = !entries.contains(b) || entries.value(b).lossy;
+        if (lossyA != lossyB) {
+            return lossyB;
+        }
+        return frameCost(a, size) < frameCost(b, size);
+    });
+    return ranked;
+}
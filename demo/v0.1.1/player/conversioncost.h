@@ -0,0 +1,63 @@
+#ifndef CONVERSIONCOST_H
+#define CONVERSIONCOST_H
+
+#include <QList>
+#include <QMap>
+#include <QSize>
+#include <QString>
+#include <QVideoFrame>
+
+// What it costs to turn a frame of each pixel format into the filters'
+// working layout (pixels_to_mat()), in nanoseconds per pixel. Cost per
+// pixel changes with frame size as the frame falls out of cache, so each
+// format carries one figure per size class. Formats missing from the table
+// cannot be converted at all.
+class ConversionCostTable
+{
+public:
+    enum SizeClass { SD, HD, UHD, SizeClassCount };
+
+    struct Entry
+    {
+        double nsPerPixel[SizeClassCount];
+        // Fewer than 8 bits per colour channel: ranked after every
+        // full-depth format regardless of cost.
+        bool lossy;
+    };
+
+    // Rough defaults for a current desktop CPU. Replace them with
+    // `bench --conversions` figures for the machine at hand.
+    static ConversionCostTable builtin();
+
+    // Times pixels_to_mat() for every convertible format on this CPU.
+    static ConversionCostTable measure(int repeats = 20);
+
+    // Reads a table written by save(); formats it lacks keep their builtin
+    // figures. Returns the builtin table when the file cannot be read.
+    static ConversionCostTable load(const QString &filename);
+    bool save(const QString &filename) const;
+
+    static SizeClass sizeClass(const QSize &size);
+    static QSize representativeSize(SizeClass sizeClass);
+    static QString formatName(QVideoFrame::PixelFormat format);
+    static QVideoFrame::PixelFormat formatFromName(const QString &name);
+
+    void insert(QVideoFrame::PixelFormat format, const Entry &entry) { entries.insert(format, entry); }
+    bool contains(QVideoFrame::PixelFormat format) const { return entries.contains(format); }
+    QList<QVideoFrame::PixelFormat> formats() const { return entries.keys(); }
+    Entry entry(QVideoFrame::PixelFormat format) const { return entries.value(format); }
+
+    // Nanoseconds to convert one frame of the given size; infinite when the
+    // format is not convertible.
+    double frameCost(QVideoFrame::PixelFormat format, const QSize &size) const;
+
+    // Cheapest first: full-depth before lossy, convertible before not, and
+    // by frameCost() within each group. Ties keep their order in formats.
+    QList<QVideoFrame::PixelFormat> rank(const QList<QVideoFrame::PixelFormat> &formats,
+                                         const QSize &size) const;
+
+private:
+    QMap<QVideoFrame::PixelFormat, Entry> entries;
+};
+
+#endif // CONVERSIONCOST_H
@@ -0,0 +1,38 @@
+#include "corpussource.h"
+
+CorpusSource::CorpusSource(QObject *parent)
+    : FrameSource(parent)
+    , next(0)
+{
+}
+
+CorpusSource::~CorpusSource()
+{
+    stop();
+}
+
+bool CorpusSource::open(const QString &filename)
+{
+    stop();
+    next = 0;
+    return corpus.open(filename);
+}
+
+FrameHandle CorpusSource::nextFrame()
+{
+    if (next >= corpus.frameCount()) {
+        return FrameHandle();
+    }
+
+    const FrameHandle frame = corpus.frame(next++);
+    if (!frame.isValid()) {
+        fail(QString("cannot map corpus frame %1").arg(next - 1));
+    }
+    return frame;
+}
+
+bool CorpusSource::seekTo(qint64 position)
+{
+    next = corpus.indexAt(position);
+    return next < corpus.frameCount();
+}
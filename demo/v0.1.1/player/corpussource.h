@@ -0,0 +1,32 @@
+#ifndef CORPUSSOURCE_H
+#define CORPUSSOURCE_H
+
+#include "framecorpus.h"
+#include "framesource.h"
+
+// Replays a raw frame corpus (see framecorpus.h): the same frames on every
+// run, no decoder in the loop, and every frame a view into the mapped file.
+class CorpusSource : public FrameSource
+{
+    Q_OBJECT
+
+public:
+    explicit CorpusSource(QObject *parent = 0);
+    ~CorpusSource();
+
+    bool open(const QString &filename);
+    QString errorString() const { return corpus.errorString(); }
+
+    const FrameCorpus &frames() const { return corpus; }
+    qint64 duration() const { return corpus.duration(); }
+
+protected:
+    FrameHandle nextFrame();
+    bool seekTo(qint64 position);
+
+private:
+    FrameCorpus corpus;
+    int next;
+};
+
+#endif // CORPUSSOURCE_H
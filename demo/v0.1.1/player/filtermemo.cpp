@@ -0,0 +1,127 @@
+#include "filtermemo.h"
+
+namespace {
+
+// FNV-1a, one 32-bit value at a time.
+const quint64 fnv_offset = 14695981039346656037ULL;
+
+quint64 mix(quint64 hash, quint64 value)
+{
+    hash = (hash ^ (value & 0xffffffff)) * 1099511628211ULL;
+    return (hash ^ (value >> 32)) * 1099511628211ULL;
+}
+
+}
+
+FilterMemo::FilterMemo()
+    : runningKey(fnv_offset)
+    , next(0)
+    , reusedSteps(0)
+    , computedSteps(0)
+{
+}
+
+void FilterMemo::begin(quint64 inputKey)
+{
+    runningKey = mix(fnv_offset, inputKey);
+    next = 0;
+    reusedSteps = 0;
+    computedSteps = 0;
+}
+
+void FilterMemo::clear()
+{
+    entries.clear();
+    next = 0;
+}
+
+quint64 FilterMemo::nextKey(const FilterParams &params, std::initializer_list<const char*> reads)
+{
+    runningKey = mix(runningKey, next);
+    for (const char *name : reads) {
+        runningKey = mix(runningKey, quint64(params.value(name)));
+    }
+    return runningKey;
+}
+
+ChainMemo::ChainMemo()
+    : frame(-1)
+    , stagesReused(0)
+    , stepsReused(0)
+    , stepsComputed(0)
+{
+}
+
+cv::Mat ChainMemo::run(qint64 frameKey, const cv::Mat &source, const FilterChain &chain,
+                       const std::function<bool()> &cancelled)
+{
+    if (frameKey != frame || frameKey < 0) {
+        clear();
+        frame = frameKey;
+    }
+    stagesReused = 0;
+    stepsReused = 0;
+    stepsComputed = 0;
+
+    cv::Mat input = source;
+    quint64 inputKey = mix(fnv_offset, quint64(frameKey));
+    bool changed = false;
+
+    for (int i = 0; i < chain.size(); ++i) {
+        if (cancelled && cancelled()) {
+            // What is left was computed from inputs that have since changed.
+            if (changed) {
+                for (int j = i; j < steps.size(); ++j) {
+                    steps[j].output = cv::Mat();
+                }
+            }
+            return cv::Mat();
+        }
+
+        const FilterInvocation &invocation = chain[i];
+        if (i == steps.size()) {
+            steps.append(Step());
+            steps[i].stage = 0;
+        }
+        Step &step = steps[i];
+
+        if (step.stage != invocation.stage) {
+            step.stage = invocation.stage;
+            step.memo.clear();
+            changed = true;
+        }
+
+        // Everything from the first changed stage on runs again, inside
+        // its memo; a temporal stage always does.
+        if (changed || step.params != invocation.params || step.output.empty()
+                || step.stage->dependsOnPreviousFrame()) {
+            changed = true;
+            step.params = invocation.params;
+            step.output = cv::Mat();
+            step.memo.begin(inputKey);
+            step.output = step.stage->processMemoised(input, step.params, &step.memo);
+            stepsReused += step.memo.reused();
+            stepsComputed += step.memo.computed();
+        } else {
+            ++stagesReused;
+        }
+        input = step.output;
+
+        inputKey = mix(inputKey, quint64(quintptr(step.stage)));
+        for (FilterParams::const_iterator it = step.params.constBegin(); it != step.params.constEnd(); ++it) {
+            inputKey = mix(inputKey, qHash(it.key()));
+            inputKey = mix(inputKey, quint64(it.value()));
+        }
+    }
+
+    while (steps.size() > chain.size()) {
+        steps.removeLast();
+    }
+    return input;
+}
+
+void ChainMemo::clear()
+{
+    steps.clear();
+    frame = -1;
+}
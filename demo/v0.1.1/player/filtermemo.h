@@ -0,0 +1,112 @@
+#ifndef FILTERMEMO_H
+#define FILTERMEMO_H
+
+#include <QList>
+#include <QVector>
+
+#include <opencv/cv.hpp>
+
+#include <functional>
+#include <initializer_list>
+
+#include "filterstage.h"
+#include "tracing.h"
+
+// The intermediates of one stage on one input, kept between calls so that
+// a slider change recomputes only the steps that read the changed
+// parameter. A stage runs its steps in a fixed order and names the
+// parameters each one reads; a step's key covers those values and the key
+// of the step before it, so a change reruns that step and every step after
+// it, and a new input reruns everything.
+//
+// Results are shared with the memo: steps must not modify the results of
+// earlier steps in place, and must not allocate them from a FrameArena.
+// Not thread-safe; one memo per frame being tuned.
+class FilterMemo
+{
+public:
+    FilterMemo();
+
+    // Starts a pass over the input identified by inputKey.
+    void begin(quint64 inputKey);
+
+    template <typename Compute>
+    cv::Mat step(const char *name, const FilterParams &params, std::initializer_list<const char*> reads,
+                 Compute compute)
+    {
+        const quint64 key = nextKey(params, reads);
+        if (next < entries.size() && entries[next].key == key) {
+            ++reusedSteps;
+            return entries[next++].value;
+        }
+
+        TRACE_SCOPE(name);
+        entries.resize(next + 1);
+        entries[next].key = key;
+        entries[next].value = compute();
+        ++computedSteps;
+        return entries[next++].value;
+    }
+
+    void clear();
+
+    // Steps taken from the memo and steps run, since begin().
+    int reused() const { return reusedSteps; }
+    int computed() const { return computedSteps; }
+
+private:
+    struct Entry
+    {
+        quint64 key;
+        cv::Mat value;
+    };
+
+    quint64 nextKey(const FilterParams &params, std::initializer_list<const char*> reads);
+
+    QVector<Entry> entries;
+    quint64 runningKey;
+    int next;
+    int reusedSteps;
+    int computedSteps;
+};
+
+// The same across a filter chain: keeps the output of every stage for the
+// last frame, with each stage's FilterMemo, and reruns the chain from the
+// first stage whose parameters changed. For a paused or looping frame that
+// is processed again on every slider move.
+class ChainMemo
+{
+public:
+    ChainMemo();
+
+    // frameKey identifies the frame (its start time); a different key
+    // starts afresh. The result is the memo's: copy it before modifying it.
+    // cancelled is asked before each stage; once it says yes, run() stops
+    // there and returns an empty Mat, keeping the stages done so far.
+    cv::Mat run(qint64 frameKey, const cv::Mat &frame, const FilterChain &chain,
+                const std::function<bool()> &cancelled = std::function<bool()>());
+    void clear();
+
+    // Whole stages skipped in the last run, and steps reused and computed
+    // inside the stages that did run.
+    int reusedStages() const { return stagesReused; }
+    int reusedSteps() const { return stepsReused; }
+    int computedSteps() const { return stepsComputed; }
+
+private:
+    struct Step
+    {
+        FilterStage *stage;
+        FilterParams params;
+        cv::Mat output;
+        FilterMemo memo;
+    };
+
+    qint64 frame;
+    QList<Step> steps;
+    int stagesReused;
+    int stepsReused;
+    int stepsComputed;
+};
+
+#endif // FILTERMEMO_H
@@ -0,0 +1,140 @@
+#include "filterstage.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "filtermemo.h"
+#include "sharpcontrast.h"
+#include "neonedge.h"
+
+cv::Mat SharpContrastStage::process(cv::Mat frame, const FilterParams &params, FrameArena *arena)
+{
+    return SharpContrast(frame, params.value("DarkLight"), params.value("Intensity"),
+                         params.value("Vibrance"), params.value("Sharpness"), params.value("Contrast"), arena);
+}
+
+// SharpContrast() in its two halves: tone (gamma and vibrance) and detail
+// (unsharp mask and CLAHE).
+cv::Mat SharpContrastStage::processMemoised(const cv::Mat &frame, const FilterParams &params, FilterMemo *memo)
+{
+    const cv::Mat toned = memo->step("gamma vibrance", params, { "DarkLight", "Intensity", "Vibrance" }, [&]() {
+        const float gammal = 1 + std::max(1, params.value("Intensity")) / 1000.f;
+        const float gammac = 1 + std::max(1, params.value("Vibrance")) / 1000.f;
+        cv::Mat input = frame;
+        return GammaVibrancePreprocessing(input, gammal, gammac, params.value("DarkLight"));
+    });
+
+    return memo->step("sharpness contrast", params, { "Sharpness", "Contrast" }, [&]() {
+        const int sharpness = params.value("Sharpness") == 0 ? 1 : params.value("Sharpness");
+        const int contrast = params.value("Contrast") == 0 ? 1 : params.value("Contrast");
+        const int sharpthreshold = 1, sharpamount = 1;
+        cv::Mat input = toned;
+        return SharpnessPreprocessing(input, sharpness + sharpness / 10.f, sharpthreshold + sharpthreshold / 10.f,
+                                      sharpamount + sharpamount / 10.f, 1, contrast);
+    });
+}
+
+cv::Mat NeonEdgeStage::process(cv::Mat frame, const FilterParams &params, FrameArena *arena)
+{
+    return NeonEdge(frame, params.value("intensity"), params.value("kernel"), params.value("weight"),
+                    params.value("scale"), params.value("cut"), params.value("hue"), arena, isLineBuffered(),
+                    taskScheduler());
+}
+
+// The steps of EdgeAugumentation, each keyed by the sliders it reads, so
+// moving "hue" only recolours the edges and "intensity" only re-blends.
+cv::Mat NeonEdgeStage::processMemoised(const cv::Mat &frame, const FilterParams &params, FilterMemo *memo)
+{
+    const cv::Mat blurred = memo->step("blur", params, { "kernel" }, [&]() {
+        int kernel = params.value("kernel");
+        (kernel > 3 && kernel % 2 == 0) ? kernel++ : kernel < 3 ? kernel = 3 : kernel;
+        cv::Mat gray;
+        cv::cvtColor(frame, gray, COLOR_BGR2GRAY);
+        cv::GaussianBlur(gray, gray, Size(kernel, kernel), 0, 0, BORDER_DEFAULT);
+        return gray;
+    });
+
+    const cv::Mat sobel = memo->step("sobel", params, { "scale", "weight" }, [&]() {
+        cv::Mat input = blurred, result;
+        calculate_sobel(input, result, params.value("scale"), params.value("weight") * 0.05, 1);
+        return result;
+    });
+
+    const cv::Mat mask = memo->step("threshold", params, { "cut" }, [&]() {
+        cv::Mat result;
+        cv::threshold(sobel, result, params.value("cut"), 255, THRESH_TOZERO);
+        return result;
+    });
+
+    const cv::Mat colour = memo->step("lut", params, { "hue" }, [&]() {
+        cv::Mat lut(1, 256, CV_8UC3), edges, result;
+        calculate_lut(lut, params.value("intensity"), get_rgb_from_hsv(params.value("hue"), 255, 255, true));
+        cv::cvtColor(mask, edges, COLOR_GRAY2BGR);
+        cv::LUT(edges, lut, result);
+        return result;
+    });
+
+    return memo->step("merge", params, { "intensity" }, [&]() {
+        // As in EdgeAugumentation, but the source is masked into a copy.
+        const double intensity = params.value("intensity") * 0.01;
+        cv::Mat edges(frame.size(), frame.type(), Scalar::all(0)), masked = frame.clone(), result;
+        frame.copyTo(edges, mask);
+        masked.setTo(Scalar(0, 0, 0), mask);
+        cv::addWeighted(edges, intensity, colour, 1 - intensity, 0, edges);
+        cv::add(masked, edges, result);
+        return result;
+    });
+}
+
+FilterTolerance NeonEdgeStage::tolerance() const
+{
+    // The bands run the same blur and Sobel on sub-images, which OpenCV may
+    // hand to a different SIMD or IPP path than the whole frame; those round
+    // the 8-bit blur by at most one.
+    FilterTolerance bands = { 1, 60 };
+    return bands;
+}
+
+FilterStage *createOpticStage(const QString &name)
+{
+    if(name == "SharpContrast") {
+        return new SharpContrastStage();
+    }
+    return 0;
+}
+
+FilterStage *createMethodStage(const QString &name)
+{
+    if(name == "NeonEdge") {
+        return new NeonEdgeStage();
+    }
+    return 0;
+}
+
+FilterParams loadDefaultParams(const QString &settingsFile, const QString &stageName)
+{
+    return loadParamField(settingsFile, stageName, "default");
+}
+
+FilterParams loadParamField(const QString &settingsFile, const QString &stageName, const QString &field)
+{
+    FilterParams params;
+
+    QFile jsonFile(settingsFile);
+    if(!jsonFile.open(QFile::ReadOnly)) {
+        return params;
+    }
+
+    foreach (const QJsonValue &method, QJsonDocument::fromJson(jsonFile.readAll()).object()["methods"].toArray()) {
+        QJsonObject obj = method.toObject();
+        if(obj["name"].toString() != stageName) {
+            continue;
+        }
+        foreach (const QJsonValue &param, obj["params"].toArray()) {
+            params.insert(param.toObject()["par_name"].toString(), param.toObject()[field].toInt());
+        }
+    }
+    return params;
+}
@@ -0,0 +1,118 @@
+#ifndef FILTERSTAGE_H
+#define FILTERSTAGE_H
+
+#include <QList>
+#include <QMap>
+#include <QString>
+
+#include <opencv/cv.hpp>
+
+#include <limits>
+
+#include "framearena.h"
+
+typedef QMap<QString, int> FilterParams;
+
+class FilterMemo;
+class TaskScheduler;
+
+// How far process() may stray from the original, unoptimised filter (kept
+// frozen in bench/reference.cpp), checked by bench --verify:
+// the largest difference in any channel of any pixel, and the lowest PSNR
+// over a whole frame.
+struct FilterTolerance
+{
+    int maxError;
+    double minPsnr;
+};
+
+class FilterStage
+{
+public:
+    enum Role { Optics, Method };
+
+    FilterStage(const QString &name, Role role)
+        : stageName(name), traceLabel(name.toUtf8()), stageRole(role), lineBuffered(false), pool(0) {}
+    virtual ~FilterStage() {}
+
+    QString name() const { return stageName; }
+    Role role() const { return stageRole; }
+    // Lives as long as the stage, for TRACE_SCOPE.
+    const char *traceName() const { return traceLabel.constData(); }
+
+    // Stages that support it process the frame in L2-sized bands of rows
+    // instead of one whole-frame pass per step.
+    void setLineBuffered(bool enabled) { lineBuffered = enabled; }
+    bool isLineBuffered() const { return lineBuffered; }
+    // With a pool, those bands run as tasks on it rather than one after
+    // another on the calling thread.
+    void setTaskScheduler(TaskScheduler *scheduler) { pool = scheduler; }
+    TaskScheduler *taskScheduler() const { return pool; }
+
+    // A temporal stage carries state from one frame to the next, so the
+    // scheduler runs it strictly in submission order. Everything else may
+    // run on any number of frames at once.
+    virtual bool dependsOnPreviousFrame() const { return false; }
+
+    // Temporaries may come from the frame's arena; the returned Mat must not.
+    virtual cv::Mat process(cv::Mat frame, const FilterParams &params, FrameArena *arena) = 0;
+
+    // process() for a frame that goes through again and again while its
+    // parameters change, e.g. a paused frame being tuned: steps whose input
+    // and parameters are as last time come from memo (see FilterMemo).
+    // frame is not modified. Stages without steps of their own run in full.
+    virtual cv::Mat processMemoised(const cv::Mat &frame, const FilterParams &params, FilterMemo *memo)
+    {
+        Q_UNUSED(memo);
+        return process(frame.clone(), params, 0);
+    }
+    // Exact unless a stage says otherwise.
+    virtual FilterTolerance tolerance() const
+    {
+        FilterTolerance exact = { 0, std::numeric_limits<double>::infinity() };
+        return exact;
+    }
+
+private:
+    QString stageName;
+    QByteArray traceLabel;
+    Role stageRole;
+    bool lineBuffered;
+    TaskScheduler *pool;
+};
+
+class SharpContrastStage : public FilterStage
+{
+public:
+    SharpContrastStage() : FilterStage("SharpContrast", Optics) {}
+    cv::Mat process(cv::Mat frame, const FilterParams &params, FrameArena *arena);
+    cv::Mat processMemoised(const cv::Mat &frame, const FilterParams &params, FilterMemo *memo);
+};
+
+class NeonEdgeStage : public FilterStage
+{
+public:
+    NeonEdgeStage() : FilterStage("NeonEdge", Method) {}
+    cv::Mat process(cv::Mat frame, const FilterParams &params, FrameArena *arena);
+    cv::Mat processMemoised(const cv::Mat &frame, const FilterParams &params, FilterMemo *memo);
+    FilterTolerance tolerance() const;
+};
+
+FilterStage *createOpticStage(const QString &name);
+FilterStage *createMethodStage(const QString &name);
+
+// The "default" of every parameter the named stage lists in a settings file
+// (MethodSettings.json, OpticalSettings.json). Empty if it is not listed.
+FilterParams loadDefaultParams(const QString &settingsFile, const QString &stageName);
+// The same for the slider limits: field is "min", "max" or "default".
+FilterParams loadParamField(const QString &settingsFile, const QString &stageName, const QString &field);
+
+struct FilterInvocation
+{
+    FilterStage *stage;
+    FilterParams params;
+};
+
+typedef QList<FilterInvocation> FilterChain;
+
+#endif // FILTERSTAGE_H
@@ -0,0 +1,143 @@
+#include "framearena.h"
+#include "metrics.h"
+
+#include <QDebug>
+
+static const size_t arenaAlignment = 64;
+
+namespace {
+
+// Marks a thread inside the arena's unlocked bookkeeping for as long as it
+// lives; a second thread arriving meanwhile trips the assertion.
+class ExclusiveUse
+{
+public:
+    explicit ExclusiveUse(std::atomic<bool> &flag)
+        : flag(flag)
+    {
+        const bool taken = flag.exchange(true);
+        Q_ASSERT_X(!taken, "FrameArena", "used by two threads at once");
+        Q_UNUSED(taken);
+    }
+    ~ExclusiveUse() { flag = false; }
+
+private:
+    std::atomic<bool> &flag;
+};
+
+}
+
+FrameArena::FrameArena(size_t capacity)
+    : block(0)
+    , blockSize(capacity)
+    , offset(0)
+    , overflow(0)
+    , live(0)
+    , inUse(false)
+{
+    if (blockSize > 0) {
+        block = static_cast<uchar*>(cv::fastMalloc(blockSize));
+    }
+}
+
+FrameArena::~FrameArena()
+{
+    cv::fastFree(block);
+}
+
+void FrameArena::reset()
+{
+    ExclusiveUse check(inUse);
+    // Rewinding under a live Mat would hand its memory to the next frame.
+    if (live.load() != 0) {
+        qWarning() << "FrameArena: reset with" << live.load() << "live allocations, keeping block";
+        return;
+    }
+
+    if (overflow > 0) {
+        cv::fastFree(block);
+        blockSize = offset + overflow + (offset + overflow) / 4;
+        block = static_cast<uchar*>(cv::fastMalloc(blockSize));
+    }
+
+    offset = 0;
+    overflow = 0;
+}
+
+cv::UMatData *FrameArena::allocate(int dims, const int *sizes, int type, void *data0,
+                                   size_t *step, int flags, cv::UMatUsageFlags usageFlags) const
+{
+    // Wrapping user memory has nothing to do with the arena.
+    if (data0) {
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+    }
+
+    ExclusiveUse check(inUse);
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            step[i] = total;
+        }
+        total *= sizes[i];
+    }
+
+    const size_t start = (offset + arenaAlignment - 1) & ~(arenaAlignment - 1);
+    if (start + total > blockSize) {
+        overflow += total;
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, 0, step, flags, usageFlags);
+    }
+    offset = start + total;
+
+    cv::UMatData *u = new cv::UMatData(this);
+    u->data = u->origdata = block + start;
+    u->size = total;
+    ++live;
+    return u;
+}
+
+bool FrameArena::allocate(cv::UMatData *data, int accessFlags, cv::UMatUsageFlags usageFlags) const
+{
+    Q_UNUSED(accessFlags);
+    Q_UNUSED(usageFlags);
+    return data != 0;
+}
+
+void FrameArena::deallocate(cv::UMatData *data) const
+{
+    if (!data) {
+        return;
+    }
+    // The bytes are reclaimed by reset(); only the header goes now.
+    --live;
+    delete data;
+}
+
+FrameArenaPool::~FrameArenaPool()
+{
+    qDeleteAll(arenas);
+}
+
+FrameArena *FrameArenaPool::acquire()
+{
+    static Counter *acquired = Metrics::instance().counter("arena.acquired");
+    static Counter *created = Metrics::instance().counter("arena.created");
+    acquired->add();
+
+    QMutexLocker locker(&mutex);
+    if (idle.isEmpty()) {
+        created->add();
+        arenas.append(new FrameArena());
+        return arenas.last();
+    }
+    return idle.takeLast();
+}
+
+void FrameArenaPool::release(FrameArena *arena)
+{
+    static Counter *released = Metrics::instance().counter("arena.released");
+    released->add();
+    arena->reset();
+
+    QMutexLocker locker(&mutex);
+    idle.append(arena);
+}
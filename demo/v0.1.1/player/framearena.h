@@ -0,0 +1,77 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <QList>
+#include <QMutex>
+
+#include <opencv/cv.hpp>
+
+#include <atomic>
+
+#if CV_MAJOR_VERSION < 3
+#error "FrameArena needs the OpenCV 3 cv::MatAllocator interface"
+#endif
+
+// Bump allocator for the temporaries of one frame. Mats created through it
+// take the next slice of a single block; freeing them only drops the
+// bookkeeping, and reset() reclaims the whole block by rewinding one offset
+// once the frame is done. A frame that does not fit spills to the heap and
+// the block grows to the observed size on the next reset().
+//
+// Only temporaries that die inside the frame may live here; anything handed
+// on (stage outputs, the final image) must use the default allocator.
+//
+// One thread at a time: allocate() and reset() move the offset without a
+// lock. A frame may continue on another worker, but work split across
+// threads (e.g. NeonEdge's pooled bands) must not share the frame's arena.
+// Debug builds assert on overlapping use.
+class FrameArena : public cv::MatAllocator
+{
+public:
+    explicit FrameArena(size_t capacity = 0);
+    ~FrameArena();
+
+    void reset();
+
+    size_t capacity() const { return blockSize; }
+    size_t used() const { return offset; }
+    size_t spilled() const { return overflow; }
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data0,
+                           size_t *step, int flags, cv::UMatUsageFlags usageFlags) const;
+    bool allocate(cv::UMatData *data, int accessFlags, cv::UMatUsageFlags usageFlags) const;
+    void deallocate(cv::UMatData *data) const;
+
+private:
+    uchar *block;
+    size_t blockSize;
+    mutable size_t offset;
+    mutable size_t overflow;
+    mutable std::atomic<int> live;
+    mutable std::atomic<bool> inUse;
+};
+
+// An empty Mat that will take its storage from the arena when an OpenCV
+// function create()s it. A null arena gives a plain heap-backed Mat.
+inline cv::Mat arena_mat(FrameArena *arena)
+{
+    cv::Mat mat;
+    mat.allocator = arena;
+    return mat;
+}
+
+class FrameArenaPool
+{
+public:
+    ~FrameArenaPool();
+
+    FrameArena *acquire();
+    void release(FrameArena *arena);
+
+private:
+    QMutex mutex;
+    QList<FrameArena*> arenas;
+    QList<FrameArena*> idle;
+};
+
+#endif // FRAMEARENA_H
@@ -0,0 +1,219 @@
+#include "framecache.h"
+#include "metrics.h"
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace {
+
+void free_pixels(void *pixels)
+{
+    delete[] static_cast<uchar*>(pixels);
+}
+
+}
+
+FrameCache::FrameCache(qint64 budgetBytes)
+    : budgetBytes(qMax<qint64>(0, budgetBytes))
+    , usedBytes(0)
+    , compressed(false)
+    , hits(Metrics::instance().counter("cache.hits"))
+    , misses(Metrics::instance().counter("cache.misses"))
+    , evictions(Metrics::instance().counter("cache.evictions"))
+{
+}
+
+void FrameCache::setBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    budgetBytes = qMax<qint64>(0, bytes);
+    evict(budgetBytes);
+}
+
+qint64 FrameCache::budget() const
+{
+    QMutexLocker locker(&mutex);
+    return budgetBytes;
+}
+
+bool FrameCache::setCompressed(bool enabled)
+{
+#ifdef HAVE_LZ4
+    QMutexLocker locker(&mutex);
+    compressed = enabled;
+    return true;
+#else
+    return !enabled;
+#endif
+}
+
+bool FrameCache::isCompressed() const
+{
+    QMutexLocker locker(&mutex);
+    return compressed;
+}
+
+quint64 FrameCache::version(const FilterChain &chain)
+{
+    // FNV-1a over the stage names and parameters.
+    quint64 hash = 14695981039346656037ULL;
+    auto mix = [&hash](uint value) { hash = (hash ^ value) * 1099511628211ULL; };
+
+    mix(chain.size());
+    for (const FilterInvocation &step : chain) {
+        if (step.stage->dependsOnPreviousFrame()) {
+            return 0;
+        }
+        mix(qHash(step.stage->name()));
+        for (FilterParams::const_iterator it = step.params.constBegin(); it != step.params.constEnd(); ++it) {
+            mix(qHash(it.key()));
+            mix(uint(it.value()));
+        }
+    }
+    return hash ? hash : 1;
+}
+
+bool FrameCache::lookup(qint64 startTime, quint64 version, QImage *frame)
+{
+    Entry entry;
+    {
+        QMutexLocker locker(&mutex);
+        QMap<Key, Entry>::iterator it = entries.find(Key(version, startTime));
+        if (it == entries.end()) {
+            if (budgetBytes > 0) {
+                misses->add();
+            }
+            return false;
+        }
+        order.splice(order.begin(), order, it->use);
+        entry = it.value();
+    }
+    hits->add();
+
+    if (entry.packed.isEmpty()) {
+        *frame = entry.image;
+        return true;
+    }
+
+#ifdef HAVE_LZ4
+    const int rawBytes = entry.bytesPerLine * entry.size.height();
+    uchar *pixels = new uchar[rawBytes];
+    if (LZ4_decompress_safe(entry.packed.constData(), reinterpret_cast<char*>(pixels),
+                            entry.packed.size(), rawBytes) != rawBytes) {
+        delete[] pixels;
+        return false;
+    }
+    *frame = QImage(pixels, entry.size.width(), entry.size.height(), entry.bytesPerLine, entry.format,
+                    free_pixels, pixels);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FrameCache::nearest(qint64 startTime, quint64 version, qint64 maxDistance, QImage *frame, qint64 *frameTime)
+{
+    qint64 found = -1;
+    {
+        QMutexLocker locker(&mutex);
+        QMap<Key, Entry>::const_iterator after = entries.lowerBound(Key(version, startTime));
+        if (after != entries.constEnd() && after.key().first == version) {
+            found = after.key().second;
+        }
+        if (after != entries.constBegin()) {
+            QMap<Key, Entry>::const_iterator previous = after;
+            const Key before = (--previous).key();
+            if (before.first == version && (found < 0 || startTime - before.second < found - startTime)) {
+                found = before.second;
+            }
+        }
+    }
+    if (found < 0 || qAbs(found - startTime) > maxDistance || !lookup(found, version, frame)) {
+        return false;
+    }
+    *frameTime = found;
+    return true;
+}
+
+void FrameCache::insert(qint64 startTime, quint64 version, const QImage &frame)
+{
+    if (startTime < 0 || version == 0 || frame.isNull()) {
+        return;
+    }
+
+    Entry entry;
+    entry.size = frame.size();
+    entry.format = frame.format();
+    entry.bytesPerLine = frame.bytesPerLine();
+    entry.bytes = frame.byteCount();
+
+#ifdef HAVE_LZ4
+    // Compressed outside the lock; the workers insert concurrently.
+    if (isCompressed()) {
+        const int rawBytes = frame.byteCount();
+        entry.packed.resize(LZ4_compressBound(rawBytes));
+        const int packedBytes = LZ4_compress_default(reinterpret_cast<const char*>(frame.constBits()),
+                                                     entry.packed.data(), rawBytes, entry.packed.size());
+        if (packedBytes > 0 && packedBytes < rawBytes) {
+            entry.packed.resize(packedBytes);
+            entry.bytes = packedBytes;
+        } else {
+            entry.packed.clear();
+        }
+    }
+#endif
+    if (entry.packed.isEmpty()) {
+        entry.image = frame;
+    }
+
+    QMutexLocker locker(&mutex);
+    if (entry.bytes > budgetBytes) {
+        return;
+    }
+
+    const Key key(version, startTime);
+    QMap<Key, Entry>::iterator it = entries.find(key);
+    if (it != entries.end()) {
+        usedBytes -= it->bytes;
+        order.erase(it->use);
+        entries.erase(it);
+    }
+
+    order.push_front(key);
+    entry.use = order.begin();
+    entries.insert(key, entry);
+    usedBytes += entry.bytes;
+    evict(budgetBytes);
+}
+
+void FrameCache::clear()
+{
+    QMutexLocker locker(&mutex);
+    entries.clear();
+    order.clear();
+    usedBytes = 0;
+}
+
+qint64 FrameCache::bytes() const
+{
+    QMutexLocker locker(&mutex);
+    return usedBytes;
+}
+
+int FrameCache::count() const
+{
+    QMutexLocker locker(&mutex);
+    return entries.size();
+}
+
+void FrameCache::evict(qint64 limit)
+{
+    while (usedBytes > limit && !order.empty()) {
+        QMap<Key, Entry>::iterator it = entries.find(order.back());
+        usedBytes -= it->bytes;
+        entries.erase(it);
+        order.pop_back();
+        evictions->add();
+    }
+}
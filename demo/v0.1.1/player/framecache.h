@@ -0,0 +1,83 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+
+#include <list>
+
+#include "filterstage.h"
+
+class Counter;
+
+// Processed frames kept for when the same source frame comes round again
+// with the same settings: pause, scrubbing back and forth, a replayed
+// segment. Entries are keyed by the frame's start time and the version of
+// the filter chain that made them, and the least recently used go first
+// once the byte budget is exceeded. Safe to use from any thread.
+class FrameCache
+{
+public:
+    explicit FrameCache(qint64 budgetBytes = 256 * 1024 * 1024);
+
+    // 0 turns the cache off.
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+    // LZ4-compresses the stored frames, so the budget holds several times
+    // as many at the cost of a decompression per hit. Returns false, and
+    // stays uncompressed, when built without LZ4 (CONFIG+=lz4_cache).
+    bool setCompressed(bool enabled);
+    bool isCompressed() const;
+
+    // Stands for the stages and every parameter value of the chain: equal
+    // chains give equal versions, so going back to earlier settings finds
+    // the frames made with them. 0 for chains that cannot be cached
+    // because a stage depends on the previous frame.
+    static quint64 version(const FilterChain &chain);
+
+    bool lookup(qint64 startTime, quint64 version, QImage *frame);
+    // The frame made with version whose start time is closest to
+    // startTime, if there is one within maxDistance (microseconds); for
+    // scrubbing, where any frame near the playhead beats none.
+    bool nearest(qint64 startTime, quint64 version, qint64 maxDistance, QImage *frame, qint64 *frameTime);
+    void insert(qint64 startTime, quint64 version, const QImage &frame);
+    // Start times only mean something within one source.
+    void clear();
+
+    qint64 bytes() const;
+    int count() const;
+
+private:
+    // Version first, so the frames of one version are together in time order.
+    typedef QPair<quint64, qint64> Key;
+
+    struct Entry
+    {
+        QImage image;
+        // Compressed pixels, with what it takes to rebuild the image.
+        QByteArray packed;
+        QSize size;
+        QImage::Format format;
+        int bytesPerLine;
+        qint64 bytes;
+        std::list<Key>::iterator use;
+    };
+
+    void evict(qint64 limit);
+
+    mutable QMutex mutex;
+    QMap<Key, Entry> entries;
+    // Most recently used first.
+    std::list<Key> order;
+    qint64 budgetBytes;
+    qint64 usedBytes;
+    bool compressed;
+    Counter *hits;
+    Counter *misses;
+    Counter *evictions;
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,287 @@
+#include "framecorpus.h"
+
+#include <QAbstractVideoBuffer>
+#include <QByteArray>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+static const char corpusMagic[8] = { 'V', 'A', 'F', 'R', 'A', 'M', 'E', 'S' };
+
+struct CorpusMapping
+{
+    CorpusMapping() : data(0), size(0) {}
+    ~CorpusMapping()
+    {
+        if (data) {
+            file.unmap(data);
+        }
+    }
+
+    QFile file;
+    uchar *data;
+    qint64 size;
+};
+
+namespace {
+
+// Whether the payload of record holds the frame it describes, so a view of
+// it never reads past the end.
+bool record_fits(const CorpusFrameRecord &record)
+{
+    const QVideoFrame::PixelFormat format = static_cast<QVideoFrame::PixelFormat>(record.pixelFormat);
+    const int type = pixel_format_mat_type(format);
+    if (type < 0 || record.width <= 0 || record.height <= 0 || record.bytesPerLine <= 0) {
+        return false;
+    }
+    // Keeps pixel_format_mat_rows() and the buffer's int size in range.
+    if (record.height > std::numeric_limits<int>::max() / 3
+            || record.bytes > quint64(std::numeric_limits<int>::max())) {
+        return false;
+    }
+    if (quint64(record.bytesPerLine) < quint64(record.width) * CV_ELEM_SIZE(type)) {
+        return false;
+    }
+    return quint64(record.bytesPerLine) * pixel_format_mat_rows(format, record.height) <= record.bytes;
+}
+
+// One payload of the mapped corpus, without a copy. Holds the mapping, so
+// the file stays mapped while any frame made from it is alive.
+class CorpusVideoBuffer : public QAbstractVideoBuffer
+{
+public:
+    CorpusVideoBuffer(const QSharedPointer<CorpusMapping> &mapping, const CorpusFrameRecord &record)
+        : QAbstractVideoBuffer(NoHandle)
+        , mapping(mapping)
+        , data(mapping->data + record.offset)
+        , bytes(static_cast<int>(record.bytes))
+        , bytesPerLine(record.bytesPerLine)
+        , mode(NotMapped)
+    {
+    }
+
+    MapMode mapMode() const { return mode; }
+
+    uchar *map(MapMode mapMode, int *numBytes, int *lineBytes)
+    {
+        // The file is mapped read-only; a write through it would fault.
+        if (mapMode & WriteOnly) {
+            return 0;
+        }
+        mode = mapMode;
+        if (numBytes) {
+            *numBytes = bytes;
+        }
+        if (lineBytes) {
+            *lineBytes = bytesPerLine;
+        }
+        return data;
+    }
+
+    void unmap() { mode = NotMapped; }
+
+private:
+    QSharedPointer<CorpusMapping> mapping;
+    uchar *data;
+    int bytes;
+    int bytesPerLine;
+    MapMode mode;
+};
+
+}
+
+FrameCorpusWriter::FrameCorpusWriter()
+{
+}
+
+FrameCorpusWriter::~FrameCorpusWriter()
+{
+    if (file.isOpen()) {
+        finish();
+    }
+}
+
+bool FrameCorpusWriter::fail(const QString &message)
+{
+    lastError = message;
+    return false;
+}
+
+bool FrameCorpusWriter::open(const QString &filename)
+{
+    index.clear();
+    lastError.clear();
+
+    file.setFileName(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return fail(QString("cannot write %1: %2").arg(filename, file.errorString()));
+    }
+
+    // Rewritten with the real count and index offset by finish().
+    CorpusHeader header;
+    memset(&header, 0, sizeof(header));
+    if (file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) {
+        return fail(file.errorString());
+    }
+    return true;
+}
+
+bool FrameCorpusWriter::write(const FrameHandle &frame)
+{
+    if (!file.isOpen()) {
+        return fail("corpus is not open");
+    }
+    if (!frame.isValid() || frame.matType() < 0) {
+        return fail("frame is not mapped or has an unsupported pixel format");
+    }
+
+    CorpusFrameRecord record;
+    record.bytes = static_cast<quint64>(frame.bytesPerLine())
+                 * pixel_format_mat_rows(frame.pixelFormat(), frame.height());
+    record.startTime = frame.startTime();
+    record.endTime = frame.endTime();
+    record.pixelFormat = frame.pixelFormat();
+    record.width = frame.width();
+    record.height = frame.height();
+    record.bytesPerLine = frame.bytesPerLine();
+
+    const qint64 end = file.pos();
+    const qint64 aligned = (end + corpusPageSize - 1) & ~qint64(corpusPageSize - 1);
+    if (aligned > end && file.write(QByteArray(aligned - end, 0)) != aligned - end) {
+        return fail(file.errorString());
+    }
+    record.offset = aligned;
+
+    const qint64 bytes = static_cast<qint64>(record.bytes);
+    if (file.write(reinterpret_cast<const char*>(frame.bits()), bytes) != bytes) {
+        return fail(file.errorString());
+    }
+
+    index.append(record);
+    return true;
+}
+
+bool FrameCorpusWriter::finish()
+{
+    if (!file.isOpen()) {
+        return fail("corpus is not open");
+    }
+
+    CorpusHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, corpusMagic, sizeof(header.magic));
+    header.version = corpusVersion;
+    header.pageSize = corpusPageSize;
+    header.frameCount = index.size();
+    header.indexOffset = file.pos();
+
+    const qint64 indexBytes = index.size() * static_cast<qint64>(sizeof(CorpusFrameRecord));
+    const bool ok = file.write(reinterpret_cast<const char*>(index.constData()), indexBytes) == indexBytes
+                 && file.seek(0)
+                 && file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+    if (!ok) {
+        lastError = file.errorString();
+    }
+    file.close();
+    return ok;
+}
+
+FrameCorpus::FrameCorpus()
+{
+}
+
+FrameCorpus::~FrameCorpus()
+{
+}
+
+bool FrameCorpus::open(const QString &filename)
+{
+    close();
+
+    QSharedPointer<CorpusMapping> map(new CorpusMapping());
+    map->file.setFileName(filename);
+    if (!map->file.open(QIODevice::ReadOnly)) {
+        lastError = QString("cannot open %1: %2").arg(filename, map->file.errorString());
+        return false;
+    }
+    map->size = map->file.size();
+    if (map->size >= static_cast<qint64>(sizeof(CorpusHeader))) {
+        map->data = map->file.map(0, map->size);
+    }
+    if (!map->data) {
+        lastError = QString("cannot map %1").arg(filename);
+        return false;
+    }
+
+    CorpusHeader header;
+    memcpy(&header, map->data, sizeof(header));
+    if (memcmp(header.magic, corpusMagic, sizeof(header.magic)) != 0 || header.version != corpusVersion) {
+        lastError = QString("%1 is not a version %2 frame corpus").arg(filename).arg(corpusVersion);
+        return false;
+    }
+
+    // Compared as what is left of the file, so a bad header cannot wrap.
+    const quint64 size = map->size;
+    if (header.indexOffset > size
+            || header.frameCount > (size - header.indexOffset) / sizeof(CorpusFrameRecord)) {
+        lastError = QString("%1 is truncated").arg(filename);
+        return false;
+    }
+
+    QVector<CorpusFrameRecord> index(header.frameCount);
+    memcpy(index.data(), map->data + header.indexOffset, header.frameCount * sizeof(CorpusFrameRecord));
+    foreach (const CorpusFrameRecord &record, index) {
+        if (record.offset > size || record.bytes > size - record.offset) {
+            lastError = QString("%1 is truncated").arg(filename);
+            return false;
+        }
+        if (!record_fits(record)) {
+            lastError = QString("%1 has a malformed frame record").arg(filename);
+            return false;
+        }
+    }
+
+    mapping = map;
+    records = index;
+    return true;
+}
+
+void FrameCorpus::close()
+{
+    // Frames still out keep their own reference to the mapping.
+    mapping.clear();
+    records.clear();
+    lastError.clear();
+}
+
+FrameHandle FrameCorpus::frame(int i) const
+{
+    if (!mapping || i < 0 || i >= records.size()) {
+        return FrameHandle();
+    }
+
+    const CorpusFrameRecord &r = records[i];
+    QVideoFrame frame(new CorpusVideoBuffer(mapping, r), QSize(r.width, r.height),
+                      static_cast<QVideoFrame::PixelFormat>(r.pixelFormat));
+    frame.setStartTime(r.startTime);
+    frame.setEndTime(r.endTime);
+    return FrameHandle(frame);
+}
+
+int FrameCorpus::indexAt(qint64 position) const
+{
+    const qint64 target = position * 1000;
+    const CorpusFrameRecord *it = std::lower_bound(records.constBegin(), records.constEnd(), target,
+        [](const CorpusFrameRecord &record, qint64 time) { return record.startTime < time; });
+    return static_cast<int>(it - records.constBegin());
+}
+
+qint64 FrameCorpus::duration() const
+{
+    if (records.isEmpty()) {
+        return -1;
+    }
+    const CorpusFrameRecord &last = records.last();
+    return qMax(last.startTime, last.endTime) / 1000;
+}
@@ -0,0 +1,100 @@
+#ifndef FRAMECORPUS_H
+#define FRAMECORPUS_H
+
+#include <QFile>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include "framehandle.h"
+
+// A raw frame corpus is a file of already decoded frames, so benchmarks can
+// replay identical input without paying for (or measuring) the decoder.
+//
+//   CorpusHeader                     at offset 0
+//   payloads                         each starting on a corpusPageSize boundary
+//   CorpusFrameRecord[frameCount]    at indexOffset, written last
+//
+// Fields are in host byte order (little-endian everywhere we build). A payload is bytesPerLine times
+// pixel_format_mat_rows() bytes, exactly as the frame was mapped, so it can
+// be handed out straight from a memory mapping.
+
+const quint32 corpusVersion = 1;
+const quint32 corpusPageSize = 4096;
+
+struct CorpusHeader
+{
+    char magic[8];          // "VAFRAMES"
+    quint32 version;
+    quint32 pageSize;
+    quint32 frameCount;
+    quint32 reserved;
+    quint64 indexOffset;
+};
+
+struct CorpusFrameRecord
+{
+    quint64 offset;
+    quint64 bytes;
+    qint64 startTime;       // microseconds, as QVideoFrame::startTime()
+    qint64 endTime;
+    qint32 pixelFormat;     // QVideoFrame::PixelFormat
+    qint32 width;
+    qint32 height;
+    qint32 bytesPerLine;
+};
+
+// Appends frames to a new corpus file; nothing is readable until finish().
+class FrameCorpusWriter
+{
+public:
+    FrameCorpusWriter();
+    ~FrameCorpusWriter();
+
+    bool open(const QString &filename);
+    bool write(const FrameHandle &frame);
+    bool finish();
+
+    int frameCount() const { return index.size(); }
+    QString errorString() const { return lastError; }
+
+private:
+    bool fail(const QString &message);
+
+    QFile file;
+    QVector<CorpusFrameRecord> index;
+    QString lastError;
+};
+
+struct CorpusMapping;
+
+// Read side: maps the whole file once. frame() hands out FrameHandles that
+// point into the mapping, and each keeps the mapping alive, so they may
+// outlive the FrameCorpus itself.
+class FrameCorpus
+{
+public:
+    FrameCorpus();
+    ~FrameCorpus();
+
+    bool open(const QString &filename);
+    void close();
+    bool isOpen() const { return !mapping.isNull(); }
+    QString errorString() const { return lastError; }
+
+    int frameCount() const { return records.size(); }
+    const CorpusFrameRecord &record(int i) const { return records[i]; }
+    FrameHandle frame(int i) const;
+
+    // First frame at or after position (milliseconds).
+    int indexAt(qint64 position) const;
+    // Milliseconds, or -1 when empty.
+    qint64 duration() const;
+
+private:
+    QSharedPointer<CorpusMapping> mapping;
+    QVector<CorpusFrameRecord> records;
+    QString lastError;
+};
+
+#endif // FRAMECORPUS_H
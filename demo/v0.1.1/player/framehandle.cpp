@@ -0,0 +1,155 @@
+#include "framehandle.h"
+
+namespace {
+
+void release_mapping(void *info)
+{
+    FrameMapping *mapping = static_cast<FrameMapping*>(info);
+    if (!mapping->ref.deref()) {
+        delete mapping;
+    }
+}
+
+// Gives Mat views the same lifetime rule QImage gets from its cleanup
+// function: the last Mat sharing a view drops the view's mapping reference.
+class MappingAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data0,
+                           size_t *step, int flags, cv::UMatUsageFlags usageFlags) const
+    {
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData *data, int accessFlags, cv::UMatUsageFlags usageFlags) const
+    {
+        Q_UNUSED(accessFlags);
+        Q_UNUSED(usageFlags);
+        return data != 0;
+    }
+
+    void deallocate(cv::UMatData *data) const
+    {
+        if (!data) {
+            return;
+        }
+        release_mapping(data->userdata);
+        delete data;
+    }
+};
+
+MappingAllocator mappingAllocator;
+
+}
+
+FrameMapping::FrameMapping(const QVideoFrame &frame)
+    : frame(frame)
+    , mapped(false)
+{
+    mapped = this->frame.map(QAbstractVideoBuffer::ReadOnly);
+}
+
+FrameMapping::~FrameMapping()
+{
+    if (mapped) {
+        frame.unmap();
+    }
+}
+
+FrameHandle::FrameHandle()
+{
+}
+
+FrameHandle::FrameHandle(const QVideoFrame &frame)
+{
+    if (frame.isValid()) {
+        d = new FrameMapping(frame);
+    }
+}
+
+bool FrameHandle::isValid() const
+{
+    return d && d->mapped;
+}
+
+qint64 FrameHandle::startTime() const
+{
+    return d ? d->frame.startTime() : -1;
+}
+
+qint64 FrameHandle::endTime() const
+{
+    return d ? d->frame.endTime() : -1;
+}
+
+QVideoFrame::PixelFormat FrameHandle::pixelFormat() const
+{
+    return d ? d->frame.pixelFormat() : QVideoFrame::Format_Invalid;
+}
+
+QImage::Format FrameHandle::imageFormat() const
+{
+    return QVideoFrame::imageFormatFromPixelFormat(pixelFormat());
+}
+
+QSize FrameHandle::size() const
+{
+    return d ? d->frame.size() : QSize();
+}
+
+int FrameHandle::width() const
+{
+    return size().width();
+}
+
+int FrameHandle::height() const
+{
+    return size().height();
+}
+
+int FrameHandle::bytesPerLine() const
+{
+    return isValid() ? d->frame.bytesPerLine() : 0;
+}
+
+const uchar *FrameHandle::bits() const
+{
+    return isValid() ? d->frame.bits() : 0;
+}
+
+int FrameHandle::matType() const
+{
+    return pixel_format_mat_type(pixelFormat());
+}
+
+cv::Mat FrameHandle::mat() const
+{
+    const int type = matType();
+    if (!isValid() || type < 0) {
+        return cv::Mat();
+    }
+
+    const int rows = pixel_format_mat_rows(pixelFormat(), height());
+    cv::Mat view(rows, width(), type, const_cast<uchar*>(bits()), bytesPerLine());
+
+    cv::UMatData *u = new cv::UMatData(&mappingAllocator);
+    u->data = u->origdata = view.data;
+    u->size = static_cast<size_t>(bytesPerLine()) * rows;
+    u->userdata = d.data();
+    u->refcount = 1;
+    d->ref.ref();
+
+    view.u = u;
+    return view;
+}
+
+QImage FrameHandle::image() const
+{
+    const QImage::Format format = imageFormat();
+    if (!isValid() || format == QImage::Format_Invalid) {
+        return QImage();
+    }
+
+    d->ref.ref();
+    return QImage(bits(), width(), height(), bytesPerLine(), format, release_mapping, d.data());
+}
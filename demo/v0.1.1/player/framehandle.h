@@ -0,0 +1,109 @@
+#ifndef FRAMEHANDLE_H
+#define FRAMEHANDLE_H
+
+#include <QImage>
+#include <QSharedData>
+#include <QVideoFrame>
+
+#include <opencv/cv.hpp>
+
+// OpenCV type of a frame of the given format viewed as one Mat, or -1 when
+// the format has no single-Mat layout. Packed 16-bit RGB and YUV formats
+// come out as CV_8UC2, 4:2:0 formats as one CV_8UC1 plane of height * 3 / 2
+// rows, the layouts cv::cvtColor expects for them.
+inline int pixel_format_mat_type(QVideoFrame::PixelFormat format)
+{
+    switch (format) {
+    case QVideoFrame::Format_ARGB32:
+    case QVideoFrame::Format_ARGB32_Premultiplied:
+    case QVideoFrame::Format_RGB32:
+    case QVideoFrame::Format_BGRA32:
+    case QVideoFrame::Format_BGRA32_Premultiplied:
+    case QVideoFrame::Format_BGR32:
+    case QVideoFrame::Format_AYUV444:
+    case QVideoFrame::Format_AYUV444_Premultiplied:
+        return CV_8UC4;
+    case QVideoFrame::Format_RGB24:
+    case QVideoFrame::Format_BGR24:
+    case QVideoFrame::Format_YUV444:
+        return CV_8UC3;
+    case QVideoFrame::Format_RGB565:
+    case QVideoFrame::Format_RGB555:
+    case QVideoFrame::Format_BGR565:
+    case QVideoFrame::Format_BGR555:
+    case QVideoFrame::Format_UYVY:
+    case QVideoFrame::Format_YUYV:
+        return CV_8UC2;
+    case QVideoFrame::Format_Y8:
+    case QVideoFrame::Format_YUV420P:
+    case QVideoFrame::Format_YV12:
+    case QVideoFrame::Format_NV12:
+    case QVideoFrame::Format_NV21:
+        return CV_8UC1;
+    case QVideoFrame::Format_Y16:
+        return CV_16UC1;
+    default:
+        return -1;
+    }
+}
+
+inline int pixel_format_mat_rows(QVideoFrame::PixelFormat format, int height)
+{
+    switch (format) {
+    case QVideoFrame::Format_YUV420P:
+    case QVideoFrame::Format_YV12:
+    case QVideoFrame::Format_NV12:
+    case QVideoFrame::Format_NV21:
+        return height * 3 / 2;
+    default:
+        return height;
+    }
+}
+
+// One read-only mapping of a video frame, shared by every handle and view
+// taken from it. Unmapped when the last of them goes away.
+class FrameMapping : public QSharedData
+{
+public:
+    explicit FrameMapping(const QVideoFrame &frame);
+    ~FrameMapping();
+
+    QVideoFrame frame;
+    bool mapped;
+};
+
+// Reference-counted handle to a mapped QVideoFrame. mat() and image() point
+// straight into the mapped buffer without copying, and each view holds its
+// own reference, so a view may outlive the handle and cross threads; the
+// buffer is unmapped only after the last handle and view are gone. Views
+// are read-only: anything that modifies pixels must convert or copy first.
+class FrameHandle
+{
+public:
+    FrameHandle();
+    // Maps the frame for reading; isValid() is false if that fails.
+    explicit FrameHandle(const QVideoFrame &frame);
+
+    bool isValid() const;
+
+    qint64 startTime() const;
+    qint64 endTime() const;
+    QVideoFrame::PixelFormat pixelFormat() const;
+    QImage::Format imageFormat() const;
+    QSize size() const;
+    int width() const;
+    int height() const;
+    int bytesPerLine() const;
+    const uchar *bits() const;
+
+    // Type of the view mat() returns, see pixel_format_mat_type().
+    int matType() const;
+
+    cv::Mat mat() const;
+    QImage image() const;
+
+private:
+    QExplicitlySharedDataPointer<FrameMapping> d;
+};
+
+#endif // FRAMEHANDLE_H
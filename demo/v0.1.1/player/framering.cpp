@@ -0,0 +1,101 @@
+#include "framering.h"
+#include "metrics.h"
+
+FrameRing::FrameRing(size_t capacity, QObject *parent)
+    : QObject(parent)
+    , ring(capacity)
+    , notified(false)
+    , pushedCount(0)
+    , overrunCount(0)
+    , highWaterMark(0)
+    , overrunMetric(Metrics::instance().counter("ring.overruns"))
+    , droppedMetric(Metrics::instance().counter("frames.dropped"))
+    , waiting(0)
+    , wakePending(false)
+{
+}
+
+bool FrameRing::push(const FrameHandle &frame)
+{
+    if (!tryPush(frame)) {
+        overrunCount.fetch_add(1, std::memory_order_relaxed);
+        overrunMetric->add();
+        droppedMetric->add();
+        return false;
+    }
+    return true;
+}
+
+bool FrameRing::tryPush(const FrameHandle &frame)
+{
+    if (!ring.push(frame)) {
+        return false;
+    }
+    pushedCount.fetch_add(1, std::memory_order_relaxed);
+
+    const size_t depth = ring.size();
+    if (depth > highWaterMark.load(std::memory_order_relaxed)) {
+        highWaterMark.store(depth, std::memory_order_relaxed);
+    }
+
+    if (!notified.exchange(true)) {
+        emit framesAvailable();
+    }
+    wakeIfWaiting();
+    return true;
+}
+
+bool FrameRing::pop(FrameHandle *frame)
+{
+    if (!ring.pop(frame)) {
+        notified.store(false);
+
+        // A push may have landed between the failed pop and re-arming; it
+        // saw the old flag and did not notify, so pick it up here.
+        if (!ring.pop(frame)) {
+            return false;
+        }
+    }
+    wakeIfWaiting();
+    return true;
+}
+
+void FrameRing::waitForRoom(int msecs)
+{
+    QMutexLocker locker(&waitMutex);
+    ++waiting;
+    if (!wakePending && ring.size() >= ring.capacity()) {
+        moved.wait(&waitMutex, msecs);
+    }
+    wakePending = false;
+    --waiting;
+}
+
+void FrameRing::waitForFrames(int msecs)
+{
+    QMutexLocker locker(&waitMutex);
+    ++waiting;
+    if (!wakePending && ring.isEmpty()) {
+        moved.wait(&waitMutex, msecs);
+    }
+    wakePending = false;
+    --waiting;
+}
+
+void FrameRing::wakeWaiters()
+{
+    QMutexLocker locker(&waitMutex);
+    wakePending = true;
+    moved.wakeAll();
+}
+
+void FrameRing::wakeIfWaiting()
+{
+    // Pairs with the waiter raising the count before it looks at the ring:
+    // either it sees this push or pop, or this sees it waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load() > 0) {
+        QMutexLocker locker(&waitMutex);
+        moved.wakeAll();
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+
+#include <atomic>
+
+#include "framehandle.h"
+#include "spscqueue.h"
+
+class Counter;
+
+// Hands frames from VideoSurface::present() to the processing side. The
+// ring stores FrameHandles, whose reference keeps the backend buffer mapped
+// until the consumer has converted it. push() never waits:
+// when the ring is full the frame is dropped and counted as an overrun.
+class FrameRing : public QObject
+{
+    Q_OBJECT
+
+public:
+    FrameRing(size_t capacity = 8, QObject *parent = 0);
+
+    // Producer (surface) side.
+    bool push(const FrameHandle &frame);
+    // Same, but a full ring is not counted as an overrun; for producers
+    // that wait and retry rather than drop.
+    bool tryPush(const FrameHandle &frame);
+
+    // Consumer side. Drain until this returns false; framesAvailable() is
+    // emitted again on the next push after that.
+    bool pop(FrameHandle *frame);
+
+    // For a side that would otherwise poll: return once the other side has
+    // moved (room to push, or a frame to pop), after wakeWaiters(), or
+    // after msecs, whichever comes first.
+    void waitForRoom(int msecs);
+    void waitForFrames(int msecs);
+    // E.g. when the producer stops or reaches the end of its stream. With
+    // nobody waiting, the next wait returns at once instead.
+    void wakeWaiters();
+
+    int size() const { return static_cast<int>(ring.size()); }
+    int capacity() const { return static_cast<int>(ring.capacity()); }
+    quint64 pushed() const { return pushedCount.load(std::memory_order_relaxed); }
+    quint64 overruns() const { return overrunCount.load(std::memory_order_relaxed); }
+    int highWater() const { return static_cast<int>(highWaterMark.load(std::memory_order_relaxed)); }
+
+signals:
+    // Emitted at most once per drain rather than once per frame.
+    void framesAvailable();
+
+private:
+    SpscQueue<FrameHandle> ring;
+    std::atomic<bool> notified;
+    std::atomic<quint64> pushedCount;
+    std::atomic<quint64> overrunCount;
+    std::atomic<size_t> highWaterMark;
+    Counter *overrunMetric;
+    Counter *droppedMetric;
+
+    void wakeIfWaiting();
+
+    // Only locked when someone waits, so push() and pop() stay lock-free
+    // otherwise.
+    QMutex waitMutex;
+    QWaitCondition moved;
+    std::atomic<int> waiting;
+    bool wakePending;
+};
+
+#endif // FRAMERING_H
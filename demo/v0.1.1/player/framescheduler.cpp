@@ -0,0 +1,362 @@
+#include "framescheduler.h"
+#include "allocstats.h"
+#include "framecache.h"
+#include "imageconvert.h"
+#include "metrics.h"
+#include "syncmonitor.h"
+#include "tracing.h"
+
+#include <QElapsedTimer>
+
+FrameScheduler::FrameScheduler(TaskScheduler *tasks, QObject *parent)
+    : QObject(parent)
+    , tasks(tasks)
+    , cache(0)
+    , frameLatency(Metrics::instance().histogram("frame.process"))
+    , framesIn(Metrics::instance().counter("frames.in"))
+    , framesOut(Metrics::instance().counter("frames.out"))
+    , framesDropped(Metrics::instance().counter("frames.dropped"))
+    , framesSkipped(Metrics::instance().counter("frames.skipped"))
+    , nextSequence(0)
+    , epoch(0)
+    , dropped(0)
+    , lastKey(-1)
+    , inFlight(0)
+    , maxInFlight(1)
+{
+    setMaxFramesInFlight(tasks->threadCount());
+}
+
+FrameScheduler::~FrameScheduler()
+{
+    waitForDone();
+}
+
+void FrameScheduler::setMaxFramesInFlight(int count)
+{
+    QMutexLocker locker(&mutex);
+    maxInFlight = qMax(1, count);
+    slotFreed.wakeAll();
+}
+
+int FrameScheduler::maxFramesInFlight() const
+{
+    QMutexLocker locker(&mutex);
+    return maxInFlight;
+}
+
+int FrameScheduler::framesInFlight() const
+{
+    QMutexLocker locker(&mutex);
+    return inFlight;
+}
+
+bool FrameScheduler::hasCapacity() const
+{
+    QMutexLocker locker(&mutex);
+    return inFlight < maxInFlight;
+}
+
+void FrameScheduler::waitForCapacity(int msecs)
+{
+    QMutexLocker locker(&mutex);
+    if (inFlight >= maxInFlight) {
+        slotFreed.wait(&mutex, msecs);
+    }
+}
+
+quint64 FrameScheduler::droppedFrames() const
+{
+    QMutexLocker locker(&mutex);
+    return dropped;
+}
+
+void FrameScheduler::setFrameCache(FrameCache *frameCache)
+{
+    QMutexLocker locker(&mutex);
+    cache = frameCache;
+}
+
+bool FrameScheduler::submit(const cv::Mat &frame, qint64 startTime, const FilterChain &chain)
+{
+    return submit(FrameHandle(), frame, startTime, chain, false);
+}
+
+bool FrameScheduler::submit(const FrameHandle &frame, const FilterChain &chain)
+{
+    return submit(frame, cv::Mat(), frame.startTime(), chain, false);
+}
+
+bool FrameScheduler::submitStill(const cv::Mat &frame, qint64 startTime, const FilterChain &chain)
+{
+    return submit(FrameHandle(), frame, startTime, chain, true);
+}
+
+bool FrameScheduler::submit(const FrameHandle &source, const cv::Mat &frame, qint64 startTime,
+                            const FilterChain &chain, bool still)
+{
+    // The cache is set up before the first frame, on this thread.
+    const quint64 cacheVersion = FrameCache::version(chain);
+    QImage cached;
+    const bool hit = cache && cache->lookup(startTime, cacheVersion, &cached);
+
+    QMutexLocker locker(&mutex);
+
+    // A hit needs no worker, so it is taken even when every slot is busy.
+    if (hit) {
+        framesIn->add();
+        const qint64 key = (startTime < 0 || reorder.contains(startTime)) ? lastKey + 1 : startTime;
+        lastKey = qMax(lastKey, key);
+        SyncMonitor::instance().markProcessStart(key);
+        SyncMonitor::instance().markProcessEnd(key);
+        reorder.reserve(key);
+        reorder.complete(key, cached);
+        emitReady();
+        return true;
+    }
+
+    if (inFlight >= maxInFlight) {
+        ++dropped;
+        framesDropped->add();
+        return false;
+    }
+    framesIn->add();
+
+    FrameJob job;
+    job.sequence = nextSequence++;
+    job.epoch = epoch;
+    job.source = source;
+    job.frame = frame;
+    job.chain = chain;
+    job.arena = arenas.acquire();
+    job.startTime = startTime;
+    job.cacheVersion = cache ? cacheVersion : 0;
+    job.submitted = Metrics::now();
+    job.step = 0;
+    job.ok = true;
+    job.still = still;
+
+    // Frames without a timestamp, or repeating one, still need their own slot.
+    job.key = (startTime < 0 || reorder.contains(startTime)) ? lastKey + 1 : startTime;
+    lastKey = qMax(lastKey, job.key);
+
+    // A still frame is out of sequence anyway; temporal stages just see it.
+    for (const FilterInvocation &step : chain) {
+        if (!still && step.stage->dependsOnPreviousFrame()) {
+            job.tickets.insert(step.stage, issuedTickets[step.stage]++);
+        }
+    }
+
+    reorder.reserve(job.key);
+    ++inFlight;
+
+    tasks->submit([this, job]() { process(job); });
+    return true;
+}
+
+// Read off the stage histograms, so stage time is recorded in one place.
+QList<StageStats> FrameScheduler::takeStageStats()
+{
+    QMutexLocker locker(&mutex);
+    QList<StageStats> stats;
+    for (int i = 0; i < stageWindows.size(); ++i) {
+        StageStats stage;
+        stage.name = stageWindows[i].first;
+        stageWindows[i].second.take(&stage.frames, &stage.busyNsecs);
+        if (stage.frames > 0) {
+            stats.append(stage);
+        }
+    }
+    return stats;
+}
+
+void FrameScheduler::discardPending()
+{
+    QMutexLocker locker(&mutex);
+    ++epoch;
+}
+
+void FrameScheduler::waitForDone()
+{
+    QMutexLocker locker(&mutex);
+    while (inFlight > 0) {
+        idle.wait(&mutex);
+    }
+}
+
+void FrameScheduler::clearStill()
+{
+    QMutexLocker locker(&stillMutex);
+    stillMemo.clear();
+}
+
+void FrameScheduler::process(FrameJob job)
+{
+    QElapsedTimer timer;
+
+    if (job.step == 0) {
+        SyncMonitor::instance().markProcessStart(job.key);
+    }
+
+    // Discarded while it waited for a worker: keep the slot, skip the work.
+    if (job.ok && isDiscarded(job)) {
+        job.ok = false;
+    }
+
+    if (job.ok && job.source.isValid()) {
+        timer.start();
+        TRACE_SCOPE("convert");
+        ALLOC_SCOPE("convert");
+        try {
+            job.frame = frame_to_mat(job.source);
+        } catch(cv::Exception &) {
+            job.ok = false;
+        }
+        job.source = FrameHandle();
+        recordStage("convert", timer.nsecsElapsed());
+    }
+
+    if (job.still && job.ok) {
+        timer.start();
+        TRACE_SCOPE("still");
+        QMutexLocker memoLocker(&stillMutex);
+        try {
+            // A newer edit discards this one; stop at the next stage rather
+            // than finish a chain nobody will see.
+            job.frame = stillMemo.run(job.startTime, job.frame, job.chain, [&]() { return isDiscarded(job); });
+            job.ok = !job.frame.empty();
+        } catch(cv::Exception &) {
+            stillMemo.clear();
+            job.ok = false;
+        }
+        recordStage("still", timer.nsecsElapsed());
+        job.step = job.chain.size();
+    }
+
+    while (job.step < job.chain.size()) {
+        const FilterInvocation &step = job.chain[job.step];
+        const bool temporal = job.tickets.contains(step.stage);
+
+        // Not our turn yet: park the frame instead of holding a worker.
+        // finishTurn() resubmits it when the previous frame is through.
+        if (temporal && !takeTurn(job)) {
+            return;
+        }
+
+        // A failed frame still takes its turn so later frames are not stuck
+        // behind it.
+        if (job.ok && isDiscarded(job)) {
+            job.ok = false;
+        }
+        if (job.ok) {
+            timer.start();
+            TRACE_SCOPE(step.stage->traceName());
+            ALLOC_SCOPE(step.stage->traceName());
+            try {
+                job.frame = step.stage->process(job.frame, step.params, job.arena);
+            } catch(cv::Exception &) {
+                job.ok = false;
+            }
+            recordStage(step.stage->name(), timer.nsecsElapsed());
+        }
+
+        if (temporal) {
+            finishTurn(step.stage);
+        }
+        ++job.step;
+    }
+
+    QImage result;
+    if (job.ok) {
+        TRACE_SCOPE("to qimage");
+        ALLOC_SCOPE("to qimage");
+        result = mat_to_owned_qimage(job.frame);
+    }
+    job.frame = cv::Mat();
+    arenas.release(job.arena);
+
+    if (job.cacheVersion != 0) {
+        cache->insert(job.startTime, job.cacheVersion, result);
+    }
+
+    SyncMonitor::instance().markProcessEnd(job.key);
+    complete(job, result);
+}
+
+bool FrameScheduler::isDiscarded(const FrameJob &job) const
+{
+    QMutexLocker locker(&mutex);
+    return job.epoch != epoch;
+}
+
+bool FrameScheduler::takeTurn(const FrameJob &job)
+{
+    FilterStage *stage = job.chain[job.step].stage;
+    const quint64 ticket = job.tickets.value(stage);
+
+    QMutexLocker locker(&mutex);
+    if (servedTickets.value(stage) == ticket) {
+        return true;
+    }
+    parked[stage].insert(ticket, job);
+    return false;
+}
+
+void FrameScheduler::finishTurn(FilterStage *stage)
+{
+    QMutexLocker locker(&mutex);
+    const quint64 next = ++servedTickets[stage];
+
+    QMap<quint64, FrameJob> &waiting = parked[stage];
+    if (waiting.contains(next)) {
+        const FrameJob job = waiting.take(next);
+        tasks->submit([this, job]() { process(job); });
+    }
+}
+
+void FrameScheduler::recordStage(const QString &name, qint64 nsecs)
+{
+    LatencyHistogram *latency;
+    {
+        QMutexLocker locker(&mutex);
+        LatencyHistogram *&known = stageLatency[name];
+        if (!known) {
+            known = Metrics::instance().histogram(name == "convert" || name == "still" ? "stage." + name
+                                                                                      : "filter." + name);
+            stageWindows.append(qMakePair(name, HistogramWindow(known)));
+        }
+        latency = known;
+    }
+    latency->record(nsecs);
+}
+
+void FrameScheduler::complete(const FrameJob &job, const QImage &result)
+{
+    frameLatency->record(Metrics::now() - job.submitted);
+
+    QMutexLocker locker(&mutex);
+    if (--inFlight == 0) {
+        idle.wakeAll();
+    }
+    slotFreed.wakeAll();
+
+    reorder.complete(job.key, job.epoch == epoch ? result : QImage());
+    emitReady();
+}
+
+// Emitting under the lock keeps the order across workers; receivers live
+// on the GUI thread so the connection is queued and returns immediately.
+void FrameScheduler::emitReady()
+{
+    qint64 key;
+    QImage ready;
+    while (reorder.takeNext(&key, &ready)) {
+        if (!ready.isNull()) {
+            framesOut->add();
+            emit frameProcessed(ready, key);
+        } else {
+            framesSkipped->add();
+            emit frameSkipped(key);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QImage>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QWaitCondition>
+
+#include "filterstage.h"
+#include "filtermemo.h"
+#include "framehandle.h"
+#include "metrics.h"
+#include "reorderbuffer.h"
+#include "stagestats.h"
+#include "taskscheduler.h"
+
+class FrameCache;
+
+struct FrameJob
+{
+    quint64 sequence;
+    quint64 epoch;
+    qint64 key;
+    FrameHandle source;
+    cv::Mat frame;
+    FilterChain chain;
+    QHash<FilterStage*, quint64> tickets;
+    FrameArena *arena;
+    // Where the result goes in the frame cache; version 0 keeps it out.
+    qint64 startTime;
+    quint64 cacheVersion;
+    qint64 submitted;
+    int step;
+    bool ok;
+    bool still;
+};
+
+// Keeps up to maxFramesInFlight() frames on the shared task scheduler, each
+// running the whole filter chain, and emits the results in presentation
+// order.
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    FrameScheduler(TaskScheduler *tasks, QObject *parent = 0);
+    ~FrameScheduler();
+
+    void setMaxFramesInFlight(int count);
+    int maxFramesInFlight() const;
+    int framesInFlight() const;
+    // For callers that would rather wait than have submit() drop.
+    bool hasCapacity() const;
+    // Returns once a slot is free, or after msecs.
+    void waitForCapacity(int msecs);
+    quint64 droppedFrames() const;
+
+    // Frames found here are passed on in their slot without processing,
+    // and processed frames are added. 0 (the default) for none.
+    void setFrameCache(FrameCache *cache);
+
+    // Worker time per filter stage, plus "convert", since the previous call.
+    QList<StageStats> takeStageStats();
+
+    // Returns false and drops the frame when every slot is busy; present()
+    // must never wait on the workers.
+    bool submit(const cv::Mat &frame, qint64 startTime, const FilterChain &chain);
+    // Same, but the frame is converted on the worker rather than the caller.
+    bool submit(const FrameHandle &frame, const FilterChain &chain);
+    // For the same frame submitted again and again with new parameters
+    // (paused, looping): keeps the intermediates of its last pass and reruns
+    // only the steps the parameter change affects (see ChainMemo). One
+    // still frame at a time; frame is not modified.
+    bool submitStill(const cv::Mat &frame, qint64 startTime, const FilterChain &chain);
+
+    // Results of frames already in flight are thrown away, e.g. after a seek
+    // or a newer preview; frames that have not started are not processed.
+    void discardPending();
+    void waitForDone();
+    // Forgets the intermediates submitStill() kept, when the frames they
+    // came from are gone (a new source, a seek).
+    void clearStill();
+
+    void process(FrameJob job);
+
+signals:
+    void frameProcessed(QImage frame, qint64 startTime);
+    // A frame that failed or was discarded, in its presentation slot.
+    void frameSkipped(qint64 startTime);
+
+private:
+    bool submit(const FrameHandle &source, const cv::Mat &frame, qint64 startTime, const FilterChain &chain,
+                bool still);
+    bool isDiscarded(const FrameJob &job) const;
+    bool takeTurn(const FrameJob &job);
+    void finishTurn(FilterStage *stage);
+    void complete(const FrameJob &job, const QImage &result);
+    void emitReady();
+    void recordStage(const QString &name, qint64 nsecs);
+
+    TaskScheduler *tasks;
+    FrameArenaPool arenas;
+    FrameCache *cache;
+    QMutex stillMutex;
+    ChainMemo stillMemo;
+
+    mutable QMutex mutex;
+    QWaitCondition idle;
+    QWaitCondition slotFreed;
+
+    ReorderBuffer<QImage> reorder;
+    QHash<FilterStage*, quint64> issuedTickets;
+    QHash<FilterStage*, quint64> servedTickets;
+    QHash<FilterStage*, QMap<quint64, FrameJob> > parked;
+    QHash<QString, LatencyHistogram*> stageLatency;
+    // The same, in the order first used, for takeStageStats().
+    QList<QPair<QString, HistogramWindow> > stageWindows;
+    LatencyHistogram *frameLatency;
+    Counter *framesIn;
+    Counter *framesOut;
+    Counter *framesDropped;
+    Counter *framesSkipped;
+
+    quint64 nextSequence;
+    quint64 epoch;
+    quint64 dropped;
+    qint64 lastKey;
+    int inFlight;
+    int maxInFlight;
+};
+
+#endif // FRAMESCHEDULER_H
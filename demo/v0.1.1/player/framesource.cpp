@@ -0,0 +1,227 @@
+#include "framesource.h"
+#include "allocstats.h"
+#include "metrics.h"
+#include "syncmonitor.h"
+#include "tracing.h"
+
+#include <QElapsedTimer>
+
+class FrameSourceThread : public QThread
+{
+public:
+    explicit FrameSourceThread(FrameSource *source) : source(source) {}
+
+protected:
+    void run() { source->run(); }
+
+private:
+    FrameSource *source;
+};
+
+FrameSource::FrameSource(QObject *parent)
+    : QObject(parent)
+    , frameRing(0)
+    , thread(new FrameSourceThread(this))
+    , paced(true)
+    , paused(false)
+    , stopping(false)
+    , ended(false)
+    , pendingSeek(-1)
+    , scrubUntil(-1)
+    , finishing(false)
+    , delivered(0)
+    , busy(0)
+{
+}
+
+FrameSource::~FrameSource()
+{
+    // Subclasses must stop() in their own destructor, while nextFrame()
+    // still has an object to run on; this only catches the base case.
+    stop();
+    delete thread;
+}
+
+void FrameSource::start()
+{
+    {
+        QMutexLocker locker(&mutex);
+        if (thread->isRunning() && !finishing) {
+            return;
+        }
+        stopping = false;
+        ended = false;
+    }
+    relaunch();
+}
+
+// A run() that has already decided to end is waited for, so the thread
+// can be started again rather than the request being lost to it.
+void FrameSource::relaunch()
+{
+    thread->wait();
+    QMutexLocker locker(&mutex);
+    finishing = false;
+    thread->start();
+}
+
+void FrameSource::stop()
+{
+    stopping = true;
+    if (frameRing) {
+        frameRing->wakeWaiters();
+    }
+    setPaused(false);
+    thread->wait();
+}
+
+void FrameSource::setPaused(bool enabled)
+{
+    QMutexLocker locker(&mutex);
+    paused = enabled;
+    scrubUntil = -1;
+    // Either way: a paced wait for the next frame ends early too.
+    wakeup.wakeAll();
+}
+
+bool FrameSource::isRunning() const
+{
+    return thread->isRunning();
+}
+
+void FrameSource::seek(qint64 position)
+{
+    bool restart;
+    {
+        QMutexLocker locker(&mutex);
+        pendingSeek = qMax<qint64>(0, position);
+        ended = false;
+        // run() checks for a seek under the same lock before it ends, so
+        // either it takes this one or it is already finishing.
+        restart = !stopping && (finishing || !thread->isRunning());
+        wakeup.wakeAll();
+    }
+    // A source that ran off the end goes again from the new position.
+    if (restart) {
+        relaunch();
+    }
+}
+
+void FrameSource::scrub(qint64 from, qint64 until)
+{
+    seek(from);
+    QMutexLocker locker(&mutex);
+    scrubUntil = until;
+    paused = false;
+    wakeup.wakeAll();
+}
+
+void FrameSource::fail(const QString &message)
+{
+    emit error(message);
+}
+
+void FrameSource::waitWhilePaused()
+{
+    QMutexLocker locker(&mutex);
+    while (paused && !stopping) {
+        wakeup.wait(&mutex);
+    }
+}
+
+void FrameSource::run()
+{
+    QElapsedTimer clock;
+    qint64 firstTimestamp = -1;
+    LatencyHistogram *decodeLatency = Metrics::instance().histogram("stage.decode");
+
+    while (!stopping) {
+        if (paused) {
+            waitWhilePaused();
+            // Pacing restarts from wherever the stream is now.
+            firstTimestamp = -1;
+            continue;
+        }
+
+        const qint64 seekTarget = pendingSeek.exchange(-1);
+        if (seekTarget >= 0) {
+            seekTo(seekTarget);
+            firstTimestamp = -1;
+        }
+
+        QElapsedTimer decodeTimer;
+        decodeTimer.start();
+        FrameHandle frame;
+        {
+            TRACE_SCOPE("decode");
+            ALLOC_SCOPE("decode");
+            frame = nextFrame();
+        }
+        const qint64 decodeNsecs = decodeTimer.nsecsElapsed();
+        busy.fetch_add(decodeNsecs, std::memory_order_relaxed);
+        if (!frame.isValid()) {
+            {
+                QMutexLocker locker(&mutex);
+                if (pendingSeek >= 0 && !stopping) {
+                    continue;
+                }
+                finishing = true;
+                ended = true;
+            }
+            // A consumer waiting for frames learns there are no more.
+            if (frameRing) {
+                frameRing->wakeWaiters();
+            }
+            emit finished();
+            return;
+        }
+        decodeLatency->record(decodeNsecs);
+
+        // A scrub window is wanted as soon as possible and in full.
+        const bool scrubbing = scrubUntil.load() >= 0;
+        if (paced && !scrubbing && frame.startTime() >= 0) {
+            if (firstTimestamp < 0) {
+                firstTimestamp = frame.startTime();
+                clock.start();
+            }
+            const qint64 due = (frame.startTime() - firstTimestamp) / 1000;
+            const qint64 early = due - clock.elapsed();
+            if (early > 0) {
+                QMutexLocker locker(&mutex);
+                if (!paused && !stopping && pendingSeek < 0) {
+                    wakeup.wait(&mutex, early);
+                }
+            }
+            // The frame is from before the seek, or nobody wants it.
+            if (stopping || pendingSeek >= 0) {
+                continue;
+            }
+        }
+
+        if (frameRing) {
+            SyncMonitor::instance().markPresented(frame.startTime());
+            if (paced && !scrubbing) {
+                frameRing->push(frame);
+            } else if (!frameRing->tryPush(frame)) {
+                TRACE_SCOPE("ring wait");
+                while (!frameRing->tryPush(frame) && !stopping) {
+                    frameRing->waitForRoom(100);
+                }
+            }
+        }
+        delivered.fetch_add(1, std::memory_order_relaxed);
+
+        if (frame.startTime() >= 0) {
+            emit positionChanged(frame.startTime() / 1000);
+        }
+
+        if (scrubbing && frame.startTime() >= 0) {
+            QMutexLocker locker(&mutex);
+            // Unless another scrub or seek came in meanwhile.
+            if (scrubUntil >= 0 && frame.startTime() / 1000 >= scrubUntil && pendingSeek < 0) {
+                scrubUntil = -1;
+                paused = true;
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <atomic>
+
+#include "framehandle.h"
+#include "framering.h"
+
+class FrameSourceThread;
+
+// Produces frames without QMediaPlayer and hands them on exactly like
+// VideoSurface does: FrameHandles pushed into a FrameRing. Each source runs
+// on its own thread.
+//
+// A paced source delivers frames at their timestamps and drops on a full
+// ring, like playback. An unpaced one runs as fast as the consumer drains
+// the ring and waits for space instead of dropping.
+class FrameSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FrameSource(QObject *parent = 0);
+    ~FrameSource();
+
+    void setFrameRing(FrameRing *ring) { frameRing = ring; }
+    void setPaced(bool enabled) { paced = enabled; }
+    bool isPaced() const { return paced; }
+
+    // Milliseconds, or -1 when unknown.
+    virtual qint64 duration() const { return -1; }
+
+    void start();
+    void stop();
+    void setPaused(bool enabled);
+    bool isPaused() const { return paused.load(); }
+    bool isRunning() const;
+    bool atEnd() const { return ended.load(); }
+
+    // Takes effect on the source thread before the next frame.
+    void seek(qint64 position);
+    // Seeks to from and delivers unpaced up to the first frame at or past
+    // until (both in ms), then pauses; for filling the frames around a
+    // scrubbed position. setPaused() ends it early.
+    void scrub(qint64 from, qint64 until);
+
+    quint64 deliveredFrames() const { return delivered.load(std::memory_order_relaxed); }
+    // Time spent inside nextFrame(), i.e. decoding.
+    qint64 busyNsecs() const { return busy.load(std::memory_order_relaxed); }
+
+signals:
+    void positionChanged(qint64 position);
+    void finished();
+    void error(const QString &message);
+
+protected:
+    // Called on the source thread. An invalid handle ends the stream; call
+    // fail() first if it ends because of an error.
+    virtual FrameHandle nextFrame() = 0;
+    virtual bool seekTo(qint64 position) { Q_UNUSED(position); return false; }
+
+    void fail(const QString &message);
+
+private:
+    friend class FrameSourceThread;
+    void run();
+    void relaunch();
+    void waitWhilePaused();
+
+    FrameRing *frameRing;
+    FrameSourceThread *thread;
+    bool paced;
+
+    QMutex mutex;
+    // Wakes run() from a pause or a paced wait: on resume, pause, seek and
+    // stop.
+    QWaitCondition wakeup;
+    std::atomic<bool> paused;
+    std::atomic<bool> stopping;
+    std::atomic<bool> ended;
+    std::atomic<qint64> pendingSeek;
+    std::atomic<qint64> scrubUntil;
+    // run() has seen the end of the stream and is returning; under mutex.
+    bool finishing;
+    std::atomic<quint64> delivered;
+    std::atomic<qint64> busy;
+};
+
+#endif // FRAMESOURCE_H
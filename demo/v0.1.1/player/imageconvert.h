@@ -0,0 +1,133 @@
+#ifndef IMAGECONVERT_H
+#define IMAGECONVERT_H
+
+#include <QImage>
+
+#include <opencv/cv.hpp>
+
+#include "framehandle.h"
+
+inline QImage mat_to_qimage(cv::Mat &mat, QImage::Format format)
+{
+    return QImage(mat.data, mat.cols, mat.rows,
+                  static_cast<int>(mat.step), format);
+}
+
+inline cv::Mat qimage_to_mat(const QImage &img, int format)
+{
+    return cv::Mat(img.height(), img.width(),
+                   format, const_cast<uchar*>(img.constBits()), img.bytesPerLine());
+}
+
+inline QImage::Format qimage_format_for(const cv::Mat &mat)
+{
+    if(!mat.empty()){
+        switch(mat.type()){
+        case CV_8UC3: return QImage::Format_RGB888;
+        case CV_8U: return QImage::Format_Indexed8;
+        case CV_8UC4: return QImage::Format_ARGB32;
+        }
+    }
+    return QImage::Format_Invalid;
+}
+
+inline QImage mat_to_qimage(cv::Mat &mat)
+{
+    QImage::Format format = qimage_format_for(mat);
+    if(format != QImage::Format_Invalid){
+        return mat_to_qimage(mat, format);
+    }
+    return {};
+}
+
+inline void release_mat(void *info)
+{
+    delete static_cast<cv::Mat*>(info);
+}
+
+// Same view as mat_to_qimage, but the QImage holds a reference on the Mat's
+// buffer so it can be handed to another thread and outlive the Mat.
+inline QImage mat_to_owned_qimage(const cv::Mat &mat)
+{
+    QImage::Format format = qimage_format_for(mat);
+    if(format == QImage::Format_Invalid){
+        return {};
+    }
+
+    cv::Mat *owner = new cv::Mat(mat);
+    return QImage(owner->data, owner->cols, owner->rows,
+                  static_cast<int>(owner->step), format, release_mat, owner);
+}
+
+// The returned Mat always owns its pixels.
+inline cv::Mat qimage_to_mat(const QImage &img)
+{
+    if(img.isNull()){
+        return cv::Mat();
+    }
+
+    switch (img.format()) {
+    case QImage::Format_RGB888:{
+        cv::Mat result;
+        cv::cvtColor(qimage_to_mat(img, CV_8UC3), result, CV_RGB2BGR);
+        return result;
+    }
+    case QImage::Format_Indexed8:{
+        return qimage_to_mat(img, CV_8U).clone();
+    }
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:{
+        cv::Mat result;
+        cv::cvtColor(qimage_to_mat(img, CV_8UC4), result, cv::COLOR_RGBA2BGR);
+        return result;
+    }
+    default:
+        break;
+    }
+    return {};
+}
+
+// Converts a frame of the given pixel format, viewed as by
+// FrameHandle::mat(), into the filters' working layout. The result always
+// owns its pixels and the conversion is the only pass over the source; an
+// empty Mat means the format is not handled.
+inline cv::Mat pixels_to_mat(const cv::Mat &pixels, QVideoFrame::PixelFormat format)
+{
+    cv::Mat result;
+    if(pixels.empty()){
+        return result;
+    }
+
+    switch (format) {
+    case QVideoFrame::Format_RGB24:
+        cv::cvtColor(pixels, result, CV_RGB2BGR);
+        break;
+    case QVideoFrame::Format_RGB32:
+    case QVideoFrame::Format_ARGB32:
+    case QVideoFrame::Format_ARGB32_Premultiplied:
+        cv::cvtColor(pixels, result, cv::COLOR_RGBA2BGR);
+        break;
+    // Same channel order the 32-bit formats end up in.
+    case QVideoFrame::Format_RGB565:
+        cv::cvtColor(pixels, result, cv::COLOR_BGR5652RGB);
+        break;
+    case QVideoFrame::Format_RGB555:
+        cv::cvtColor(pixels, result, cv::COLOR_BGR5552RGB);
+        break;
+    case QVideoFrame::Format_Y8:
+        cv::cvtColor(pixels, result, cv::COLOR_GRAY2BGR);
+        break;
+    default:
+        break;
+    }
+    return result;
+}
+
+// Reads straight from the mapped frame; no intermediate QImage or copy.
+inline cv::Mat frame_to_mat(const FrameHandle &frame)
+{
+    return pixels_to_mat(frame.mat(), frame.pixelFormat());
+}
+
+#endif // IMAGECONVERT_H
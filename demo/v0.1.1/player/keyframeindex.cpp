@@ -0,0 +1,132 @@
+#include "keyframeindex.h"
+
+#include <QFile>
+
+#include <algorithm>
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavformat/avformat.h>
+}
+#endif
+
+KeyframeIndex::KeyframeIndex(QObject *parent)
+    : QThread(parent)
+    , cancelled(false)
+    , complete(false)
+{
+}
+
+KeyframeIndex::~KeyframeIndex()
+{
+    cancel();
+}
+
+void KeyframeIndex::build(const QString &file)
+{
+    clear();
+    filename = file;
+    cancelled = false;
+    start(QThread::LowPriority);
+}
+
+void KeyframeIndex::cancel()
+{
+    cancelled = true;
+    wait();
+}
+
+void KeyframeIndex::clear()
+{
+    cancel();
+    QMutexLocker locker(&mutex);
+    keyframes.clear();
+    complete = false;
+}
+
+int KeyframeIndex::count() const
+{
+    QMutexLocker locker(&mutex);
+    return keyframes.size();
+}
+
+qint64 KeyframeIndex::keyframeBefore(qint64 position) const
+{
+    QMutexLocker locker(&mutex);
+    if (!complete && (keyframes.isEmpty() || position > keyframes.last())) {
+        return -1;
+    }
+    QVector<qint64>::const_iterator it = std::upper_bound(keyframes.constBegin(), keyframes.constEnd(), position);
+    return it == keyframes.constBegin() ? -1 : *(it - 1);
+}
+
+qint64 KeyframeIndex::keyframeAfter(qint64 position) const
+{
+    QMutexLocker locker(&mutex);
+    QVector<qint64>::const_iterator it = std::upper_bound(keyframes.constBegin(), keyframes.constEnd(), position);
+    return it == keyframes.constEnd() ? -1 : *it;
+}
+
+#ifdef HAVE_FFMPEG
+
+void KeyframeIndex::run()
+{
+    const QByteArray path = QFile::encodeName(filename);
+    AVFormatContext *format = 0;
+    if (avformat_open_input(&format, path.constData(), 0, 0) < 0) {
+        return;
+    }
+    if (avformat_find_stream_info(format, 0) < 0) {
+        avformat_close_input(&format);
+        return;
+    }
+
+    const int streamIndex = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, 0, 0);
+    if (streamIndex < 0) {
+        avformat_close_input(&format);
+        return;
+    }
+    const AVStream *stream = format->streams[streamIndex];
+    const AVRational microseconds = { 1, 1000000 };
+    for (unsigned i = 0; i < format->nb_streams; ++i) {
+        if (int(i) != streamIndex) {
+            format->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    // Packets are only read, never decoded, so this runs well ahead of
+    // playback.
+    AVPacket *packet = av_packet_alloc();
+    while (!cancelled && av_read_frame(format, packet) >= 0) {
+        if (packet->stream_index == streamIndex && (packet->flags & AV_PKT_FLAG_KEY)) {
+            int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (ts != AV_NOPTS_VALUE) {
+                if (stream->start_time != AV_NOPTS_VALUE) {
+                    ts -= stream->start_time;
+                }
+                const qint64 position = av_rescale_q(ts, stream->time_base, microseconds);
+                QMutexLocker locker(&mutex);
+                // Keyframes come in presentation order in every container
+                // we play; an odd one out is sorted in.
+                if (keyframes.isEmpty() || position > keyframes.last()) {
+                    keyframes.append(position);
+                } else if (!std::binary_search(keyframes.constBegin(), keyframes.constEnd(), position)) {
+                    keyframes.insert(std::lower_bound(keyframes.begin(), keyframes.end(), position), position);
+                }
+            }
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    avformat_close_input(&format);
+
+    complete = !cancelled;
+}
+
+#else // HAVE_FFMPEG
+
+void KeyframeIndex::run()
+{
+}
+
+#endif // HAVE_FFMPEG
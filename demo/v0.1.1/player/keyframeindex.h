@@ -0,0 +1,53 @@
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+#include <atomic>
+
+// Start times of the keyframes of a file's video stream, in microseconds
+// from the start of the stream (the timestamps NativeDecoder gives its
+// frames). build() scans the packets on a thread of its own, without
+// decoding, and lookups may start at once: they answer for the part
+// already scanned and return -1 beyond it.
+//
+// NativeDecoder already seeks to the keyframe before a position and skips
+// up to it, so a seek needs no index. The index says where decoding of a
+// range really starts: frames from keyframeBefore() on are decoded anyway
+// and are cheap to prefetch. Only built with CONFIG += native_decoder;
+// without it the index stays empty.
+class KeyframeIndex : public QThread
+{
+public:
+    explicit KeyframeIndex(QObject *parent = 0);
+    ~KeyframeIndex();
+
+    // Drops the current index and scans filename.
+    void build(const QString &filename);
+    void cancel();
+    // Cancels and drops the index, e.g. for a source without keyframes.
+    void clear();
+
+    bool isComplete() const { return complete.load(); }
+    int count() const;
+
+    // The last keyframe at or before position, the first after it, or -1.
+    qint64 keyframeBefore(qint64 position) const;
+    qint64 keyframeAfter(qint64 position) const;
+
+protected:
+    void run();
+
+private:
+    QString filename;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> complete;
+
+    mutable QMutex mutex;
+    QVector<qint64> keyframes;
+};
+
+#endif // KEYFRAMEINDEX_H
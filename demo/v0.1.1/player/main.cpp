@@ -1,14 +1,114 @@
 #include "videoplayer.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "syncmonitor.h"
+#include "tracing.h"
 
 #include <QApplication>
+#include <QShortcut>
+#include <QTimer>
 
 int main(int argc, char **argv)
 {
     QApplication app(argc, argv);
 
     VideoPlayer player;
+    int decodeThreads = 0;
+    QString benchmarkFile;
+    QString syntheticSpec;
+    QString traceFile;
+    QString metricsFile;
+    int metricsPort = 0;
+    qint64 frameCacheMiB = 256;
+    bool frameCacheLz4 = false;
+    bool benchmark = false;
+    foreach (const QString &arg, app.arguments()) {
+        if (arg.startsWith("--threads=")) {
+            player.setWorkerThreads(arg.mid(10).toInt());
+        } else if (arg.startsWith("--decode-threads=")) {
+            decodeThreads = arg.mid(17).toInt();
+        } else if (arg.startsWith("--benchmark=")) {
+            benchmarkFile = arg.mid(12);
+            benchmark = true;
+        } else if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg.startsWith("--synthetic=")) {
+            syntheticSpec = arg.mid(12);
+        } else if (arg.startsWith("--trace=")) {
+            traceFile = arg.mid(8);
+        } else if (arg.startsWith("--metrics=")) {
+            metricsFile = arg.mid(10);
+        } else if (arg.startsWith("--metrics-port=")) {
+            metricsPort = arg.mid(15).toInt();
+        } else if (arg.startsWith("--frame-cache=")) {
+            // In MiB of processed frames; 0 turns the cache off.
+            frameCacheMiB = arg.mid(14).toLongLong();
+        } else if (arg == "--frame-cache-lz4") {
+            frameCacheLz4 = true;
+        } else if (arg.startsWith("--drift-threshold=")) {
+            // In ms; past it the player warns that the picture lags the audio.
+            SyncMonitor::instance().setDriftThreshold(arg.mid(18).toLongLong());
+        }
+    }
+    if (app.arguments().contains("--decoder=native")) {
+        player.useNativeDecoder(decodeThreads);
+    }
+    // e.g. --synthetic=3840x2160@120:noise, see SyntheticSource::configure().
+    if (!syntheticSpec.isEmpty() && !player.useSyntheticSource(syntheticSpec)) {
+        return 2;
+    }
+    if (app.arguments().contains("--stages")) {
+        player.setProcessingMode(VideoPlayer::StagePipelined);
+    }
+    if (app.arguments().contains("--strips")) {
+        player.setLineBuffered(true);
+    }
+    if (app.arguments().contains("--log-stats")) {
+        player.setStatsLogging(true);
+    }
+    player.setFrameCache(frameCacheMiB * 1024 * 1024, frameCacheLz4);
     player.show();
 
+    // Each write takes the events since the previous one: Ctrl+Shift+T
+    // writes FILE.1, FILE.2, ... and the rest goes to FILE on exit.
+    if (!traceFile.isEmpty()) {
+        Tracing::setEnabled(true);
+        QShortcut *dump = new QShortcut(QKeySequence("Ctrl+Shift+T"), &player);
+        int dumps = 0;
+        QObject::connect(dump, &QShortcut::activated, [traceFile, dumps]() mutable {
+            Tracing::writeChromeTrace(QString("%1.%2").arg(traceFile).arg(++dumps));
+        });
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [traceFile]() {
+            Tracing::writeChromeTrace(traceFile);
+        });
+    }
+
+    // Totals since start, rewritten every few seconds so a crash or a kill
+    // still leaves recent numbers; FILE.csv writes CSV instead of JSON.
+    if (!metricsFile.isEmpty()) {
+        QTimer *metricsTimer = new QTimer(&player);
+        QObject::connect(metricsTimer, &QTimer::timeout, [metricsFile]() {
+            Metrics::instance().snapshot().save(metricsFile);
+        });
+        metricsTimer->start(5000);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [metricsFile]() {
+            Metrics::instance().snapshot().save(metricsFile);
+        });
+    }
+
+    // For a local Prometheus scraper: http://127.0.0.1:PORT/metrics
+    MetricsServer metricsServer;
+    if (metricsPort > 0 && !metricsServer.listen(metricsPort)) {
+        qWarning() << "metrics endpoint:" << metricsServer.errorString();
+        return 2;
+    }
+
+    // Exits with 0 once every frame of the file (or of a finite synthetic
+    // source) has been presented.
+    if (benchmark && !player.runBenchmark(benchmarkFile)) {
+        return 2;
+    }
+
     return app.exec();
 }
 
@@ -0,0 +1,367 @@
+#include "metrics.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <limits>
+
+namespace {
+
+// Read once, so now() is relative to a common start for every thread.
+QElapsedTimer &monotonic_clock()
+{
+    static QElapsedTimer clock;
+    static bool started = (clock.start(), true);
+    Q_UNUSED(started);
+    return clock;
+}
+
+double to_ms(qint64 nsecs)
+{
+    return nsecs / 1e6;
+}
+
+// "filter.NeonEdge" -> "va_filter_NeonEdge"
+QByteArray prometheus_name(const QString &name)
+{
+    QByteArray result = "va_" + name.toLatin1();
+    for (int i = 3; i < result.size(); ++i) {
+        const char c = result[i];
+        if (!(c >= 'a' && c <= 'z') && !(c >= 'A' && c <= 'Z') && !(c >= '0' && c <= '9')) {
+            result[i] = '_';
+        }
+    }
+    return result;
+}
+
+int highest_bit(quint64 value)
+{
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+}
+
+qint64 HistogramSnapshot::percentile(double p) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(p / 100.0 * count + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return qMin(max, LatencyHistogram::bucketUpperBound(i));
+        }
+    }
+    return max;
+}
+
+HistogramSnapshot HistogramSnapshot::since(const HistogramSnapshot &earlier) const
+{
+    if (earlier.count > count || earlier.buckets.size() != buckets.size()) {
+        return *this;
+    }
+
+    HistogramSnapshot delta;
+    delta.buckets.resize(buckets.size());
+    delta.count = count - earlier.count;
+    delta.sum = sum - earlier.sum;
+    int lowest = -1;
+    int highest = -1;
+    for (int i = 0; i < buckets.size(); ++i) {
+        if (earlier.buckets[i] > buckets[i]) {
+            return *this;
+        }
+        delta.buckets[i] = buckets[i] - earlier.buckets[i];
+        if (delta.buckets[i] > 0) {
+            lowest = lowest < 0 ? i : lowest;
+            highest = i;
+        }
+    }
+    if (lowest >= 0) {
+        delta.min = qMax(min, lowest > 0 ? LatencyHistogram::bucketUpperBound(lowest - 1) + 1 : 0);
+        delta.max = qMin(max, LatencyHistogram::bucketUpperBound(highest));
+    }
+    return delta;
+}
+
+LatencyHistogram::LatencyHistogram()
+    : count(0)
+    , sum(0)
+    , min(std::numeric_limits<qint64>::max())
+    , max(0)
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucketFor(qint64 nsecs)
+{
+    if (nsecs < SubBuckets) {
+        return nsecs < 0 ? 0 : static_cast<int>(nsecs);
+    }
+
+    const int exponent = highest_bit(static_cast<quint64>(nsecs));
+    if (exponent > MaxExponent) {
+        return BucketCount - 1;
+    }
+    const int sub = static_cast<int>((nsecs >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+    return (exponent - SubBucketBits + 1) * SubBuckets + sub;
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < SubBuckets) {
+        return bucket;
+    }
+
+    const int exponent = bucket / SubBuckets + SubBucketBits - 1;
+    const int sub = bucket % SubBuckets;
+    const qint64 width = qint64(1) << (exponent - SubBucketBits);
+    return (qint64(SubBuckets + sub) << (exponent - SubBucketBits)) + width - 1;
+}
+
+void LatencyHistogram::record(qint64 nsecs)
+{
+    buckets[bucketFor(nsecs)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nsecs, std::memory_order_relaxed);
+
+    qint64 low = min.load(std::memory_order_relaxed);
+    while (nsecs < low && !min.compare_exchange_weak(low, nsecs, std::memory_order_relaxed)) {
+    }
+    qint64 high = max.load(std::memory_order_relaxed);
+    while (nsecs > high && !max.compare_exchange_weak(high, nsecs, std::memory_order_relaxed)) {
+    }
+}
+
+HistogramSnapshot LatencyHistogram::snapshot(bool reset)
+{
+    HistogramSnapshot snap;
+    snap.buckets.resize(BucketCount);
+    for (int i = 0; i < BucketCount; ++i) {
+        snap.buckets[i] = reset ? buckets[i].exchange(0, std::memory_order_relaxed)
+                                : buckets[i].load(std::memory_order_relaxed);
+    }
+
+    if (reset) {
+        snap.count = count.exchange(0, std::memory_order_relaxed);
+        snap.sum = sum.exchange(0, std::memory_order_relaxed);
+        snap.min = min.exchange(std::numeric_limits<qint64>::max(), std::memory_order_relaxed);
+        snap.max = max.exchange(0, std::memory_order_relaxed);
+    } else {
+        snap.count = count.load(std::memory_order_relaxed);
+        snap.sum = sum.load(std::memory_order_relaxed);
+        snap.min = min.load(std::memory_order_relaxed);
+        snap.max = max.load(std::memory_order_relaxed);
+    }
+    if (snap.count == 0) {
+        snap.min = 0;
+    }
+    return snap;
+}
+
+Metrics::Metrics()
+    : intervalStart(now())
+{
+}
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+qint64 Metrics::now()
+{
+    return monotonic_clock().nsecsElapsed();
+}
+
+HistogramWindow::HistogramWindow(LatencyHistogram *histogram)
+    : histogram(histogram)
+    , takenCount(0)
+    , takenNsecs(0)
+{
+    if (histogram) {
+        quint64 count;
+        qint64 nsecs;
+        take(&count, &nsecs);
+    }
+}
+
+void HistogramWindow::take(quint64 *count, qint64 *nsecs)
+{
+    const HistogramSnapshot now = histogram->snapshot();
+    // Someone reset the histogram meanwhile (a soak interval).
+    if (now.count < takenCount) {
+        takenCount = 0;
+        takenNsecs = 0;
+    }
+    *count = now.count - takenCount;
+    *nsecs = now.sum - takenNsecs;
+    takenCount = now.count;
+    takenNsecs = now.sum;
+}
+
+LatencyHistogram *Metrics::histogram(const QString &name)
+{
+    QMutexLocker locker(&mutex);
+    LatencyHistogram *&histogram = histograms[name];
+    if (!histogram) {
+        histogram = new LatencyHistogram();
+    }
+    return histogram;
+}
+
+Counter *Metrics::counter(const QString &name)
+{
+    QMutexLocker locker(&mutex);
+    Counter *&counter = counters[name];
+    if (!counter) {
+        counter = new Counter();
+    }
+    return counter;
+}
+
+Gauge *Metrics::gauge(const QString &name)
+{
+    QMutexLocker locker(&mutex);
+    Gauge *&gauge = gauges[name];
+    if (!gauge) {
+        gauge = new Gauge();
+    }
+    return gauge;
+}
+
+MetricsSnapshot Metrics::snapshot(bool reset)
+{
+    MetricsSnapshot snap;
+    const qint64 end = now();
+    snap.intervalNsecs = end - (reset ? intervalStart.exchange(end) : intervalStart.load());
+
+    QMutexLocker locker(&mutex);
+    for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+        snap.counters.insert(it.key(), reset ? it.value()->take() : it.value()->get());
+    }
+    for (auto it = gauges.constBegin(); it != gauges.constEnd(); ++it) {
+        snap.gauges.insert(it.key(), it.value()->get());
+    }
+    for (auto it = histograms.constBegin(); it != histograms.constEnd(); ++it) {
+        snap.histograms.insert(it.key(), it.value()->snapshot(reset));
+    }
+    return snap;
+}
+
+QByteArray MetricsSnapshot::toJson() const
+{
+    QJsonObject counterObj;
+    for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+        counterObj[it.key()] = static_cast<double>(it.value());
+    }
+
+    QJsonObject gaugeObj;
+    for (auto it = gauges.constBegin(); it != gauges.constEnd(); ++it) {
+        gaugeObj[it.key()] = it.value();
+    }
+
+    QJsonObject histogramObj;
+    for (auto it = histograms.constBegin(); it != histograms.constEnd(); ++it) {
+        const HistogramSnapshot &h = it.value();
+        QJsonObject obj;
+        obj["count"] = static_cast<double>(h.count);
+        obj["min_ms"] = to_ms(h.min);
+        obj["mean_ms"] = h.mean() / 1e6;
+        obj["p50_ms"] = to_ms(h.percentile(50));
+        obj["p90_ms"] = to_ms(h.percentile(90));
+        obj["p99_ms"] = to_ms(h.percentile(99));
+        obj["p999_ms"] = to_ms(h.percentile(99.9));
+        obj["max_ms"] = to_ms(h.max);
+        histogramObj[it.key()] = obj;
+    }
+
+    QJsonObject root;
+    root["interval_s"] = intervalNsecs / 1e9;
+    root["counters"] = counterObj;
+    root["gauges"] = gaugeObj;
+    root["histograms"] = histogramObj;
+    return QJsonDocument(root).toJson();
+}
+
+QByteArray MetricsSnapshot::toCsv() const
+{
+    QStringList lines;
+    lines << "metric,type,count,min_ms,mean_ms,p50_ms,p90_ms,p99_ms,p999_ms,max_ms";
+
+    for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+        lines << QString("%1,counter,%2,,,,,,,").arg(it.key()).arg(it.value());
+    }
+    for (auto it = gauges.constBegin(); it != gauges.constEnd(); ++it) {
+        lines << QString("%1,gauge,%2,,,,,,,").arg(it.key()).arg(it.value());
+    }
+    for (auto it = histograms.constBegin(); it != histograms.constEnd(); ++it) {
+        const HistogramSnapshot &h = it.value();
+        QStringList row;
+        row << it.key() << "histogram" << QString::number(h.count);
+        row << QString::number(to_ms(h.min), 'f', 3)
+            << QString::number(h.mean() / 1e6, 'f', 3)
+            << QString::number(to_ms(h.percentile(50)), 'f', 3)
+            << QString::number(to_ms(h.percentile(90)), 'f', 3)
+            << QString::number(to_ms(h.percentile(99)), 'f', 3)
+            << QString::number(to_ms(h.percentile(99.9)), 'f', 3)
+            << QString::number(to_ms(h.max), 'f', 3);
+        lines << row.join(",");
+    }
+    return (lines.join("\n") + "\n").toUtf8();
+}
+
+QByteArray MetricsSnapshot::toPrometheus() const
+{
+    QByteArray text;
+
+    for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+        const QByteArray name = prometheus_name(it.key()) + "_total";
+        text += "# TYPE " + name + " counter\n";
+        text += name + " " + QByteArray::number(it.value()) + "\n";
+    }
+
+    for (auto it = gauges.constBegin(); it != gauges.constEnd(); ++it) {
+        const QByteArray name = prometheus_name(it.key());
+        text += "# TYPE " + name + " gauge\n";
+        text += name + " " + QByteArray::number(it.value(), 'g', 9) + "\n";
+    }
+
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    for (auto it = histograms.constBegin(); it != histograms.constEnd(); ++it) {
+        const HistogramSnapshot &h = it.value();
+        const QByteArray name = prometheus_name(it.key()) + "_seconds";
+        text += "# TYPE " + name + " summary\n";
+        for (double q : quantiles) {
+            text += name + "{quantile=\"" + QByteArray::number(q) + "\"} "
+                    + QByteArray::number(h.percentile(q * 100) / 1e9, 'g', 9) + "\n";
+        }
+        text += name + "_sum " + QByteArray::number(h.sum / 1e9, 'g', 12) + "\n";
+        text += name + "_count " + QByteArray::number(h.count) + "\n";
+    }
+
+    return text;
+}
+
+bool MetricsSnapshot::save(const QString &filename) const
+{
+    QFile file(filename);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        return false;
+    }
+    const QByteArray data = filename.endsWith(".csv") ? toCsv() : toJson();
+    return file.write(data) == data.size();
+}
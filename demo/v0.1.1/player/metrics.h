@@ -0,0 +1,156 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+// Counts of a LatencyHistogram at one point in time.
+struct HistogramSnapshot
+{
+    HistogramSnapshot() : count(0), sum(0), min(0), max(0) {}
+
+    // Nanoseconds. At most one bucket width (about 3%) above the true value.
+    qint64 percentile(double p) const;
+    double mean() const { return count > 0 ? double(sum) / count : 0; }
+    // What was recorded after earlier, a snapshot of the same histogram.
+    // min and max are then bounded by the buckets. All of this snapshot if
+    // the histogram was reset in between.
+    HistogramSnapshot since(const HistogramSnapshot &earlier) const;
+
+    QVector<quint64> buckets;
+    quint64 count;
+    qint64 sum;
+    qint64 min;
+    qint64 max;
+};
+
+// Log-linear (HDR style) histogram of durations in nanoseconds: 32 buckets
+// per power of two, so about 3% relative error from 1 ns up to ~18 minutes,
+// in a fixed 9 KB. Recording is a few relaxed atomic adds and never locks,
+// so any thread may record while another takes a snapshot.
+class LatencyHistogram
+{
+public:
+    enum { SubBucketBits = 5, SubBuckets = 1 << SubBucketBits, MaxExponent = 39,
+           BucketCount = (MaxExponent - SubBucketBits + 2) * SubBuckets };
+
+    LatencyHistogram();
+
+    void record(qint64 nsecs);
+    // Bucket counts are taken one at a time, so a snapshot taken while
+    // others record may be off by the frames in flight.
+    HistogramSnapshot snapshot(bool reset = false);
+
+    static int bucketFor(qint64 nsecs);
+    static qint64 bucketUpperBound(int bucket);
+
+private:
+    std::atomic<quint64> buckets[BucketCount];
+    std::atomic<quint64> count;
+    std::atomic<qint64> sum;
+    std::atomic<qint64> min;
+    std::atomic<qint64> max;
+};
+
+// The part of a histogram's totals recorded between calls of take(), for
+// stats kept per window while the histogram itself keeps running. Starts
+// from what the histogram holds when the window is made.
+class HistogramWindow
+{
+public:
+    explicit HistogramWindow(LatencyHistogram *histogram = 0);
+
+    void take(quint64 *count, qint64 *nsecs);
+
+private:
+    LatencyHistogram *histogram;
+    quint64 takenCount;
+    qint64 takenNsecs;
+};
+
+class Counter
+{
+public:
+    Counter() : value(0) {}
+
+    void add(quint64 n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 get() const { return value.load(std::memory_order_relaxed); }
+    quint64 take() { return value.exchange(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> value;
+};
+
+// A level rather than a total: queue depths, frame rate. Whoever owns the
+// value sets it; readers see the latest.
+class Gauge
+{
+public:
+    Gauge() : value(0) {}
+
+    void set(double v) { value.store(v, std::memory_order_relaxed); }
+    double get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> value;
+};
+
+struct MetricsSnapshot
+{
+    MetricsSnapshot() : intervalNsecs(0) {}
+
+    // Since the previous reset, or since start.
+    qint64 intervalNsecs;
+    QMap<QString, quint64> counters;
+    QMap<QString, double> gauges;
+    QMap<QString, HistogramSnapshot> histograms;
+
+    QByteArray toJson() const;
+    QByteArray toCsv() const;
+    // Prometheus text exposition format: counters as *_total, gauges as
+    // they are, histograms as summaries in seconds, all prefixed "va_".
+    QByteArray toPrometheus() const;
+    // CSV for *.csv, JSON otherwise.
+    bool save(const QString &filename) const;
+};
+
+// Process-wide named counters and histograms, shared by the player and the
+// command-line tools. Names are dotted: "stage.convert", "filter.NeonEdge",
+// "frames.dropped". Look a metric up once and keep the pointer; lookups
+// lock, recording does not.
+//
+// Frame counters: frames.in (accepted for processing), frames.out
+// (processed and handed on), frames.dropped (refused, or lost to a full
+// ring), frames.skipped (finished without a picture: failed or discarded).
+class Metrics
+{
+public:
+    static Metrics &instance();
+
+    // Monotonic nanoseconds, for timestamps that cross threads.
+    static qint64 now();
+
+    LatencyHistogram *histogram(const QString &name);
+    Counter *counter(const QString &name);
+    Gauge *gauge(const QString &name);
+
+    MetricsSnapshot snapshot(bool reset = false);
+
+private:
+    Metrics();
+    Q_DISABLE_COPY(Metrics)
+
+    QMutex mutex;
+    QMap<QString, LatencyHistogram*> histograms;
+    QMap<QString, Counter*> counters;
+    QMap<QString, Gauge*> gauges;
+    std::atomic<qint64> intervalStart;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,99 @@
+#include "metricsserver.h"
+#include "metrics.h"
+
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace {
+
+// Requests are a single GET line and a few headers; anything larger is not
+// a scraper.
+const int max_request_bytes = 8192;
+const int request_timeout_msecs = 5000;
+
+QByteArray response(const QByteArray &status, const QByteArray &contentType, const QByteArray &body)
+{
+    return "HTTP/1.0 " + status + "\r\n"
+           "Content-Type: " + contentType + "\r\n"
+           "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+           "Connection: close\r\n"
+           "\r\n" + body;
+}
+
+void serve(QTcpSocket *socket)
+{
+    const QByteArray request = socket->readAll();
+    const QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+    const QByteArray path = requestLine.size() > 1 ? requestLine[1] : QByteArray();
+    if (requestLine.value(0) != "GET") {
+        socket->write(response("405 Method Not Allowed", "text/plain", "GET only\n"));
+    } else if (path == "/metrics" || path == "/") {
+        socket->write(response("200 OK", "text/plain; version=0.0.4",
+                               Metrics::instance().snapshot().toPrometheus()));
+    } else {
+        socket->write(response("404 Not Found", "text/plain", "try /metrics\n"));
+    }
+    socket->disconnectFromHost();
+}
+
+}
+
+MetricsServer::MetricsServer(QObject *parent)
+    : QThread(parent)
+    , port(0)
+{
+    setObjectName("metrics server");
+}
+
+MetricsServer::~MetricsServer()
+{
+    quit();
+    wait();
+}
+
+bool MetricsServer::listen(quint16 port)
+{
+    if (isRunning()) {
+        return true;
+    }
+
+    this->port = port;
+    error.clear();
+    start();
+    ready.acquire();
+    return error.isEmpty();
+}
+
+void MetricsServer::run()
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, port)) {
+        error = server.errorString();
+        ready.release();
+        return;
+    }
+    ready.release();
+
+    QObject::connect(&server, &QTcpServer::newConnection, [&server]() {
+        while (QTcpSocket *socket = server.nextPendingConnection()) {
+            // The request may arrive in pieces; it is answered once the
+            // headers are complete. peek() leaves it buffered until then.
+            QObject::connect(socket, &QTcpSocket::readyRead, [socket]() {
+                if (socket->bytesAvailable() > max_request_bytes) {
+                    socket->abort();
+                    return;
+                }
+                const QByteArray pending = socket->peek(socket->bytesAvailable());
+                if (pending.contains("\r\n\r\n") || pending.contains("\n\n")) {
+                    serve(socket);
+                }
+            });
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            QTimer::singleShot(request_timeout_msecs, socket, SLOT(abort()));
+        }
+    });
+
+    exec();
+}
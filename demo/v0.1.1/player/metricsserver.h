@@ -0,0 +1,32 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QThread>
+#include <QSemaphore>
+#include <QString>
+
+// Serves Metrics::snapshot() over HTTP in Prometheus text format at
+// http://127.0.0.1:PORT/metrics, for a scraper on the same machine. It runs
+// its own event loop, so a scrape reads the atomics behind the metrics and
+// never waits on the GUI thread or the frame path.
+class MetricsServer : public QThread
+{
+public:
+    explicit MetricsServer(QObject *parent = 0);
+    ~MetricsServer();
+
+    // Binds to the loopback interface only. Returns false, with
+    // errorString() set, when the port cannot be used.
+    bool listen(quint16 port);
+    QString errorString() const { return error; }
+
+protected:
+    void run();
+
+private:
+    quint16 port;
+    QString error;
+    QSemaphore ready;
+};
+
+#endif // METRICSSERVER_H
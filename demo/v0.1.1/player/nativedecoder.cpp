@@ -0,0 +1,501 @@
+#include "nativedecoder.h"
+
+#ifdef HAVE_FFMPEG
+
+#include <QAbstractVideoBuffer>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+
+#include <cstring>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 59
+typedef const AVCodec DecoderCodec;
+#else
+typedef AVCodec DecoderCodec;
+#endif
+
+namespace {
+
+const int ioBufferSize = 256 * 1024;
+const AVRational microseconds = { 1, 1000000 };
+
+// Output buffers go back to the pool instead of being freed, so steady
+// state decoding allocates nothing per frame.
+class FramePool
+{
+public:
+    explicit FramePool(int bytes) : bytes(bytes) {}
+    ~FramePool()
+    {
+        foreach (uchar *buffer, idle) {
+            av_free(buffer);
+        }
+    }
+
+    uchar *acquire()
+    {
+        QMutexLocker locker(&mutex);
+        if (!idle.isEmpty()) {
+            return idle.takeLast();
+        }
+        return static_cast<uchar*>(av_malloc(bytes));
+    }
+
+    void release(uchar *buffer)
+    {
+        if (!buffer) {
+            return;
+        }
+        QMutexLocker locker(&mutex);
+        idle.append(buffer);
+    }
+
+    const int bytes;
+
+private:
+    QMutex mutex;
+    QList<uchar*> idle;
+};
+
+// Lives as long as the last QVideoFrame (and so the last FrameHandle and
+// view) referring to it.
+class PooledVideoBuffer : public QAbstractVideoBuffer
+{
+public:
+    PooledVideoBuffer(const QSharedPointer<FramePool> &pool, int bytesPerLine)
+        : QAbstractVideoBuffer(NoHandle)
+        , pool(pool)
+        , data(pool->acquire())
+        , bytesPerLine(bytesPerLine)
+        , mode(NotMapped)
+    {
+    }
+
+    ~PooledVideoBuffer()
+    {
+        pool->release(data);
+    }
+
+    MapMode mapMode() const { return mode; }
+
+    uchar *map(MapMode mapMode, int *numBytes, int *lineBytes)
+    {
+        mode = mapMode;
+        if (numBytes) {
+            *numBytes = pool->bytes;
+        }
+        if (lineBytes) {
+            *lineBytes = bytesPerLine;
+        }
+        return data;
+    }
+
+    void unmap() { mode = NotMapped; }
+
+    uchar *bits() const { return data; }
+
+private:
+    QSharedPointer<FramePool> pool;
+    uchar *data;
+    int bytesPerLine;
+    MapMode mode;
+};
+
+}
+
+struct NativeDecoderState
+{
+    NativeDecoderState()
+        : mapped(0), mappedSize(0), mappedPos(0), io(0), format(0), codec(0), stream(0)
+        , streamIndex(-1), frame(0), packet(0), scaler(0), width(0), height(0), bytesPerLine(0)
+        , draining(false), packetPending(false), skipUntil(-1)
+    {
+    }
+
+    ~NativeDecoderState()
+    {
+        sws_freeContext(scaler);
+        av_frame_free(&frame);
+        av_packet_free(&packet);
+        avcodec_free_context(&codec);
+        avformat_close_input(&format);
+        if (io) {
+            av_freep(&io->buffer);
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 80, 100)
+            avio_context_free(&io);
+#else
+            av_freep(&io);
+#endif
+        }
+        if (mapped) {
+            file.unmap(mapped);
+        }
+    }
+
+    QFile file;
+    uchar *mapped;
+    qint64 mappedSize;
+    qint64 mappedPos;
+
+    AVIOContext *io;
+    AVFormatContext *format;
+    AVCodecContext *codec;
+    AVStream *stream;
+    int streamIndex;
+    AVFrame *frame;
+    AVPacket *packet;
+    SwsContext *scaler;
+
+    QSharedPointer<FramePool> pool;
+    int width;
+    int height;
+    int bytesPerLine;
+
+    bool draining;
+    // packet was refused with EAGAIN and goes again once output is taken.
+    bool packetPending;
+    qint64 skipUntil;
+};
+
+namespace {
+
+int read_mapped(void *opaque, uint8_t *buffer, int size)
+{
+    NativeDecoderState *state = static_cast<NativeDecoderState*>(opaque);
+    const qint64 available = state->mappedSize - state->mappedPos;
+    if (available <= 0) {
+        return AVERROR_EOF;
+    }
+
+    const int count = static_cast<int>(qMin<qint64>(size, available));
+    memcpy(buffer, state->mapped + state->mappedPos, count);
+    state->mappedPos += count;
+    return count;
+}
+
+int64_t seek_mapped(void *opaque, int64_t offset, int whence)
+{
+    NativeDecoderState *state = static_cast<NativeDecoderState*>(opaque);
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return state->mappedSize;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += state->mappedPos;
+        break;
+    case SEEK_END:
+        offset += state->mappedSize;
+        break;
+    default:
+        return -1;
+    }
+    if (offset < 0 || offset > state->mappedSize) {
+        return -1;
+    }
+    state->mappedPos = offset;
+    return offset;
+}
+
+qint64 frame_timestamp(const NativeDecoderState *state)
+{
+    int64_t ts = state->frame->best_effort_timestamp;
+    if (ts == AV_NOPTS_VALUE) {
+        return -1;
+    }
+    if (state->stream->start_time != AV_NOPTS_VALUE) {
+        ts -= state->stream->start_time;
+    }
+    return av_rescale_q(ts, state->stream->time_base, microseconds);
+}
+
+}
+
+NativeDecoder::NativeDecoder(QObject *parent)
+    : FrameSource(parent)
+    , state(0)
+    , decodeThreads(0)
+    , memoryMapped(true)
+{
+}
+
+NativeDecoder::~NativeDecoder()
+{
+    close();
+}
+
+bool NativeDecoder::isAvailable()
+{
+    return true;
+}
+
+bool NativeDecoder::open(const QString &filename)
+{
+    close();
+
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+    av_register_all();
+#endif
+
+    NativeDecoderState *s = new NativeDecoderState;
+    const QByteArray path = QFile::encodeName(filename);
+
+    if (memoryMapped) {
+        s->file.setFileName(filename);
+        if (!s->file.open(QIODevice::ReadOnly)
+                || !(s->mapped = s->file.map(0, s->file.size()))) {
+            lastError = tr("Cannot map %1: %2").arg(filename, s->file.errorString());
+            delete s;
+            return false;
+        }
+        s->mappedSize = s->file.size();
+
+        uchar *ioBuffer = static_cast<uchar*>(av_malloc(ioBufferSize));
+        s->io = avio_alloc_context(ioBuffer, ioBufferSize, 0, s, read_mapped, 0, seek_mapped);
+        s->format = avformat_alloc_context();
+        s->format->pb = s->io;
+    }
+
+    if (avformat_open_input(&s->format, path.constData(), 0, 0) < 0
+            || avformat_find_stream_info(s->format, 0) < 0) {
+        lastError = tr("Cannot read %1").arg(filename);
+        delete s;
+        return false;
+    }
+
+    DecoderCodec *decoder = 0;
+    s->streamIndex = av_find_best_stream(s->format, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (s->streamIndex < 0 || !decoder) {
+        lastError = tr("No decodable video stream in %1").arg(filename);
+        delete s;
+        return false;
+    }
+    s->stream = s->format->streams[s->streamIndex];
+
+    s->codec = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(s->codec, s->stream->codecpar);
+    s->codec->thread_count = decodeThreads;
+    s->codec->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+    if (avcodec_open2(s->codec, decoder, 0) < 0) {
+        lastError = tr("Cannot open the %1 decoder").arg(decoder->name);
+        delete s;
+        return false;
+    }
+
+    s->frame = av_frame_alloc();
+    s->packet = av_packet_alloc();
+
+    state = s;
+    lastError.clear();
+    return true;
+}
+
+void NativeDecoder::close()
+{
+    stop();
+    delete state;
+    state = 0;
+}
+
+QSize NativeDecoder::frameSize() const
+{
+    return state ? QSize(state->codec->width, state->codec->height) : QSize();
+}
+
+double NativeDecoder::frameRate() const
+{
+    return state ? av_q2d(state->stream->avg_frame_rate) : 0;
+}
+
+qint64 NativeDecoder::duration() const
+{
+    if (!state || state->format->duration == AV_NOPTS_VALUE) {
+        return -1;
+    }
+    return state->format->duration / (AV_TIME_BASE / 1000);
+}
+
+FrameHandle NativeDecoder::nextFrame()
+{
+    NativeDecoderState *s = state;
+    if (!s) {
+        return FrameHandle();
+    }
+
+    for (;;) {
+        const int received = avcodec_receive_frame(s->codec, s->frame);
+
+        if (received == 0) {
+            const qint64 timestamp = frame_timestamp(s);
+
+            // Frames between the keyframe a seek landed on and the target.
+            if (s->skipUntil >= 0 && timestamp >= 0 && timestamp < s->skipUntil) {
+                av_frame_unref(s->frame);
+                continue;
+            }
+            s->skipUntil = -1;
+
+            if (s->frame->width != s->width || s->frame->height != s->height) {
+                s->width = s->frame->width;
+                s->height = s->frame->height;
+                s->bytesPerLine = FFALIGN(s->width * 4, 64);
+                s->pool.reset(new FramePool(s->bytesPerLine * s->height));
+            }
+
+            // BGRA in memory is what Qt calls ARGB32 on little-endian.
+            s->scaler = sws_getCachedContext(s->scaler, s->width, s->height, AVPixelFormat(s->frame->format),
+                                             s->width, s->height, AV_PIX_FMT_BGRA, SWS_BILINEAR, 0, 0, 0);
+            PooledVideoBuffer *buffer = new PooledVideoBuffer(s->pool, s->bytesPerLine);
+            if (!buffer->bits()) {
+                delete buffer;
+                av_frame_unref(s->frame);
+                fail(tr("Out of memory for a decoded frame"));
+                return FrameHandle();
+            }
+            uint8_t *planes[4] = { buffer->bits(), 0, 0, 0 };
+            int strides[4] = { s->bytesPerLine, 0, 0, 0 };
+            sws_scale(s->scaler, s->frame->data, s->frame->linesize, 0, s->height, planes, strides);
+            av_frame_unref(s->frame);
+
+            QVideoFrame video(buffer, QSize(s->width, s->height), QVideoFrame::Format_ARGB32);
+            video.setStartTime(timestamp);
+            return FrameHandle(video);
+        }
+
+        if (received == AVERROR_EOF) {
+            return FrameHandle();
+        }
+        if (received != AVERROR(EAGAIN)) {
+            fail(tr("Decoding failed"));
+            return FrameHandle();
+        }
+
+        // The decoder wants more input.
+        if (!s->packetPending) {
+            if (av_read_frame(s->format, s->packet) < 0) {
+                if (s->draining) {
+                    return FrameHandle();
+                }
+                const int sent = avcodec_send_packet(s->codec, 0);
+                if (sent < 0 && sent != AVERROR(EAGAIN) && sent != AVERROR_EOF) {
+                    fail(tr("Decoding failed"));
+                    return FrameHandle();
+                }
+                // On EAGAIN, take the output first and flush again.
+                s->draining = sent != AVERROR(EAGAIN);
+                continue;
+            }
+            if (s->packet->stream_index != s->streamIndex) {
+                av_packet_unref(s->packet);
+                continue;
+            }
+        }
+
+        const int sent = avcodec_send_packet(s->codec, s->packet);
+        s->packetPending = sent == AVERROR(EAGAIN);
+        if (s->packetPending) {
+            continue;
+        }
+        av_packet_unref(s->packet);
+        if (sent < 0) {
+            fail(tr("Decoding failed"));
+            return FrameHandle();
+        }
+    }
+}
+
+bool NativeDecoder::seekTo(qint64 position)
+{
+    NativeDecoderState *s = state;
+    if (!s) {
+        return false;
+    }
+
+    int64_t target = av_rescale_q(position * 1000, microseconds, s->stream->time_base);
+    if (s->stream->start_time != AV_NOPTS_VALUE) {
+        target += s->stream->start_time;
+    }
+    if (av_seek_frame(s->format, s->streamIndex, target, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+
+    avcodec_flush_buffers(s->codec);
+    av_packet_unref(s->packet);
+    s->packetPending = false;
+    s->draining = false;
+    s->skipUntil = position * 1000;
+    return true;
+}
+
+#else // HAVE_FFMPEG
+
+struct NativeDecoderState
+{
+};
+
+NativeDecoder::NativeDecoder(QObject *parent)
+    : FrameSource(parent)
+    , state(0)
+    , decodeThreads(0)
+    , memoryMapped(true)
+{
+}
+
+NativeDecoder::~NativeDecoder()
+{
+    close();
+}
+
+bool NativeDecoder::isAvailable()
+{
+    return false;
+}
+
+bool NativeDecoder::open(const QString &filename)
+{
+    Q_UNUSED(filename);
+    lastError = tr("Built without the native decoder (qmake CONFIG+=native_decoder)");
+    return false;
+}
+
+void NativeDecoder::close()
+{
+    stop();
+}
+
+QSize NativeDecoder::frameSize() const
+{
+    return QSize();
+}
+
+double NativeDecoder::frameRate() const
+{
+    return 0;
+}
+
+qint64 NativeDecoder::duration() const
+{
+    return -1;
+}
+
+FrameHandle NativeDecoder::nextFrame()
+{
+    return FrameHandle();
+}
+
+bool NativeDecoder::seekTo(qint64 position)
+{
+    Q_UNUSED(position);
+    return false;
+}
+
+#endif // HAVE_FFMPEG
@@ -0,0 +1,52 @@
+#ifndef NATIVEDECODER_H
+#define NATIVEDECODER_H
+
+#include <QSize>
+#include <QString>
+
+#include "framesource.h"
+
+struct NativeDecoderState;
+
+// Software decoder (FFmpeg) for workloads that want every frame as fast as
+// the CPU allows rather than playback through QMediaPlayer. The codec runs
+// with its own frame/slice threads and the file can be read through a
+// memory mapping. Frames come out as ARGB32, the format the QMediaPlayer
+// path normally negotiates, so nothing downstream can tell the difference.
+//
+// Only built with CONFIG += native_decoder; without it open() fails.
+class NativeDecoder : public FrameSource
+{
+    Q_OBJECT
+
+public:
+    explicit NativeDecoder(QObject *parent = 0);
+    ~NativeDecoder();
+
+    static bool isAvailable();
+
+    // 0 lets the codec use one thread per core. Both settings apply from
+    // the next open().
+    void setDecodeThreads(int threads) { decodeThreads = threads; }
+    void setMemoryMapped(bool enabled) { memoryMapped = enabled; }
+
+    bool open(const QString &filename);
+    void close();
+    QString errorString() const { return lastError; }
+
+    QSize frameSize() const;
+    double frameRate() const;
+    qint64 duration() const;
+
+protected:
+    FrameHandle nextFrame();
+    bool seekTo(qint64 position);
+
+private:
+    NativeDecoderState *state;
+    int decodeThreads;
+    bool memoryMapped;
+    QString lastError;
+};
+
+#endif // NATIVEDECODER_H
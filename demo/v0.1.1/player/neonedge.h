@@ -3,11 +3,14 @@
 
 #include <opencv/cv.hpp>
 
+#include "framearena.h"
+#include "cacheinfo.h"
+#include "taskscheduler.h"
+#include "tracing.h"
+
 using namespace std;
 using namespace cv;
 
-Mat lut(1, 256, CV_8UC3);
-
 Scalar get_rgb_from_hsv(int hue, int sat, int val, bool white_black = false) {
     Mat color_mat(1, 1, CV_8UC3, Scalar(hue, sat, val));
     Mat temp;
@@ -28,7 +31,7 @@ Scalar get_rgb_from_hsv(int hue, int sat, int val, bool white_black = false) {
     }
 }
 
-void calculate_lut(int intensity, Scalar color) {
+void calculate_lut(Mat& lut, int intensity, Scalar color) {
     Q_UNUSED(intensity);
     for ( int i = 0; i < 256; ++i) {
         float f = (i / 255.0f);
@@ -38,40 +41,195 @@ void calculate_lut(int intensity, Scalar color) {
     }
 }
 
-void calculate_sobel(Mat& gray, Mat& sobel, int scale, double weight,int bold) {
-    Mat sobel_x, sobel_y;
+void calculate_sobel(Mat& gray, Mat& sobel, int scale, double weight,int bold, FrameArena *arena = 0,
+                     int border = BORDER_DEFAULT) {
+    TRACE_SCOPE("sobel");
+    Mat sobel_x = arena_mat(arena), sobel_y = arena_mat(arena);
        // -----------
     // odvod po x
-    Sobel( gray, sobel_x, CV_16S, 1, 0, bold, scale, 11);
+    Sobel( gray, sobel_x, CV_16S, 1, 0, bold, scale, 11, border);
     convertScaleAbs(sobel_x, sobel_x);
     // -----------
     // odvod po y
-    Sobel( gray, sobel_y, CV_16S, 0, 1, bold, scale, 11);
+    Sobel( gray, sobel_y, CV_16S, 0, 1, bold, scale, 11, border);
     convertScaleAbs(sobel_y, sobel_y);
     addWeighted( sobel_x, weight, sobel_y, weight, 0, sobel );
 }
 
-Mat EdgeAugumentation(Mat& src,int kernel,int scale, double weight_d, int bold, int cut, int intensity) {
+Mat EdgeAugumentation(Mat& src, const Mat& lut, int kernel,int scale, double weight_d, int bold, int cut, int intensity,
+                      FrameArena *arena = 0) {
 
     // Matrix Initialisation
-    Mat  gray, sobel, edges, color_edges,dst;
-
-    cvtColor(src, gray, COLOR_BGR2GRAY );
-    GaussianBlur(gray, gray, Size(kernel, kernel), 0, 0, BORDER_DEFAULT);
-    calculate_sobel(gray, sobel, scale, weight_d,bold);
-    cv::threshold(sobel, sobel, cut, 255, THRESH_TOZERO);
-    //Sobel Type 2 bolj izraziti robovi
-    cvtColor(sobel, edges, COLOR_GRAY2BGR );
-    LUT(edges, lut, color_edges);
-    src.copyTo(edges, sobel);
-    src.setTo(Scalar(0, 0, 0), sobel);
-    addWeighted( edges, (intensity * 0.01), color_edges, (1 - (intensity * 0.01)), 0, edges );
-    add(src, edges, dst);
+    Mat  gray = arena_mat(arena), sobel = arena_mat(arena), edges = arena_mat(arena), color_edges = arena_mat(arena);
+    Mat  dst;
+
+    {
+        TRACE_SCOPE("blur");
+        cvtColor(src, gray, COLOR_BGR2GRAY );
+        GaussianBlur(gray, gray, Size(kernel, kernel), 0, 0, BORDER_DEFAULT);
+    }
+    calculate_sobel(gray, sobel, scale, weight_d,bold, arena);
+    {
+        TRACE_SCOPE("lut");
+        cv::threshold(sobel, sobel, cut, 255, THRESH_TOZERO);
+        //Sobel Type 2 bolj izraziti robovi
+        cvtColor(sobel, edges, COLOR_GRAY2BGR );
+        LUT(edges, lut, color_edges);
+    }
+    {
+        TRACE_SCOPE("merge");
+        src.copyTo(edges, sobel);
+        src.setTo(Scalar(0, 0, 0), sobel);
+        addWeighted( edges, (intensity * 0.01), color_edges, (1 - (intensity * 0.01)), 0, edges );
+        add(src, edges, dst);
+    }
 
     return dst;
 }
 
-cv::Mat NeonEdge(cv::Mat frame, int intensity=46, int kernel=9, int weight=32, int scale=4, int cut=100, int hue=42) {
+// Intermediate bytes per pixel of one EdgeAugumentation band: source and
+// result (3+3), gray, blurred, 16-bit and 8-bit Sobel pair, sobel (1+1+4+2+1),
+// edges, color_edges and the masked source (3+3+3).
+const int edgeStripBytesPerPixel = 24;
+
+// The temporaries of one band, reused from band to band.
+struct EdgeBandScratch
+{
+    Mat blurred, sobel, edges, color_edges, masked;
+};
+
+// Rows y0..y1 of EdgeAugumentation into dst. gray holds the gray rows from
+// top down, the band plus its blur/Sobel halo.
+void edge_band(const Mat& src, Mat& dst, const Mat& gray, int top, int y0, int y1, const Mat& lut, int kernel,
+               int scale, double weight_d, int bold, int cut, int intensity, EdgeBandScratch& scratch, FrameArena *arena) {
+
+    // Rows near the window edges come out wrong, but only halo rows are
+    // affected and they are dropped below. At the frame edges the window
+    // edge is the frame edge, so BORDER_ISOLATED matches the full frame.
+    const int border = BORDER_DEFAULT | BORDER_ISOLATED;
+    {
+        TRACE_SCOPE("blur");
+        GaussianBlur(gray, scratch.blurred, Size(kernel, kernel), 0, 0, border);
+    }
+    calculate_sobel(scratch.blurred, scratch.sobel, scale, weight_d, bold, arena, border);
+
+    Mat band = scratch.sobel.rowRange(y0 - top, y1 - top);
+    Mat srcBand = src.rowRange(y0, y1);
+    Mat dstBand = dst.rowRange(y0, y1);
+
+    {
+        TRACE_SCOPE("lut");
+        cv::threshold(band, band, cut, 255, THRESH_TOZERO);
+        cvtColor(band, scratch.edges, COLOR_GRAY2BGR );
+        LUT(scratch.edges, lut, scratch.color_edges);
+    }
+    TRACE_SCOPE("merge");
+    srcBand.copyTo(scratch.edges, band);
+    srcBand.copyTo(scratch.masked);
+    scratch.masked.setTo(Scalar(0, 0, 0), band);
+    addWeighted( scratch.edges, (intensity * 0.01), scratch.color_edges, (1 - (intensity * 0.01)), 0, scratch.edges );
+    add(scratch.masked, scratch.edges, dstBand);
+}
+
+// Same result as EdgeAugumentation, computed one band of rows at a time so a
+// band's intermediates stay in L2 instead of streaming the whole frame out to
+// DRAM between stages. The gray rows shared by neighbouring bands are kept
+// in a rolling line buffer; only the blur/Sobel halo rows are recomputed.
+// src is left untouched.
+Mat EdgeAugumentationStrips(Mat& src, const Mat& lut, int kernel,int scale, double weight_d, int bold, int cut, int intensity,
+                            int stripRows, FrameArena *arena = 0) {
+
+    const int halo = kernel / 2 + std::max(1, bold / 2);
+
+    Mat dst(src.size(), src.type());
+
+    Mat window = arena_mat(arena);
+    window.create(stripRows + 2 * halo, src.cols, CV_8U);
+    int windowTop = 0;
+    int windowRows = 0;
+
+    EdgeBandScratch scratch = { arena_mat(arena), arena_mat(arena), arena_mat(arena), arena_mat(arena),
+                                arena_mat(arena) };
+
+    for (int y0 = 0; y0 < src.rows; y0 += stripRows) {
+        TRACE_SCOPE("band");
+        const int y1 = std::min(src.rows, y0 + stripRows);
+        const int top = std::max(0, y0 - halo);
+        const int bottom = std::min(src.rows, y1 + halo);
+
+        // Slide the line buffer up to the new top and convert only the rows
+        // the previous band did not already have.
+        int kept = 0;
+        if (windowRows > 0 && top < windowTop + windowRows) {
+            const int shift = top - windowTop;
+            kept = windowRows - shift;
+            for (int r = 0; r < kept; ++r) {
+                memcpy(window.ptr(r), window.ptr(r + shift), window.cols);
+            }
+        }
+        if (kept < bottom - top) {
+            Mat fresh = window.rowRange(kept, bottom - top);
+            cvtColor(src.rowRange(top + kept, bottom), fresh, COLOR_BGR2GRAY);
+        }
+        windowTop = top;
+        windowRows = bottom - top;
+
+        edge_band(src, dst, window.rowRange(0, windowRows), top, y0, y1, lut, kernel, scale, weight_d, bold, cut,
+                  intensity, scratch, arena);
+    }
+
+    return dst;
+}
+
+// The bands of EdgeAugumentationStrips as independent tasks: each converts
+// its own gray rows, halo included, so there is no line buffer to share.
+// Temporaries come from the heap; the frame's arena is single-threaded.
+class EdgeBands : public ParallelLoopBody
+{
+public:
+    EdgeBands(const Mat& src, Mat& dst, const Mat& lut, int kernel, int scale, double weight_d, int bold, int cut,
+              int intensity, int stripRows)
+        : src(src), dst(dst), lut(lut), kernel(kernel), scale(scale), weight_d(weight_d), bold(bold), cut(cut)
+        , intensity(intensity), stripRows(stripRows), halo(kernel / 2 + std::max(1, bold / 2)) {}
+
+    void operator()(const Range& range) const {
+        EdgeBandScratch scratch;
+        Mat gray;
+        for (int i = range.start; i < range.end; ++i) {
+            TRACE_SCOPE("band");
+            const int y0 = i * stripRows;
+            const int y1 = std::min(src.rows, y0 + stripRows);
+            const int top = std::max(0, y0 - halo);
+            const int bottom = std::min(src.rows, y1 + halo);
+            cvtColor(src.rowRange(top, bottom), gray, COLOR_BGR2GRAY);
+            edge_band(src, dst, gray, top, y0, y1, lut, kernel, scale, weight_d, bold, cut, intensity, scratch, 0);
+        }
+    }
+
+private:
+    const Mat& src;
+    Mat& dst;
+    const Mat& lut;
+    int kernel, scale;
+    double weight_d;
+    int bold, cut, intensity, stripRows, halo;
+};
+
+// EdgeAugumentationStrips with the bands spread over pool, one task each.
+// TaskScheduler::parallelFor() submits stripe i with affinity i, so the
+// same rows of consecutive frames go to the same worker.
+Mat EdgeAugumentationBands(Mat& src, const Mat& lut, int kernel,int scale, double weight_d, int bold, int cut, int intensity,
+                           int stripRows, TaskScheduler *pool) {
+
+    Mat dst(src.size(), src.type());
+    const int bands = (src.rows + stripRows - 1) / stripRows;
+    pool->parallelFor(Range(0, bands), EdgeBands(src, dst, lut, kernel, scale, weight_d, bold, cut, intensity, stripRows),
+                      bands);
+    return dst;
+}
+
+cv::Mat NeonEdge(cv::Mat frame, int intensity=46, int kernel=9, int weight=32, int scale=4, int cut=100, int hue=42,
+                 FrameArena *arena = 0, bool lineBuffered = false, TaskScheduler *pool = 0) {
 
     double weight_d;
     int bold = 1;
@@ -80,14 +238,26 @@ cv::Mat NeonEdge(cv::Mat frame, int intensity=46, int kernel=9, int weight=32, i
     int val = 255;
 
     Scalar color;
+    Mat lut(1, 256, CV_8UC3);
 
     (kernel > 3 && kernel % 2 == 0) ? kernel++ : kernel < 3 ? kernel = 3 : kernel;
     (bold > 3 && bold % 2 == 0) ? bold++ : bold < 3 ? bold = 1 : bold;
     weight_d = weight * 0.05;
     color = get_rgb_from_hsv(hue, sat, val,true);
-    calculate_lut(intensity, color);
+    calculate_lut(lut, intensity, color);
+
+    if (lineBuffered) {
+        const int halo = kernel / 2 + std::max(1, bold / 2);
+        const int stripRows = strip_rows_for(frame.cols, edgeStripBytesPerPixel, 4 * halo);
+        if (stripRows < frame.rows && pool && pool->threadCount() > 1) {
+            return EdgeAugumentationBands(frame, lut, kernel, scale, weight_d, bold, cut, intensity, stripRows, pool);
+        }
+        if (stripRows < frame.rows) {
+            return EdgeAugumentationStrips(frame, lut, kernel, scale, weight_d, bold, cut, intensity, stripRows, arena);
+        }
+    }
 
-    return EdgeAugumentation(frame,  kernel, scale,  weight_d,  bold,  cut,  intensity);
+    return EdgeAugumentation(frame, lut, kernel, scale,  weight_d,  bold,  cut,  intensity, arena);
 }
 
 
@@ -0,0 +1,78 @@
+# Frame sources, conversion, scheduling and filters: everything below the
+# GUI, shared by the player and the command-line tools (bench, headless).
+
+INCLUDEPATH += $$PWD
+
+HEADERS   += $$PWD/sharpcontrast.h \
+    $$PWD/neonedge.h \
+    $$PWD/imageconvert.h \
+    $$PWD/filterstage.h \
+    $$PWD/reorderbuffer.h \
+    $$PWD/framescheduler.h \
+    $$PWD/spscqueue.h \
+    $$PWD/stagepipeline.h \
+    $$PWD/stagestats.h \
+    $$PWD/framering.h \
+    $$PWD/taskscheduler.h \
+    $$PWD/framearena.h \
+    $$PWD/cacheinfo.h \
+    $$PWD/framehandle.h \
+    $$PWD/conversioncost.h \
+    $$PWD/framesource.h \
+    $$PWD/nativedecoder.h \
+    $$PWD/framecorpus.h \
+    $$PWD/corpussource.h \
+    $$PWD/syntheticsource.h \
+    $$PWD/tracing.h \
+    $$PWD/metrics.h \
+    $$PWD/syncmonitor.h \
+    $$PWD/allocstats.h \
+    $$PWD/framecache.h \
+    $$PWD/filtermemo.h \
+    $$PWD/keyframeindex.h
+
+SOURCES   += $$PWD/filterstage.cpp \
+    $$PWD/framescheduler.cpp \
+    $$PWD/stagepipeline.cpp \
+    $$PWD/framering.cpp \
+    $$PWD/taskscheduler.cpp \
+    $$PWD/framearena.cpp \
+    $$PWD/framehandle.cpp \
+    $$PWD/conversioncost.cpp \
+    $$PWD/framesource.cpp \
+    $$PWD/nativedecoder.cpp \
+    $$PWD/framecorpus.cpp \
+    $$PWD/corpussource.cpp \
+    $$PWD/syntheticsource.cpp \
+    $$PWD/tracing.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/syncmonitor.cpp \
+    $$PWD/allocstats.cpp \
+    $$PWD/framecache.cpp \
+    $$PWD/filtermemo.cpp \
+    $$PWD/keyframeindex.cpp
+
+QT += multimedia
+CONFIG += c++11
+
+# In-process FFmpeg decoder (NativeDecoder): qmake CONFIG+=native_decoder
+native_decoder {
+    DEFINES += HAVE_FFMPEG
+    LIBS += -lavformat
+    LIBS += -lavcodec
+    LIBS += -lswscale
+    LIBS += -lavutil
+}
+
+# LZ4 for the processed-frame cache (FrameCache::setCompressed()):
+# qmake CONFIG+=lz4_cache
+lz4_cache {
+    DEFINES += HAVE_LZ4
+    LIBS += -llz4
+}
+
+# Count every heap allocation per stage, not only Mats (AllocStats):
+# qmake CONFIG+=count_allocations
+count_allocations {
+    DEFINES += COUNT_HEAP_ALLOCATIONS
+}
@@ -1,17 +1,21 @@
 TEMPLATE = app
 TARGET = player
 
-QT += multimedia multimediawidgets
+QT += multimedia multimediawidgets network
 
 HEADERS   += videoplayer.h \
-    videosurface.h \
-    sharpcontrast.h \
-    neonedge.h
+    benchmarkrun.h \
+    metricsserver.h \
+    videosurface.h
 
 SOURCES   += main.cpp \
              videoplayer.cpp \
+    benchmarkrun.cpp \
+    metricsserver.cpp \
     videosurface.cpp
 
+include(pipeline.pri)
+
 QT+=widgets
 
 CONFIG += c++11
@@ -20,6 +24,8 @@ INCLUDEPATH += /usr/local/include/opencv
 INCLUDEPATH += /usr/local/include/opencv2
 INCLUDEPATH += /usr/local/include
 
+# OpenCV 3: FrameArena implements its cv::MatAllocator interface, so the
+# 2.4-only modules (contrib, legacy, nonfree) are not linked.
 LIBS += -L/usr/local/lib
 LIBS += -L/usr/local/include
 LIBS += -lopencv_core
@@ -30,8 +36,4 @@ LIBS += -lopencv_video
 LIBS += -lopencv_features2d
 LIBS += -lopencv_calib3d
 LIBS += -lopencv_objdetect
-LIBS += -lopencv_contrib
-LIBS += -lopencv_legacy
 LIBS += -lopencv_flann
-LIBS += -lopencv_nonfree
-LIBS += -lopencv_legacy
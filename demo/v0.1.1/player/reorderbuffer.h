@@ -0,0 +1,52 @@
+#ifndef REORDERBUFFER_H
+#define REORDERBUFFER_H
+
+#include <QMap>
+
+// Holds results that finish out of order and hands them back in key order.
+// A slot is reserved when work is submitted; takeNext() only releases the
+// smallest reserved key, and only once it has completed. Not thread-safe.
+template <typename T>
+class ReorderBuffer
+{
+public:
+    bool contains(qint64 key) const { return entries.contains(key); }
+    int size() const { return entries.size(); }
+    bool isEmpty() const { return entries.isEmpty(); }
+
+    void reserve(qint64 key)
+    {
+        entries.insert(key, Slot());
+    }
+
+    void complete(qint64 key, const T &value)
+    {
+        typename QMap<qint64, Slot>::iterator it = entries.find(key);
+        if (it != entries.end()) {
+            it->ready = true;
+            it->value = value;
+        }
+    }
+
+    bool takeNext(qint64 *key, T *value)
+    {
+        if (entries.isEmpty() || !entries.first().ready) {
+            return false;
+        }
+        *key = entries.firstKey();
+        *value = entries.take(*key).value;
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        Slot() : ready(false) {}
+        bool ready;
+        T value;
+    };
+
+    QMap<qint64, Slot> entries;
+};
+
+#endif // REORDERBUFFER_H
@@ -11,12 +11,12 @@
 #include <cmath>
 #include <math.h>
 
+#include "framearena.h"
+#include "tracing.h"
+
 using namespace std;
 using namespace cv;
 
-Mat lutL(1, 256, CV_8U);
-Mat lutC(1, 256, CV_8U);
-
 void exponent_correction(Mat& src, float gamma) {
     // to se ne uporablja, ker sem implementiral z LUT
     for (int i = 0; i < src.rows; i++) {
@@ -31,12 +31,12 @@ void exponent_correction(Mat& src, float gamma) {
     }
 }
 
-Mat vibrance(Mat& src, float gamma) {
-    Q_UNUSED(gamma);
-    Mat dst, HSV;
+Mat vibrance(Mat& src, const Mat& lutC, FrameArena *arena = 0) {
+    TRACE_SCOPE("vibrance");
+    Mat dst = arena_mat(arena), HSV = arena_mat(arena);
     src.copyTo(dst);
 
-    vector<Mat> hsv_planes;
+    vector<Mat> hsv_planes(3, arena_mat(arena));
     cvtColor(src, HSV, COLOR_BGR2HSV);
     split(HSV, hsv_planes);
 
@@ -47,14 +47,14 @@ Mat vibrance(Mat& src, float gamma) {
     return dst;
 }
 
-void calculate_lutC(float gamma) {
+void calculate_lutC(Mat& lutC, float gamma) {
     uchar* p = lutC.ptr();
     for ( int i = 0; i < 256; ++i)
       //p[i] = saturate_cast<uchar>(pow((float)(i / 255.0), dGamma) * 255.0f); // originalna formula
         p[i] = saturate_cast<uchar>(pow((float)(i / 255.0f), 1/gamma) * 255.0f);  //sprememba namesta 1/gamma
 }
 
-void calculate_lutDark(float gamma) {
+void calculate_lutDark(Mat& lutL, float gamma) {
     uchar* p = lutL.ptr();
     for ( int i = 0; i < 256; ++i)
       //p[i] = saturate_cast<uchar>(pow((float)(i / 255.0), dGamma) * 255.0f); // originalna formula
@@ -62,7 +62,7 @@ void calculate_lutDark(float gamma) {
 
 }
 
-void calculate_lutLight(float gamma) {
+void calculate_lutLight(Mat& lutL, float gamma) {
     uchar* p = lutL.ptr();
     for ( int i = 0; i < 256; ++i)
       //p[i] = saturate_cast<uchar>(pow((float)(i / 255.0), dGamma) * 255.0f); // originalna formula
@@ -70,48 +70,64 @@ void calculate_lutLight(float gamma) {
       {p[i] = saturate_cast<uchar>(pow((float)(i / 255.0f), 1/gamma) * 255.0f);}  //Lighten image
 }
 
-Mat GammaVibrancePreprocessing(Mat& src,double gammal,double gammac,int DarkLight) {
+Mat GammaVibrancePreprocessing(Mat& src,double gammal,double gammac,int DarkLight, FrameArena *arena = 0) {
 
-    Mat tmp,dst;
+    Mat tmp = arena_mat(arena), dst;
+    Mat lutL(1, 256, CV_8U);
+    Mat lutC(1, 256, CV_8U);
 
-    calculate_lutC(gammac);
+    calculate_lutC(lutC, gammac);
 
     //Glede na tip slike izberi bodisi posvetlitev oz. potemnitev
-    if (DarkLight==0) {calculate_lutDark(gammal);}  //   gamma   Bio Inspired Image Darkening
-    if (DarkLight==1) {calculate_lutLight(gammal);} //   1/gamma Bio Inspired Image brightening
+    if (DarkLight==0) {calculate_lutDark(lutL, gammal);}  //   gamma   Bio Inspired Image Darkening
+    if (DarkLight==1) {calculate_lutLight(lutL, gammal);} //   1/gamma Bio Inspired Image brightening
 
-    LUT(src, lutL, tmp);
+    {
+        TRACE_SCOPE("gamma lut");
+        LUT(src, lutL, tmp);
+    }
 
     //Vibrance Bio Inspired Color Saturation
-    dst = vibrance(tmp, gammac);
+    dst = vibrance(tmp, lutC, arena);
 
     return dst;
 }
 
-Mat SharpnessPreprocessing(Mat& src,double sigma,double threshold,double amount,int cliplimit,int Contrast ) {
+Mat SharpnessPreprocessing(Mat& src,double sigma,double threshold,double amount,int cliplimit,int Contrast,
+                           FrameArena *arena = 0) {
 
-    Mat dst,tmp;
+    Mat dst,tmp = arena_mat(arena);
 
-    Mat lowContrastMask,sharpened,blurred;
-    GaussianBlur(src, blurred, Size(), sigma, sigma);
-    lowContrastMask = abs(src - blurred) < threshold;
-    sharpened = src*(1+amount) + blurred*(-(amount));
-    src.copyTo(sharpened, lowContrastMask);                    // CONDITIONAL COPY IMAGE
+    Mat lowContrastMask = arena_mat(arena), sharpened = arena_mat(arena), blurred = arena_mat(arena);
+    {
+        TRACE_SCOPE("unsharp");
+        GaussianBlur(src, blurred, Size(), sigma, sigma);
+        lowContrastMask = abs(src - blurred) < threshold;
+        sharpened = src*(1+amount) + blurred*(-(amount));
+        src.copyTo(sharpened, lowContrastMask);                    // CONDITIONAL COPY IMAGE
+    }
 
-    cv::Mat lab_image;
-    cv::cvtColor(sharpened, lab_image, cv::COLOR_BGR2Lab);
+    cv::Mat lab_image = arena_mat(arena);
+    std::vector<cv::Mat> lab_planes(3, arena_mat(arena));
+    {
+        TRACE_SCOPE("to lab");
+        cv::cvtColor(sharpened, lab_image, cv::COLOR_BGR2Lab);
 
-    // Extract the L channel
-    std::vector<cv::Mat> lab_planes(3);
-    cv::split(lab_image, lab_planes);  // now we have the L image in lab_planes[0]
+        // Extract the L channel
+        cv::split(lab_image, lab_planes);  // now we have the L image in lab_planes[0]
+    }
 
     // apply the CLAHE algorithm to the L channel
-    cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
-    clahe->setClipLimit(cliplimit);
-    clahe->setTilesGridSize(Size(Contrast,Contrast));
-    clahe->apply(lab_planes[0], tmp);
+    {
+        TRACE_SCOPE("clahe");
+        cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE();
+        clahe->setClipLimit(cliplimit);
+        clahe->setTilesGridSize(Size(Contrast,Contrast));
+        clahe->apply(lab_planes[0], tmp);
+    }
 
     // Merge the the color planes back into an Lab image
+    TRACE_SCOPE("merge");
     tmp.copyTo(lab_planes[0]);
     cv::merge(lab_planes, lab_image);
 
@@ -121,7 +137,8 @@ Mat SharpnessPreprocessing(Mat& src,double sigma,double threshold,double amount,
     return dst;
 }
 
-cv::Mat SharpContrast(cv::Mat frame, int DarkLight=0, int Intensity=5, int Vibrance=5, int Sharpness=1, int Contrast=1) {
+cv::Mat SharpContrast(cv::Mat frame, int DarkLight=0, int Intensity=5, int Vibrance=5, int Sharpness=1, int Contrast=1,
+                      FrameArena *arena = 0) {
 
     Mat final;
 
@@ -144,8 +161,8 @@ cv::Mat SharpContrast(cv::Mat frame, int DarkLight=0, int Intensity=5, int Vibra
     double threshold = sharpthreshold+sharpthreshold/10.f;
     double amount = sharpamount+sharpamount/10.f;
 
-    final = GammaVibrancePreprocessing(frame, gammal, gammac, DarkLight);
-    final = SharpnessPreprocessing(final, sigma,threshold,amount,cliplimit,Contrast);
+    final = GammaVibrancePreprocessing(frame, gammal, gammac, DarkLight, arena);
+    final = SharpnessPreprocessing(final, sigma,threshold,amount,cliplimit,Contrast, arena);
 
     return final;
 }
@@ -0,0 +1,78 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded single-producer/single-consumer ring. Neither push() nor pop()
+// blocks or locks: each side only ever writes its own index. The capacity
+// is rounded up to a power of two.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity)
+        : buffer(roundUp(capacity))
+        , mask(buffer.size() - 1)
+        , head(0)
+        , tail(0)
+    {
+    }
+
+    size_t capacity() const { return buffer.size(); }
+
+    // Safe to call from any thread; the answer may be stale by one element.
+    size_t size() const
+    {
+        const size_t h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
+    }
+
+    bool isEmpty() const { return size() == 0; }
+
+    bool push(const T &value)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == buffer.size()) {
+            return false;
+        }
+        buffer[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T *value)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == h) {
+            return false;
+        }
+        *value = buffer[h & mask];
+        // Drop the slot's reference now rather than when it is overwritten.
+        buffer[h & mask] = T();
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static size_t roundUp(size_t n)
+    {
+        size_t c = 1;
+        while (c < n) {
+            c <<= 1;
+        }
+        return c;
+    }
+
+    std::vector<T> buffer;
+    const size_t mask;
+
+    // Keep the two indices on separate cache lines so producer and consumer
+    // do not invalidate each other on every operation.
+    std::atomic<size_t> head;
+    char padding[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+};
+
+#endif // SPSCQUEUE_H
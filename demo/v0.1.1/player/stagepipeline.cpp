@@ -0,0 +1,297 @@
+#include "stagepipeline.h"
+#include "allocstats.h"
+#include "imageconvert.h"
+#include "metrics.h"
+#include "syncmonitor.h"
+#include "tracing.h"
+
+#include <QSemaphore>
+#include <QThread>
+
+#include <functional>
+
+class PipelineWorker : public QThread
+{
+public:
+    typedef std::function<void(PipelineFrame &)> Handler;
+
+    PipelineWorker(const QString &name, SpscQueue<PipelineFrame> *input,
+                   SpscQueue<PipelineFrame> *output, Handler handler)
+        : stageName(name)
+        , traceLabel(name.toUtf8())
+        , input(input)
+        , output(output)
+        , handler(handler)
+        , latency(Metrics::instance().histogram("stage." + name))
+        , activity(latency)
+        , stopping(false)
+    {
+        setObjectName(name);
+    }
+
+    QString name() const { return stageName; }
+
+    // The queues themselves never block; the semaphores only park a worker
+    // instead of spinning, idle on an empty input or stuck on a full output.
+    void wake() { pending.release(); }
+    // Whoever pops the output queue calls this after each pop.
+    void outputTaken() { room.release(); }
+
+    void stop()
+    {
+        stopping = true;
+        pending.release();
+        room.release();
+        wait();
+    }
+
+    // Since the previous call, from the stage's histogram.
+    void takeActivity(quint64 *frames, qint64 *busyNsecs) { activity.take(frames, busyNsecs); }
+
+    std::function<void()> onOutput;
+    std::function<void()> onInputTaken;
+
+protected:
+    void run()
+    {
+        while (!stopping) {
+            pending.acquire();
+
+            PipelineFrame frame;
+            if (!input->pop(&frame)) {
+                continue;
+            }
+            onInputTaken();
+
+            QElapsedTimer timer;
+            timer.start();
+            {
+                TRACE_SCOPE(traceLabel.constData());
+                ALLOC_SCOPE(traceLabel.constData());
+                handler(frame);
+            }
+            latency->record(timer.nsecsElapsed());
+
+            // A full output queue means a later stage is the bottleneck;
+            // back off rather than drop work that has already been done.
+            if (!output->push(frame)) {
+                TRACE_SCOPE("queue wait");
+                do {
+                    // Releases from pops while there was room say nothing
+                    // now; drop them, then look again before waiting.
+                    room.tryAcquire(room.available());
+                    if (output->push(frame)) {
+                        break;
+                    }
+                    if (stopping) {
+                        return;
+                    }
+                    room.acquire();
+                } while (!output->push(frame));
+            }
+            onOutput();
+        }
+    }
+
+private:
+    QString stageName;
+    QByteArray traceLabel;
+    SpscQueue<PipelineFrame> *input;
+    SpscQueue<PipelineFrame> *output;
+    Handler handler;
+    LatencyHistogram *latency;
+    HistogramWindow activity;
+    QSemaphore pending;
+    QSemaphore room;
+    std::atomic<bool> stopping;
+};
+
+static void runRole(PipelineFrame &frame, FilterStage::Role role)
+{
+    for (const FilterInvocation &step : frame.chain) {
+        if (step.stage->role() != role || frame.image.empty()) {
+            continue;
+        }
+        try {
+            frame.image = step.stage->process(frame.image, step.params, frame.arena);
+        } catch(cv::Exception &) {
+            frame.image = cv::Mat();
+        }
+    }
+}
+
+StagePipeline::StagePipeline(int queueDepth, QObject *parent)
+    : QObject(parent)
+    , inFlight(0)
+    , submitted(0)
+    , dropped(0)
+    , presentLatency(Metrics::instance().histogram("stage.present"))
+    , presentActivity(presentLatency)
+    , framesIn(Metrics::instance().counter("frames.in"))
+    , framesOut(Metrics::instance().counter("frames.out"))
+    , framesDropped(Metrics::instance().counter("frames.dropped"))
+    , framesSkipped(Metrics::instance().counter("frames.skipped"))
+{
+    for (int i = 0; i < 4; ++i) {
+        queues.append(new SpscQueue<PipelineFrame>(queueDepth));
+    }
+
+    workers.append(new PipelineWorker("convert", queues[0], queues[1], [](PipelineFrame &frame) {
+        SyncMonitor::instance().markProcessStart(frame.startTime);
+        frame.image = frame_to_mat(frame.source);
+        frame.source = FrameHandle();
+    }));
+    workers.append(new PipelineWorker("optics", queues[1], queues[2], [](PipelineFrame &frame) {
+        runRole(frame, FilterStage::Optics);
+    }));
+    workers.append(new PipelineWorker("method", queues[2], queues[3], [this](PipelineFrame &frame) {
+        runRole(frame, FilterStage::Method);
+        frame.output = mat_to_owned_qimage(frame.image);
+        frame.image = cv::Mat();
+        arenas.release(frame.arena);
+        frame.arena = 0;
+        SyncMonitor::instance().markProcessEnd(frame.startTime);
+    }));
+
+    for (int i = 0; i < workers.size(); ++i) {
+        PipelineWorker *next = i + 1 < workers.size() ? workers[i + 1] : 0;
+        PipelineWorker *previous = i > 0 ? workers[i - 1] : 0;
+        if (next) {
+            workers[i]->onOutput = [next]() { next->wake(); };
+        } else {
+            workers[i]->onOutput = [this]() { emit frameReady(); };
+        }
+        // submit() drops rather than waits, so nobody waits on the first queue.
+        if (previous) {
+            workers[i]->onInputTaken = [previous]() { previous->outputTaken(); };
+        } else {
+            workers[i]->onInputTaken = []() {};
+        }
+        workers[i]->start();
+    }
+
+    window.start();
+}
+
+StagePipeline::~StagePipeline()
+{
+    foreach (PipelineWorker *worker, workers) {
+        worker->stop();
+    }
+    qDeleteAll(workers);
+    qDeleteAll(queues);
+}
+
+bool StagePipeline::submit(const FrameHandle &frame, const FilterChain &chain)
+{
+    ++submitted;
+
+    PipelineFrame job;
+    job.source = frame;
+    job.chain = chain;
+    job.startTime = frame.startTime();
+    job.arena = arenas.acquire();
+
+    if (!queues[0]->push(job)) {
+        arenas.release(job.arena);
+        ++dropped;
+        framesDropped->add();
+        return false;
+    }
+    framesIn->add();
+    ++inFlight;
+    workers[0]->wake();
+    return true;
+}
+
+bool StagePipeline::takeFrame(QImage *frame, qint64 *startTime)
+{
+    PipelineFrame done;
+    while (queues.last()->pop(&done)) {
+        workers.last()->outputTaken();
+        --inFlight;
+        if (!done.output.isNull()) {
+            framesOut->add();
+            *frame = done.output;
+            *startTime = done.startTime;
+            return true;
+        }
+        framesSkipped->add();
+    }
+    return false;
+}
+
+bool StagePipeline::hasCapacity() const
+{
+    return queues.first()->size() < queues.first()->capacity();
+}
+
+void StagePipeline::reportPresented(qint64 nsecs)
+{
+    presentLatency->record(nsecs);
+}
+
+QList<StageStats> StagePipeline::queueStats() const
+{
+    QList<StageStats> stats;
+    for (int i = 0; i < queues.size(); ++i) {
+        StageStats stage;
+        stage.name = i < workers.size() ? workers[i]->name() : QString("present");
+        stage.queueDepth = static_cast<int>(queues[i]->size());
+        stage.queueCapacity = static_cast<int>(queues[i]->capacity());
+        stats.append(stage);
+    }
+    return stats;
+}
+
+QList<StageStats> StagePipeline::takeStats()
+{
+    const double elapsed = qMax<qint64>(1, window.nsecsElapsed());
+    window.restart();
+
+    QList<StageStats> stats;
+
+    StageStats decode;
+    decode.name = "decode";
+    decode.queueDepth = 0;
+    decode.queueCapacity = 0;
+    decode.occupancy = 0;
+    decode.frames = submitted.exchange(0);
+    decode.dropped = dropped.exchange(0);
+    stats.append(decode);
+
+    for (int i = 0; i < workers.size(); ++i) {
+        StageStats stage;
+        stage.name = workers[i]->name();
+        stage.queueDepth = static_cast<int>(queues[i]->size());
+        stage.queueCapacity = static_cast<int>(queues[i]->capacity());
+        workers[i]->takeActivity(&stage.frames, &stage.busyNsecs);
+        stage.occupancy = stage.busyNsecs / elapsed;
+        stage.dropped = 0;
+        stats.append(stage);
+    }
+
+    StageStats present;
+    present.name = "present";
+    present.queueDepth = static_cast<int>(queues.last()->size());
+    present.queueCapacity = static_cast<int>(queues.last()->capacity());
+    presentActivity.take(&present.frames, &present.busyNsecs);
+    present.occupancy = present.busyNsecs / elapsed;
+    present.dropped = 0;
+    stats.append(present);
+
+    return stats;
+}
+
+QString StagePipeline::bottleneck(const QList<StageStats> &stats)
+{
+    QString name;
+    double highest = -1;
+    foreach (const StageStats &stage, stats) {
+        if (stage.occupancy > highest) {
+            highest = stage.occupancy;
+            name = stage.name;
+        }
+    }
+    return name;
+}
@@ -0,0 +1,83 @@
+#ifndef STAGEPIPELINE_H
+#define STAGEPIPELINE_H
+
+#include <QObject>
+#include <QImage>
+#include <QList>
+#include <QElapsedTimer>
+
+#include <atomic>
+
+#include "filterstage.h"
+#include "framehandle.h"
+#include "metrics.h"
+#include "spscqueue.h"
+#include "stagestats.h"
+
+struct PipelineFrame
+{
+    PipelineFrame() : arena(0), startTime(-1) {}
+
+    FrameHandle source;
+    cv::Mat image;
+    QImage output;
+    FilterChain chain;
+    FrameArena *arena;
+    qint64 startTime;
+};
+
+class PipelineWorker;
+
+// Runs convert -> optics -> method each on its own thread, joined by
+// lock-free SPSC queues, so consecutive frames overlap across stages.
+// Decode happens upstream in the media backend and presentation on the GUI
+// thread, which drains the last queue after frameReady().
+class StagePipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    StagePipeline(int queueDepth = 4, QObject *parent = 0);
+    ~StagePipeline();
+
+    // Called from present(); returns false and drops the frame when the
+    // convert stage is still backed up.
+    bool submit(const FrameHandle &frame, const FilterChain &chain);
+
+    bool takeFrame(QImage *frame, qint64 *startTime);
+
+    // Whether submit() would take a frame now, and how many frames are
+    // between submit() and takeFrame().
+    bool hasCapacity() const;
+    int framesInFlight() const { return inFlight.load(); }
+    void reportPresented(qint64 nsecs);
+
+    // Depth and capacity of each stage's input queue, plus "present",
+    // without taking the counters takeStats() reports.
+    QList<StageStats> queueStats() const;
+
+    // Depth, capacity and busy fraction per stage since the previous call.
+    QList<StageStats> takeStats();
+    static QString bottleneck(const QList<StageStats> &stats);
+
+signals:
+    void frameReady();
+
+private:
+    QList<SpscQueue<PipelineFrame>*> queues;
+    QList<PipelineWorker*> workers;
+    FrameArenaPool arenas;
+
+    std::atomic<int> inFlight;
+    std::atomic<quint64> submitted;
+    std::atomic<quint64> dropped;
+    LatencyHistogram *presentLatency;
+    HistogramWindow presentActivity;
+    Counter *framesIn;
+    Counter *framesOut;
+    Counter *framesDropped;
+    Counter *framesSkipped;
+    QElapsedTimer window;
+};
+
+#endif // STAGEPIPELINE_H
@@ -0,0 +1,20 @@
+#ifndef STAGESTATS_H
+#define STAGESTATS_H
+
+#include <QString>
+
+// One stage's activity over a stats window.
+struct StageStats
+{
+    StageStats() : queueDepth(0), queueCapacity(0), occupancy(0), busyNsecs(0), frames(0), dropped(0) {}
+
+    QString name;
+    int queueDepth;
+    int queueCapacity;
+    double occupancy;
+    qint64 busyNsecs;
+    quint64 frames;
+    quint64 dropped;
+};
+
+#endif // STAGESTATS_H
@@ -0,0 +1,165 @@
+#include "syncmonitor.h"
+#include "metrics.h"
+
+namespace {
+
+// Frames that never reach the paint (dropped, skipped) would otherwise
+// pile up; a few seconds of video is plenty to match against.
+const int max_pending = 256;
+
+// Exponential smoothing over roughly the last 16 frames, as RFC 3550
+// does for jitter.
+qint64 smooth(qint64 average, qint64 sample)
+{
+    return average + (sample - average) / 16;
+}
+
+}
+
+SyncMonitor::SyncMonitor()
+    : thresholdUsecs(45000)
+    , lastPaint(-1)
+    , lastStartTime(-1)
+{
+}
+
+SyncMonitor &SyncMonitor::instance()
+{
+    static SyncMonitor monitor;
+    return monitor;
+}
+
+FrameStamps *SyncMonitor::stampsFor(qint64 startTime)
+{
+    if (!pending.contains(startTime) && pending.size() >= max_pending) {
+        pending.erase(pending.begin());
+    }
+    return &pending[startTime];
+}
+
+void SyncMonitor::markPresented(qint64 startTime)
+{
+    if (startTime < 0) {
+        return;
+    }
+    const qint64 now = Metrics::now();
+    QMutexLocker locker(&mutex);
+    stampsFor(startTime)->presented = now;
+}
+
+void SyncMonitor::markProcessStart(qint64 startTime)
+{
+    if (startTime < 0) {
+        return;
+    }
+    const qint64 now = Metrics::now();
+    QMutexLocker locker(&mutex);
+    stampsFor(startTime)->processStart = now;
+}
+
+void SyncMonitor::markProcessEnd(qint64 startTime)
+{
+    if (startTime < 0) {
+        return;
+    }
+    const qint64 now = Metrics::now();
+    QMutexLocker locker(&mutex);
+    stampsFor(startTime)->processEnd = now;
+}
+
+void SyncMonitor::markPainted(qint64 startTime, qint64 mediaPosition)
+{
+    if (startTime < 0) {
+        return;
+    }
+
+    static LatencyHistogram *total = Metrics::instance().histogram("sync.present_to_paint");
+    static LatencyHistogram *queued = Metrics::instance().histogram("sync.queued");
+    static LatencyHistogram *processing = Metrics::instance().histogram("sync.processing");
+    static LatencyHistogram *handoff = Metrics::instance().histogram("sync.handoff");
+    static LatencyHistogram *jitter = Metrics::instance().histogram("sync.jitter");
+    static LatencyHistogram *drift = Metrics::instance().histogram("sync.drift");
+    static Counter *alerts = Metrics::instance().counter("sync.drift_alerts");
+
+    const qint64 now = Metrics::now();
+    bool exceeded = false;
+    bool recovered = false;
+    qint64 driftMsecs = 0;
+    {
+        QMutexLocker locker(&mutex);
+        const FrameStamps stamps = pending.take(startTime);
+        // Earlier frames that never got here are not coming any more.
+        while (!pending.isEmpty() && pending.firstKey() < startTime) {
+            pending.erase(pending.begin());
+        }
+
+        if (stamps.presented >= 0) {
+            total->record(now - stamps.presented);
+            current.latencyUsecs = smooth(current.latencyUsecs, (now - stamps.presented) / 1000);
+            if (stamps.processStart >= 0) {
+                queued->record(stamps.processStart - stamps.presented);
+            }
+        }
+        if (stamps.processStart >= 0 && stamps.processEnd >= 0) {
+            processing->record(stamps.processEnd - stamps.processStart);
+        }
+        if (stamps.processEnd >= 0) {
+            handoff->record(now - stamps.processEnd);
+        }
+
+        // Paint spacing against timestamp spacing; only meaningful between
+        // consecutive frames of the same run.
+        if (lastPaint >= 0 && startTime > lastStartTime) {
+            const qint64 deviation = qAbs((now - lastPaint) / 1000 - (startTime - lastStartTime));
+            jitter->record(deviation * 1000);
+            current.jitterUsecs = smooth(current.jitterUsecs, deviation);
+        }
+        lastPaint = now;
+        lastStartTime = startTime;
+        ++current.frames;
+
+        if (mediaPosition >= 0) {
+            const qint64 sample = mediaPosition * 1000 - startTime;
+            drift->record(qAbs(sample) * 1000);
+            current.driftUsecs = current.frames == 1 ? sample : smooth(current.driftUsecs, sample);
+
+            const qint64 magnitude = qAbs(current.driftUsecs);
+            if (!current.alerting && magnitude > thresholdUsecs) {
+                current.alerting = true;
+                exceeded = true;
+                alerts->add();
+            } else if (current.alerting && magnitude < thresholdUsecs / 2) {
+                current.alerting = false;
+                recovered = true;
+            }
+            driftMsecs = current.driftUsecs / 1000;
+        }
+    }
+
+    if (exceeded) {
+        emit driftExceeded(driftMsecs);
+    } else if (recovered) {
+        emit driftRecovered(driftMsecs);
+    }
+}
+
+void SyncMonitor::setDriftThreshold(qint64 msecs)
+{
+    QMutexLocker locker(&mutex);
+    thresholdUsecs = qMax<qint64>(1, msecs) * 1000;
+}
+
+void SyncMonitor::reset()
+{
+    QMutexLocker locker(&mutex);
+    pending.clear();
+    current = SyncStats();
+    lastPaint = -1;
+    lastStartTime = -1;
+}
+
+SyncStats SyncMonitor::stats() const
+{
+    QMutexLocker locker(&mutex);
+    return current;
+}
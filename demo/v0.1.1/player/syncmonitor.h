@@ -0,0 +1,75 @@
+#ifndef SYNCMONITOR_H
+#define SYNCMONITOR_H
+
+#include <QObject>
+#include <QMap>
+#include <QMutex>
+
+struct FrameStamps
+{
+    FrameStamps() : presented(-1), processStart(-1), processEnd(-1) {}
+
+    // Metrics::now() nanoseconds; -1 when the frame skipped that step.
+    qint64 presented;
+    qint64 processStart;
+    qint64 processEnd;
+};
+
+struct SyncStats
+{
+    SyncStats() : frames(0), latencyUsecs(0), jitterUsecs(0), driftUsecs(0), alerting(false) {}
+
+    quint64 frames;
+    // Smoothed over the last few frames.
+    qint64 latencyUsecs;
+    qint64 jitterUsecs;
+    // Media position minus the painted frame's timestamp: positive means
+    // the picture is behind the clock the audio follows.
+    qint64 driftUsecs;
+    bool alerting;
+};
+
+// Follows each frame from VideoSurface::present() (or the frame source)
+// through processing to the paint, matched by QVideoFrame::startTime().
+// Stamps may come from any thread. Latencies go to the "sync.*" metrics;
+// drift against the media position is watched continuously and raises
+// driftExceeded() once when it passes the threshold, and driftRecovered()
+// once it is back under half of it.
+class SyncMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    static SyncMonitor &instance();
+
+    void markPresented(qint64 startTime);
+    void markProcessStart(qint64 startTime);
+    void markProcessEnd(qint64 startTime);
+    // mediaPosition in ms, or -1 when there is no clock to drift from
+    // (unpaced runs).
+    void markPainted(qint64 startTime, qint64 mediaPosition);
+
+    void setDriftThreshold(qint64 msecs);
+    // Forget frames in flight and the smoothed values, e.g. after a seek.
+    void reset();
+
+    SyncStats stats() const;
+
+signals:
+    void driftExceeded(qint64 driftMsecs);
+    void driftRecovered(qint64 driftMsecs);
+
+private:
+    SyncMonitor();
+
+    FrameStamps *stampsFor(qint64 startTime);
+
+    mutable QMutex mutex;
+    QMap<qint64, FrameStamps> pending;
+    SyncStats current;
+    qint64 thresholdUsecs;
+    qint64 lastPaint;
+    qint64 lastStartTime;
+};
+
+#endif // SYNCMONITOR_H
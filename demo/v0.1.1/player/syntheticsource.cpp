@@ -0,0 +1,362 @@
+#include "syntheticsource.h"
+#include "conversioncost.h"
+
+#include <QAbstractVideoBuffer>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+
+#include <algorithm>
+#include <cstring>
+
+// Frame buffers are recycled, so generating 8K frames does not turn into
+// an allocator benchmark.
+class SyntheticBufferPool
+{
+public:
+    explicit SyntheticBufferPool(size_t bytes) : bytes(bytes) {}
+    ~SyntheticBufferPool()
+    {
+        foreach (uchar *buffer, idle) {
+            cv::fastFree(buffer);
+        }
+    }
+
+    uchar *acquire()
+    {
+        QMutexLocker locker(&mutex);
+        if (!idle.isEmpty()) {
+            return idle.takeLast();
+        }
+        return static_cast<uchar*>(cv::fastMalloc(bytes));
+    }
+
+    void release(uchar *buffer)
+    {
+        QMutexLocker locker(&mutex);
+        idle.append(buffer);
+    }
+
+    const size_t bytes;
+
+private:
+    QMutex mutex;
+    QList<uchar*> idle;
+};
+
+namespace {
+
+class SyntheticVideoBuffer : public QAbstractVideoBuffer
+{
+public:
+    SyntheticVideoBuffer(const QSharedPointer<SyntheticBufferPool> &pool, int bytesPerLine)
+        : QAbstractVideoBuffer(NoHandle)
+        , pool(pool)
+        , data(pool->acquire())
+        , bytesPerLine(bytesPerLine)
+        , mode(NotMapped)
+    {
+    }
+
+    ~SyntheticVideoBuffer()
+    {
+        pool->release(data);
+    }
+
+    MapMode mapMode() const { return mode; }
+
+    uchar *map(MapMode mapMode, int *numBytes, int *lineBytes)
+    {
+        mode = mapMode;
+        if (numBytes) {
+            *numBytes = static_cast<int>(pool->bytes);
+        }
+        if (lineBytes) {
+            *lineBytes = bytesPerLine;
+        }
+        return data;
+    }
+
+    void unmap() { mode = NotMapped; }
+
+    uchar *bits() const { return data; }
+
+private:
+    QSharedPointer<SyntheticBufferPool> pool;
+    uchar *data;
+    int bytesPerLine;
+    MapMode mode;
+};
+
+// cvtColor code from the BGR scene to the frame's memory layout.
+int scene_conversion(QVideoFrame::PixelFormat format)
+{
+    switch (format) {
+    case QVideoFrame::Format_ARGB32:
+    case QVideoFrame::Format_ARGB32_Premultiplied:
+    case QVideoFrame::Format_RGB32:
+        return cv::COLOR_BGR2BGRA;
+    case QVideoFrame::Format_RGB24:
+        return cv::COLOR_BGR2RGB;
+    case QVideoFrame::Format_RGB565:
+        return cv::COLOR_BGR2BGR565;
+    case QVideoFrame::Format_RGB555:
+        return cv::COLOR_BGR2BGR555;
+    case QVideoFrame::Format_Y8:
+        return cv::COLOR_BGR2GRAY;
+    default:
+        return -1;
+    }
+}
+
+// Bounces between 0 and range.
+int bounce(qint64 position, int range)
+{
+    if (range <= 0) {
+        return 0;
+    }
+    const int p = static_cast<int>(position % (2 * range));
+    return p > range ? 2 * range - p : p;
+}
+
+}
+
+SyntheticSource::SyntheticSource(QObject *parent)
+    : FrameSource(parent)
+    , size(1920, 1080)
+    , pixelFormat(QVideoFrame::Format_ARGB32)
+    , frameRate(30)
+    , pattern(Gradient)
+    , frameCount(-1)
+    , prepared(false)
+    , next(0)
+    , bytesPerLine(0)
+    , conversion(-1)
+    , sceneIndex(0)
+{
+}
+
+SyntheticSource::~SyntheticSource()
+{
+    stop();
+}
+
+bool SyntheticSource::isSupported(QVideoFrame::PixelFormat format)
+{
+    return scene_conversion(format) >= 0;
+}
+
+bool SyntheticSource::patternFromName(const QString &name, Pattern *pattern)
+{
+    static const struct { const char *name; Pattern pattern; } names[] = {
+        { "gradient", Gradient },
+        { "noise", Noise },
+        { "text", Text },
+        { "static", Static },
+        { "cuts", SceneCuts },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (name == names[i].name) {
+            *pattern = names[i].pattern;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SyntheticSource::configure(const QString &spec)
+{
+    const QStringList parts = spec.split(':');
+    const QStringList sizeAndRate = parts[0].split('@');
+    const QStringList dims = sizeAndRate[0].split('x');
+
+    const QSize parsed = dims.size() == 2 ? QSize(dims[0].toInt(), dims[1].toInt()) : QSize();
+    if (parsed.width() < 16 || parsed.height() < 16) {
+        lastError = QString("synthetic: bad frame size in \"%1\"").arg(spec);
+        return false;
+    }
+
+    double fps = 30;
+    if (sizeAndRate.size() > 1) {
+        fps = sizeAndRate[1].toDouble();
+        if (fps <= 0) {
+            lastError = QString("synthetic: bad frame rate in \"%1\"").arg(spec);
+            return false;
+        }
+    }
+
+    // The optional fields are told apart by what they parse as.
+    Pattern newPattern = Gradient;
+    QVideoFrame::PixelFormat format = QVideoFrame::Format_ARGB32;
+    int count = -1;
+    for (int i = 1; i < parts.size(); ++i) {
+        bool isNumber = false;
+        const int number = parts[i].toInt(&isNumber);
+        const QVideoFrame::PixelFormat named = ConversionCostTable::formatFromName(parts[i]);
+        if (isNumber) {
+            count = number;
+        } else if (patternFromName(parts[i], &newPattern)) {
+            continue;
+        } else if (named != QVideoFrame::Format_Invalid && isSupported(named)) {
+            format = named;
+        } else {
+            lastError = QString("synthetic: unknown pattern or unsupported format \"%1\"").arg(parts[i]);
+            return false;
+        }
+    }
+
+    setFrameSize(parsed);
+    setFrameRate(fps);
+    setPattern(newPattern);
+    setPixelFormat(format);
+    setFrameCount(count);
+    lastError.clear();
+    return true;
+}
+
+qint64 SyntheticSource::duration() const
+{
+    return frameCount < 0 ? -1 : static_cast<qint64>(frameCount * 1000 / frameRate);
+}
+
+bool SyntheticSource::seekTo(qint64 position)
+{
+    next = static_cast<qint64>(position * frameRate / 1000);
+    return frameCount < 0 || next < frameCount;
+}
+
+void SyntheticSource::prepare()
+{
+    const int width = size.width();
+    const int height = size.height();
+
+    conversion = scene_conversion(pixelFormat);
+    bytesPerLine = (width * CV_ELEM_SIZE(pixel_format_mat_type(pixelFormat)) + 3) & ~3;
+    pool.reset(new SyntheticBufferPool(static_cast<size_t>(bytesPerLine) * height));
+    scene.create(height, width, CV_8UC3);
+
+    // Fixed seed: every run generates the same frames.
+    cv::RNG rng(0x5eed);
+
+    switch (pattern) {
+    case Gradient:
+        // One ramp row, copied into each frame row at a moving offset.
+        texture.create(1, width + 256, CV_8UC3);
+        for (int x = 0; x < texture.cols; ++x) {
+            texture.at<cv::Vec3b>(0, x) = cv::Vec3b(x & 255, (x * 2) & 255, 255 - (x & 255));
+        }
+        break;
+    case Noise:
+        texture.create(height, width, CV_8UC3);
+        rng.fill(texture, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+        break;
+    case Text:
+        texture.release();
+        break;
+    case Static:
+    case SceneCuts:
+        texture.create(height, width, CV_8UC3);
+        rng.fill(texture, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+        cv::GaussianBlur(texture, texture, cv::Size(0, 0), std::max(2.0, width / 400.0));
+        background = texture.clone();
+        background.copyTo(scene);
+        box = cv::Rect();
+        sceneIndex = 0;
+        break;
+    }
+
+    prepared = true;
+}
+
+void SyntheticSource::moveBox(qint64 index)
+{
+    // Restore what the box covered last frame; the rest of the scene is
+    // untouched, so consecutive frames differ in two small regions only.
+    if (box.area() > 0) {
+        background(box).copyTo(scene(box));
+    }
+
+    const int boxWidth = std::max(8, scene.cols / 12);
+    const int boxHeight = std::max(8, scene.rows / 12);
+    box = cv::Rect(bounce(index * 5, scene.cols - boxWidth), bounce(index * 3, scene.rows - boxHeight),
+                   boxWidth, boxHeight);
+
+    scene(box).setTo(cv::Scalar(40, 200, 255));
+    cv::rectangle(scene, box, cv::Scalar::all(0), std::max(1, boxWidth / 32));
+}
+
+void SyntheticSource::render(qint64 index)
+{
+    switch (pattern) {
+    case Gradient: {
+        const int phase = static_cast<int>((index * 4) & 255);
+        for (int y = 0; y < scene.rows; ++y) {
+            const int offset = (phase + y / 2) & 255;
+            memcpy(scene.ptr(y), texture.ptr(0) + offset * 3, scene.cols * 3);
+        }
+        break;
+    }
+    case Noise: {
+        const int shift = static_cast<int>((index * 7) % scene.rows);
+        for (int y = 0; y < scene.rows; ++y) {
+            memcpy(scene.ptr(y), texture.ptr((y + shift) % scene.rows), scene.cols * 3);
+        }
+        break;
+    }
+    case Text: {
+        scene.setTo(cv::Scalar::all(24));
+        const double fontScale = std::max(0.5, scene.rows / 720.0);
+        const int thickness = std::max(1, cvRound(fontScale));
+        const int lineHeight = cvRound(30 * fontScale);
+        const int scroll = static_cast<int>((index * 3) % lineHeight);
+        int line = 0;
+        for (int y = lineHeight - scroll; y < scene.rows + lineHeight; y += lineHeight, ++line) {
+            const std::string text = cv::format("%08lld  the quick brown fox jumps over the lazy dog 0123456789",
+                                                static_cast<long long>(index + line));
+            cv::putText(scene, text, cv::Point(8, y), cv::FONT_HERSHEY_SIMPLEX, fontScale,
+                        cv::Scalar::all(220), thickness);
+        }
+        break;
+    }
+    case SceneCuts: {
+        // Normal, dark and flat, bright and flat, harsh.
+        static const double looks[][2] = { { 1.0, 0 }, { 0.25, 16 }, { 0.3, 170 }, { 1.8, -90 } };
+        const int cut = static_cast<int>(index / std::max(1, cvRound(frameRate)));
+        if (cut != sceneIndex) {
+            const double *look = looks[cut % 4];
+            texture.convertTo(background, -1, look[0], look[1]);
+            background.copyTo(scene);
+            box = cv::Rect();
+            sceneIndex = cut;
+        }
+        moveBox(index);
+        break;
+    }
+    case Static:
+        moveBox(index);
+        break;
+    }
+}
+
+FrameHandle SyntheticSource::nextFrame()
+{
+    if (frameCount >= 0 && next >= frameCount) {
+        return FrameHandle();
+    }
+    if (!prepared) {
+        prepare();
+    }
+
+    render(next);
+
+    SyntheticVideoBuffer *buffer = new SyntheticVideoBuffer(pool, bytesPerLine);
+    cv::Mat pixels(size.height(), size.width(), pixel_format_mat_type(pixelFormat),
+                   buffer->bits(), bytesPerLine);
+    cv::cvtColor(scene, pixels, conversion);
+
+    QVideoFrame frame(buffer, size, pixelFormat);
+    frame.setStartTime(static_cast<qint64>(next * 1e6 / frameRate));
+    frame.setEndTime(static_cast<qint64>((next + 1) * 1e6 / frameRate));
+    ++next;
+    return FrameHandle(frame);
+}
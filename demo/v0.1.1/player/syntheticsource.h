@@ -0,0 +1,83 @@
+#ifndef SYNTHETICSOURCE_H
+#define SYNTHETICSOURCE_H
+
+#include <QSharedPointer>
+#include <QSize>
+#include <QVideoFrame>
+
+#include <opencv/cv.hpp>
+
+#include "framesource.h"
+
+class SyntheticBufferPool;
+
+// Generates frames instead of decoding them, for load tests at sizes and
+// rates no test clip has (4K120, 8K30). Paced, frames arrive at the
+// configured rate like playback; unpaced, as fast as they are taken.
+//
+// Each pattern is aimed at something in the pipeline:
+//   gradient  moving smooth ramps, few edges
+//   noise     shifting noise, an edge on every pixel
+//   text      scrolling lines of text, dense hard edges
+//   static    a fixed picture with one small moving box (temporal skipping)
+//   cuts      static, but the scene changes brightness and contrast every
+//             second, including low-contrast ones (CLAHE)
+class SyntheticSource : public FrameSource
+{
+    Q_OBJECT
+
+public:
+    enum Pattern { Gradient, Noise, Text, Static, SceneCuts };
+
+    explicit SyntheticSource(QObject *parent = 0);
+    ~SyntheticSource();
+
+    // Settings take effect from the next start(); change them while stopped.
+    void setFrameSize(const QSize &value) { size = value; prepared = false; }
+    void setPixelFormat(QVideoFrame::PixelFormat format) { pixelFormat = format; prepared = false; }
+    void setFrameRate(double fps) { frameRate = fps > 0 ? fps : 30; }
+    void setPattern(Pattern value) { pattern = value; prepared = false; }
+    // -1 generates until stopped.
+    void setFrameCount(int count) { frameCount = count; }
+
+    // "WxH[@FPS][:pattern][:format][:frames]", the optional fields in any
+    // order, e.g. "3840x2160@120:noise" or "7680x4320@30:cuts:RGB24:300".
+    bool configure(const QString &spec);
+    QString errorString() const { return lastError; }
+
+    static bool isSupported(QVideoFrame::PixelFormat format);
+    static bool patternFromName(const QString &name, Pattern *pattern);
+
+    QSize frameSize() const { return size; }
+    qint64 duration() const;
+
+protected:
+    FrameHandle nextFrame();
+    bool seekTo(qint64 position);
+
+private:
+    void prepare();
+    void render(qint64 index);
+    void moveBox(qint64 index);
+
+    QSize size;
+    QVideoFrame::PixelFormat pixelFormat;
+    double frameRate;
+    Pattern pattern;
+    int frameCount;
+    QString lastError;
+
+    // Source thread only.
+    bool prepared;
+    qint64 next;
+    int bytesPerLine;
+    int conversion;
+    QSharedPointer<SyntheticBufferPool> pool;
+    cv::Mat scene;
+    cv::Mat texture;
+    cv::Mat background;
+    cv::Rect box;
+    int sceneIndex;
+};
+
+#endif // SYNTHETICSOURCE_H
@@ -0,0 +1,326 @@
+#include "taskscheduler.h"
+
+#include <QSemaphore>
+#include <QThread>
+
+#include <exception>
+#include <memory>
+#include <vector>
+
+class SchedulerThread : public QThread
+{
+public:
+    SchedulerThread(TaskScheduler *scheduler, int index)
+        : scheduler(scheduler)
+        , index(index)
+    {
+        setObjectName(QString("worker %1").arg(index));
+    }
+
+protected:
+    void run() { scheduler->workerLoop(index); }
+
+private:
+    TaskScheduler *scheduler;
+    int index;
+};
+
+static thread_local const TaskScheduler *currentScheduler = 0;
+static thread_local int currentWorkerIndex = -1;
+
+namespace {
+
+// One parallelFor() call. Each stripe runs once, on whichever of its task
+// and the caller claims it first; tasks that find theirs taken return, so
+// the state outlives the call.
+struct ParallelLoop
+{
+    ParallelLoop(const cv::ParallelLoopBody &body, int stripes)
+        : body(body)
+        , claimed(stripes)
+        , remaining(stripes)
+    {
+    }
+
+    void run(const cv::Range &part, int stripe)
+    {
+        if (claimed[stripe].exchange(true)) {
+            return;
+        }
+        try {
+            body(part);
+        } catch(...) {
+            QMutexLocker locker(&failureMutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+        if (--remaining == 0) {
+            done.release();
+        }
+    }
+
+    const cv::ParallelLoopBody &body;
+    std::vector<std::atomic<bool> > claimed;
+    std::atomic<int> remaining;
+    QSemaphore done;
+    QMutex failureMutex;
+    std::exception_ptr failure;
+};
+
+}
+
+TaskScheduler::TaskScheduler(int threads)
+    : pending(0)
+    , running(0)
+    , stopping(false)
+    , submitted(0)
+{
+    // With our own pool in charge, OpenCV's would only compete for the same
+    // cores; its kernels now run single-threaded inside our tasks, and the
+    // filters split their own work with parallelFor().
+    cv::setNumThreads(0);
+    start(threads);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    waitForDone();
+    stop();
+}
+
+void TaskScheduler::setThreadCount(int threads)
+{
+    waitForDone();
+    stop();
+    start(threads);
+}
+
+int TaskScheduler::threadCount() const
+{
+    return workers.size();
+}
+
+void TaskScheduler::start(int threads)
+{
+    if (threads <= 0) {
+        threads = QThread::idealThreadCount();
+    }
+
+    stopping = false;
+    for (int i = 0; i < threads; ++i) {
+        workers.append(new Worker());
+    }
+    for (int i = 0; i < threads; ++i) {
+        workers[i]->thread = new SchedulerThread(this, i);
+        workers[i]->thread->start();
+    }
+}
+
+void TaskScheduler::stop()
+{
+    {
+        QMutexLocker locker(&sleepMutex);
+        stopping = true;
+        wakeup.wakeAll();
+    }
+    foreach (Worker *worker, workers) {
+        worker->thread->wait();
+        delete worker->thread;
+    }
+    qDeleteAll(workers);
+    workers.clear();
+}
+
+int TaskScheduler::currentWorker() const
+{
+    return currentScheduler == this ? currentWorkerIndex : -1;
+}
+
+void TaskScheduler::submit(const Task &task, int affinity)
+{
+    const int target = affinity >= 0 ? affinity % workers.size() : currentWorker();
+
+    // Count the task before it becomes visible so pending never reads low.
+    ++submitted;
+    ++pending;
+
+    if (target >= 0) {
+        QMutexLocker locker(&workers[target]->mutex);
+        workers[target]->tasks.push_back(task);
+    } else {
+        QMutexLocker locker(&sharedMutex);
+        shared.push_back(task);
+    }
+
+    QMutexLocker locker(&sleepMutex);
+    wakeup.wakeOne();
+}
+
+void TaskScheduler::parallelFor(const cv::Range &range, const cv::ParallelLoopBody &body, int stripes)
+{
+    const int length = range.end - range.start;
+    if (length <= 0) {
+        return;
+    }
+
+    if (stripes <= 0) {
+        stripes = workers.size();
+    }
+    stripes = qMin(stripes, length);
+
+    std::shared_ptr<ParallelLoop> loop(new ParallelLoop(body, stripes));
+    std::vector<cv::Range> parts;
+    for (int i = 0; i < stripes; ++i) {
+        parts.push_back(cv::Range(range.start + static_cast<int>(qint64(length) * i / stripes),
+                                  range.start + static_cast<int>(qint64(length) * (i + 1) / stripes)));
+    }
+    for (int i = 0; i < stripes; ++i) {
+        const cv::Range part = parts[i];
+        submit([loop, part, i]() { loop->run(part, i); }, i);
+    }
+
+    // The caller only helps with its own stripes, from the far end: picking
+    // up any other task here could leave this loop waiting on a whole
+    // unrelated frame. Once all are claimed, the rest are running.
+    for (int i = stripes - 1; i >= 0; --i) {
+        loop->run(parts[i], i);
+    }
+    loop->done.acquire();
+
+    if (loop->failure) {
+        std::rethrow_exception(loop->failure);
+    }
+}
+
+void TaskScheduler::waitForDone()
+{
+    const int self = currentWorker();
+    while (pending.load() > 0 || running.load() > (self >= 0 ? 1 : 0)) {
+        if (!runOne(self)) {
+            QThread::msleep(1);
+        }
+    }
+}
+
+SchedulerStats TaskScheduler::stats() const
+{
+    SchedulerStats result;
+    result.threads = workers.size();
+    result.submitted = submitted.load();
+    result.executed = 0;
+    result.stolen = 0;
+
+    foreach (Worker *worker, workers) {
+        result.executedPerWorker.append(worker->executed.load());
+        result.executed += worker->executed.load();
+        result.stolen += worker->stolen.load();
+    }
+    return result;
+}
+
+void TaskScheduler::resetStats()
+{
+    submitted = 0;
+    foreach (Worker *worker, workers) {
+        worker->executed = 0;
+        worker->stolen = 0;
+    }
+}
+
+void TaskScheduler::workerLoop(int index)
+{
+    currentScheduler = this;
+    currentWorkerIndex = index;
+
+    for (;;) {
+        if (runOne(index)) {
+            continue;
+        }
+
+        QMutexLocker locker(&sleepMutex);
+        if (stopping) {
+            return;
+        }
+        // pending is raised before the submitter takes sleepMutex, so a
+        // task queued after this check still wakes us.
+        if (pending.load() == 0) {
+            wakeup.wait(&sleepMutex);
+        }
+    }
+}
+
+bool TaskScheduler::runOne(int self)
+{
+    Task task;
+    bool stolen = false;
+
+    if (!popLocal(self, &task) && !popShared(&task)) {
+        if (!steal(self, &task)) {
+            return false;
+        }
+        stolen = true;
+    }
+
+    // running first, so waitForDone() never sees both at zero while the
+    // task is still to run.
+    ++running;
+    --pending;
+    task();
+    --running;
+
+    if (self >= 0) {
+        ++workers[self]->executed;
+        if (stolen) {
+            ++workers[self]->stolen;
+        }
+    }
+    return true;
+}
+
+bool TaskScheduler::popLocal(int self, Task *task)
+{
+    if (self < 0) {
+        return false;
+    }
+
+    Worker *worker = workers[self];
+    QMutexLocker locker(&worker->mutex);
+    if (worker->tasks.empty()) {
+        return false;
+    }
+    *task = worker->tasks.back();
+    worker->tasks.pop_back();
+    return true;
+}
+
+bool TaskScheduler::popShared(Task *task)
+{
+    QMutexLocker locker(&sharedMutex);
+    if (shared.empty()) {
+        return false;
+    }
+    *task = shared.front();
+    shared.pop_front();
+    return true;
+}
+
+bool TaskScheduler::steal(int self, Task *task)
+{
+    const int count = workers.size();
+    for (int i = 1; i <= count; ++i) {
+        const int victim = (qMax(self, 0) + i) % count;
+        if (victim == self) {
+            continue;
+        }
+
+        Worker *worker = workers[victim];
+        QMutexLocker locker(&worker->mutex);
+        if (!worker->tasks.empty()) {
+            *task = worker->tasks.front();
+            worker->tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,95 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <opencv/cv.hpp>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+
+struct SchedulerStats
+{
+    int threads;
+    quint64 submitted;
+    quint64 executed;
+    quint64 stolen;
+    QList<quint64> executedPerWorker;
+};
+
+class SchedulerThread;
+
+// One pool for every filter and stream. Each worker owns a deque: it pops
+// its own work newest-first and, when empty, takes from the shared queue or
+// steals the oldest task of another worker. Tasks submitted with the same
+// affinity land on the same worker, so tile N of consecutive frames tends to
+// find its inputs still in that core's cache.
+class TaskScheduler
+{
+public:
+    typedef std::function<void()> Task;
+
+    explicit TaskScheduler(int threads = 0);
+    ~TaskScheduler();
+
+    // Drains outstanding work, then restarts with the given number of
+    // workers; 0 means QThread::idealThreadCount().
+    void setThreadCount(int threads);
+    int threadCount() const;
+
+    // affinity < 0 means no preference.
+    void submit(const Task &task, int affinity = -1);
+
+    // Stands in for cv::parallel_for_: splits the range into stripes, runs
+    // the body on the pool and returns when every stripe is done. The
+    // calling thread runs stripes too, and never other tasks, so calling
+    // from inside a task is safe; it sleeps while the last ones finish.
+    void parallelFor(const cv::Range &range, const cv::ParallelLoopBody &body, int stripes = 0);
+
+    void waitForDone();
+
+    SchedulerStats stats() const;
+    void resetStats();
+
+private:
+    friend class SchedulerThread;
+
+    struct Worker
+    {
+        Worker() : executed(0), stolen(0), thread(0) {}
+
+        QMutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<quint64> executed;
+        std::atomic<quint64> stolen;
+        SchedulerThread *thread;
+    };
+
+    void start(int threads);
+    void stop();
+    void workerLoop(int index);
+    int currentWorker() const;
+
+    bool runOne(int self);
+    bool popLocal(int self, Task *task);
+    bool popShared(Task *task);
+    bool steal(int self, Task *task);
+
+    QList<Worker*> workers;
+
+    QMutex sharedMutex;
+    std::deque<Task> shared;
+
+    QMutex sleepMutex;
+    QWaitCondition wakeup;
+
+    std::atomic<int> pending;
+    std::atomic<int> running;
+    std::atomic<bool> stopping;
+    std::atomic<quint64> submitted;
+};
+
+#endif // TASKSCHEDULER_H
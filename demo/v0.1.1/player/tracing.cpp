@@ -0,0 +1,184 @@
+#include "tracing.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QTextStream>
+#include <QThread>
+
+#include <chrono>
+#include <vector>
+
+namespace Tracing {
+
+std::atomic<bool> enabledFlag(false);
+
+}
+
+namespace {
+
+// Per thread; about 1.5 MB each. A full buffer drops new events until the
+// next writeChromeTrace() drains it. When its thread ends, a buffer is freed
+// at once if it is empty, otherwise once writeChromeTrace() has drained it.
+const quint64 bufferCapacity = 1 << 16;
+
+struct TraceEvent
+{
+    const char *name;
+    qint64 start;
+    qint64 end;
+};
+
+// Single producer (its thread), single consumer (writeChromeTrace).
+struct ThreadBuffer
+{
+    ThreadBuffer(int tid, const QString &name)
+        : events(bufferCapacity)
+        , written(0)
+        , read(0)
+        , tid(tid)
+        , name(name)
+        , finished(false)
+    {
+    }
+
+    std::vector<TraceEvent> events;
+    std::atomic<quint64> written;
+    std::atomic<quint64> read;
+    const int tid;
+    const QString name;
+    // Its thread has ended; under registryMutex.
+    bool finished;
+};
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+QMutex registryMutex;
+QList<ThreadBuffer*> buffers;
+int lastTid = 0;
+std::atomic<quint64> dropped(0);
+
+// Gives the thread's buffer up when the thread ends.
+struct LocalBuffer
+{
+    LocalBuffer() : buffer(0) {}
+
+    ~LocalBuffer()
+    {
+        if (!buffer) {
+            return;
+        }
+        QMutexLocker locker(&registryMutex);
+        if (buffer->written.load() == buffer->read.load()) {
+            buffers.removeOne(buffer);
+            delete buffer;
+        } else {
+            buffer->finished = true;
+        }
+    }
+
+    ThreadBuffer *buffer;
+};
+
+thread_local LocalBuffer localBuffer;
+
+ThreadBuffer *threadBuffer()
+{
+    if (!localBuffer.buffer) {
+        QThread *thread = QThread::currentThread();
+        const bool isMain = QCoreApplication::instance() && QCoreApplication::instance()->thread() == thread;
+        QString name = thread->objectName();
+
+        QMutexLocker locker(&registryMutex);
+        const int tid = ++lastTid;
+        if (name.isEmpty()) {
+            name = isMain ? QString("main") : QString("thread %1").arg(tid);
+        }
+        localBuffer.buffer = new ThreadBuffer(tid, name);
+        buffers.append(localBuffer.buffer);
+    }
+    return localBuffer.buffer;
+}
+
+QString json_string(const QString &text)
+{
+    QString escaped = text;
+    escaped.replace("\\", "\\\\");
+    escaped.replace("\"", "\\\"");
+    return "\"" + escaped + "\"";
+}
+
+}
+
+void Tracing::setEnabled(bool enabled)
+{
+    enabledFlag.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 Tracing::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Tracing::record(const char *name, qint64 start, qint64 end)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    const quint64 w = buffer->written.load(std::memory_order_relaxed);
+    if (w - buffer->read.load(std::memory_order_acquire) >= bufferCapacity) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent &event = buffer->events[w % bufferCapacity];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    buffer->written.store(w + 1, std::memory_order_release);
+}
+
+quint64 Tracing::droppedEvents()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+bool Tracing::writeChromeTrace(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    QTextStream out(&file);
+    const qint64 pid = QCoreApplication::applicationPid();
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    QMutexLocker locker(&registryMutex);
+    for (int b = 0; b < buffers.size(); ++b) {
+        ThreadBuffer *buffer = buffers[b];
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+            << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":" << json_string(buffer->name) << "}}";
+        first = false;
+
+        const quint64 r = buffer->read.load(std::memory_order_relaxed);
+        const quint64 w = buffer->written.load(std::memory_order_acquire);
+        for (quint64 i = r; i < w; ++i) {
+            const TraceEvent &event = buffer->events[i % bufferCapacity];
+            out << ",\n{\"name\":" << json_string(QString::fromUtf8(event.name))
+                << ",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+                << ",\"ts\":" << QString::number(event.start / 1000.0, 'f', 3)
+                << ",\"dur\":" << QString::number((event.end - event.start) / 1000.0, 'f', 3) << "}";
+        }
+        buffer->read.store(w, std::memory_order_release);
+
+        if (buffer->finished) {
+            buffers.removeAt(b--);
+            delete buffer;
+        }
+    }
+
+    out << "\n]}\n";
+    out.flush();
+    return file.error() == QFile::NoError;
+}
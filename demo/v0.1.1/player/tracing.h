@@ -0,0 +1,69 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QString>
+
+#include <atomic>
+
+// Timeline markers written out as Chrome trace-event JSON, for
+// chrome://tracing or ui.perfetto.dev.
+//
+//   TRACE_SCOPE("sobel");
+//
+// records one event from there to the end of the enclosing block. The name
+// is kept as a pointer, so it must be a literal or otherwise outlive the
+// trace. Every thread appends to its own buffer without locking. With
+// tracing switched off a scope costs one relaxed load; DEFINES += NO_TRACING
+// compiles them out altogether.
+namespace Tracing {
+
+extern std::atomic<bool> enabledFlag;
+
+inline bool isEnabled() { return enabledFlag.load(std::memory_order_relaxed); }
+void setEnabled(bool enabled);
+
+// Nanoseconds since the process started tracing.
+qint64 now();
+void record(const char *name, qint64 start, qint64 end);
+
+// Moves every event recorded so far out of the thread buffers into
+// filename, so repeated calls each get what happened since the last one.
+bool writeChromeTrace(const QString &filename);
+// Events lost because a thread's buffer was full.
+quint64 droppedEvents();
+
+class Scope
+{
+public:
+    explicit Scope(const char *label)
+        : name(isEnabled() ? label : 0)
+        , start(name ? now() : 0)
+    {
+    }
+
+    ~Scope()
+    {
+        if (name) {
+            record(name, start, now());
+        }
+    }
+
+private:
+    Scope(const Scope &);
+    Scope &operator=(const Scope &);
+
+    const char *name;
+    qint64 start;
+};
+
+}
+
+#ifdef NO_TRACING
+#define TRACE_SCOPE(name) do {} while (0)
+#else
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) Tracing::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
+#endif // TRACING_H
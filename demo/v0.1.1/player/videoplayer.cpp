@@ -1,7 +1,14 @@
 #include "videoplayer.h"
 #include "videosurface.h"
-#include "sharpcontrast.h"
-#include "neonedge.h"
+#include "imageconvert.h"
+#include "metrics.h"
+#include "syncmonitor.h"
+#include "tracing.h"
+
+// How far past the playhead a scrub decodes, in the direction of the drag,
+// and how far from it a cached frame may be to stand in for it.
+static const qint64 scrubWindowMsecs = 500;
+static const qint64 scrubNearestMsecs = 2000;
 
 class InvalidMethodException : public QException
 {
@@ -17,63 +24,12 @@ public:
     InvalidSettingException *clone() const { return new InvalidSettingException(*this); }
 };
 
-inline QImage mat_to_qimage(cv::Mat &mat, QImage::Format format)
-{
-    return QImage(mat.data, mat.cols, mat.rows,
-                  static_cast<int>(mat.step), format);
-}
-
-inline cv::Mat qimage_to_mat(QImage &img, int format)
-{
-    return cv::Mat(img.height(), img.width(),
-                   format, img.bits(), img.bytesPerLine());
-}
-
-QImage mat_to_qimage(cv::Mat &mat)
-{
-    if(!mat.empty()){
-        switch(mat.type()){
-        case CV_8UC3: return mat_to_qimage(mat, QImage::Format_RGB888);
-        case CV_8U: return mat_to_qimage(mat, QImage::Format_Indexed8);
-        case CV_8UC4: return mat_to_qimage(mat, QImage::Format_ARGB32);
-        }
-    }
-    return {};
-}
-
-cv::Mat qimage_to_mat(QImage &img)
-{
-    if(img.isNull()){
-        return cv::Mat();
-    }
-
-    switch (img.format()) {
-    case QImage::Format_RGB888:{
-        auto result = qimage_to_mat(img, CV_8UC3);
-        cv::cvtColor(result, result, CV_RGB2BGR);
-        return result;
-    }
-    case QImage::Format_Indexed8:{
-        return qimage_to_mat(img, CV_8U);
-    }
-    case QImage::Format_RGB32:
-    case QImage::Format_ARGB32:
-    case QImage::Format_ARGB32_Premultiplied:{
-        auto result = qimage_to_mat(img, CV_8UC4);
-        cv::cvtColor(result, result, cv::COLOR_RGBA2BGR);
-        return result;
-    }
-    default:
-        break;
-    }
-    return {};
-}
-
 VideoPlayer::VideoPlayer(QWidget *parent)
     : QWidget(parent)
     , mediaPlayer(0, QMediaPlayer::VideoSurface)
     , playButton(0)
     , positionSlider(0)
+    , scheduler(&tasks)
 {
 
     QAbstractButton *openButton = new QPushButton(tr("Open..."));
@@ -90,6 +46,8 @@ VideoPlayer::VideoPlayer(QWidget *parent)
 
     connect(positionSlider, SIGNAL(sliderMoved(int)),
             this, SLOT(setPosition(int)));
+    connect(positionSlider, SIGNAL(sliderPressed()), this, SLOT(scrubStarted()));
+    connect(positionSlider, SIGNAL(sliderReleased()), this, SLOT(scrubFinished()));
 
     QBoxLayout *controlLayout = new QHBoxLayout;
     controlLayout->setMargin(0);
@@ -150,31 +108,107 @@ VideoPlayer::VideoPlayer(QWidget *parent)
 
     VideoSurface* surface = new VideoSurface(this);
     mediaPlayer.setVideoOutput(surface);
-    connect(surface, SIGNAL(frameAvailable(QImage)), this, SLOT(processFrame(QImage)));
+    surface->setFrameRing(&frameRing);
+    // Written by `bench --conversions --write=ConversionCosts.json`.
+    conversionCosts = ConversionCostTable::load("ConversionCosts.json");
+    surface->setConversionCosts(&conversionCosts);
+    connect(&frameRing, SIGNAL(framesAvailable()), this, SLOT(drainFrames()), Qt::QueuedConnection);
+    scheduler.setFrameCache(&frameCache);
+    connect(&scheduler, SIGNAL(frameProcessed(QImage,qint64)), this, SLOT(showFrame(QImage,qint64)));
+    connect(&scheduler, SIGNAL(frameSkipped(qint64)), this, SLOT(frameSkipped(qint64)));
+    connect(&SyncMonitor::instance(), SIGNAL(driftExceeded(qint64)), this, SLOT(driftExceeded(qint64)),
+            Qt::QueuedConnection);
+    connect(&SyncMonitor::instance(), SIGNAL(driftRecovered(qint64)), this, SLOT(driftRecovered(qint64)),
+            Qt::QueuedConnection);
 
     connect(methodsControlsCombo, SIGNAL(currentTextChanged(QString)), this, SLOT(methodChanged(QString)));
     connect(opticsControlsCombo, SIGNAL(currentTextChanged(QString)), this, SLOT(opticsChanged(QString)));
 
+    processingStatsTimer = new QTimer(this);
+    processingStatsTimer->setInterval(5000);
+    connect(processingStatsTimer, SIGNAL(timeout()), this, SLOT(logProcessingStats()));
+
+    // Levels for the metrics file and endpoint; the rates are per interval.
+    gaugeTimer = new QTimer(this);
+    gaugeTimer->setInterval(1000);
+    connect(gaugeTimer, SIGNAL(timeout()), this, SLOT(publishGauges()));
+    gaugeTimer->start();
+    gaugeWindow.start();
+
+    refineTimer = new QTimer(this);
+    refineTimer->setSingleShot(true);
+    refineTimer->setInterval(150);
+    connect(refineTimer, SIGNAL(timeout()), this, SLOT(refinePreview()));
+
+    scrubTimer = new QTimer(this);
+    scrubTimer->setSingleShot(true);
+    scrubTimer->setInterval(40);
+    connect(scrubTimer, SIGNAL(timeout()), this, SLOT(seekScrubTarget()));
+
     loadSettings("MethodSettings.json");
     loadSettingsOptics("OpticalSettings.json");
 }
 
 VideoPlayer::~VideoPlayer()
 {
+    nativeSource.reset();
+    syntheticSource.reset();
+    scheduler.waitForDone();
+    pipeline.reset();
+    qDeleteAll(opticStages);
+    qDeleteAll(methodStages);
 }
 
 void VideoPlayer::openFile()
 {
     QString fileName = QFileDialog::getOpenFileName(this, tr("Open Movie"),QDir::homePath());
 
-    if (!fileName.isEmpty()) {
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    dropSource();
+    SyncMonitor::instance().reset();
+    sourcePosition = -1;
+    lastFrame = FrameHandle();
+    stillFrame = cv::Mat();
+    keyframes.clear();
+
+    if (nativeSource) {
+        // Only the native decoder scrubs from a keyframe.
+        keyframes.build(fileName);
+        if (!nativeSource->open(fileName)) {
+            qWarning() << nativeSource->errorString();
+            return;
+        }
+        frameSource = nativeSource.data();
+        durationChanged(nativeSource->duration());
+        mediaStateChanged(QMediaPlayer::StoppedState);
+    } else {
+        frameSource = 0;
         mediaPlayer.setMedia(QUrl::fromLocalFile(fileName));
-        playButton->setEnabled(true);
     }
+    playButton->setEnabled(true);
 }
 
 void VideoPlayer::play()
 {
+    if (frameSource) {
+        const bool playing = frameSource->isRunning() && !frameSource->isPaused();
+        if (playing) {
+            frameSource->setPaused(true);
+        } else if (frameSource->isRunning()) {
+            frameSource->setPaused(false);
+        } else {
+            frameSource->start();
+        }
+        mediaStateChanged(playing ? QMediaPlayer::PausedState : QMediaPlayer::PlayingState);
+        if(framePlane->isHidden()) {
+            framePlane->show();
+        }
+        return;
+    }
+
     switch(mediaPlayer.state()) {
     case QMediaPlayer::PlayingState:
         mediaPlayer.pause();
@@ -193,6 +227,12 @@ void VideoPlayer::mediaStateChanged(QMediaPlayer::State state)
     switch(state) {
     case QMediaPlayer::PlayingState:
         playButton->setIcon(style()->standardIcon(QStyle::SP_MediaPause));
+        // Playback takes over from a preview still in flight.
+        if (!stillFrame.empty()) {
+            refineTimer->stop();
+            scheduler.discardPending();
+            stillFrame = cv::Mat();
+        }
         break;
     default:
         playButton->setIcon(style()->standardIcon(QStyle::SP_MediaPlay));
@@ -202,7 +242,21 @@ void VideoPlayer::mediaStateChanged(QMediaPlayer::State state)
 
 void VideoPlayer::positionChanged(qint64 position)
 {
-    positionSlider->setValue(position);
+    // The handle stays under the mouse while a scrub decodes.
+    if (!positionSlider->isSliderDown()) {
+        positionSlider->setValue(position);
+    }
+    if (frameSource) {
+        sourcePosition = position;
+
+        // The target is in and the source stopped there (a position from
+        // before the seek would find it still running); fill the window
+        // behind it.
+        if (scrubPrefetchFrom >= 0 && isScrubbing() && frameSource->isPaused() && position >= scrubTarget) {
+            frameSource->scrub(scrubPrefetchFrom, scrubTarget);
+            scrubPrefetchFrom = -1;
+        }
+    }
 }
 
 void VideoPlayer::durationChanged(qint64 duration)
@@ -212,32 +266,594 @@ void VideoPlayer::durationChanged(qint64 duration)
 
 void VideoPlayer::setPosition(int position)
 {
-    mediaPlayer.setPosition(position);
+    if (benchmark) {
+        return;
+    }
+    if (scrubTarget >= 0 && position != scrubTarget) {
+        scrubDirection = position < scrubTarget ? -1 : 1;
+    }
+    scrubTarget = position;
+
+    QImage cached;
+    qint64 cachedTime;
+    if (frameCache.nearest(position * 1000LL, FrameCache::version(currentChain()), scrubNearestMsecs * 1000,
+                           &cached, &cachedTime)
+        && (scrubShown < 0 || qAbs(cachedTime - position * 1000LL) < qAbs(scrubShown - position * 1000LL))) {
+        paintFrame(cached);
+        scrubShown = cachedTime;
+    }
+
+    if (!scrubTimer->isActive()) {
+        scrubTimer->start();
+    }
 }
 
-void VideoPlayer::processFrame(QImage frame)
+void VideoPlayer::scrubStarted()
 {
-    try {
-        applied = qimage_to_mat(frame);
+    if (benchmark) {
+        return;
+    }
+    resumeAfterScrub = isPlaying();
+    scrubTarget = positionSlider->value();
+    scrubShown = -1;
+    scrubDirection = 0;
+    if (frameSource) {
+        frameSource->setPaused(true);
+    } else {
+        mediaPlayer.pause();
+    }
+}
+
+// The source seeks to the target itself (the decoder lands on the keyframe
+// before and skips up to it), so the target is the first frame processed.
+// Dragging forward, decoding goes on past it; dragging backward, the frames
+// behind it follow once it is in, from the keyframe before the window,
+// whose frames are decoded anyway. The processed frames land in the frame
+// cache, where the next slider move finds them. QMediaPlayer only gets the
+// seek.
+void VideoPlayer::seekScrubTarget()
+{
+    if (!positionSlider->isSliderDown() || scrubTarget < 0) {
+        return;
+    }
+    scheduler.discardPending();
+    SyncMonitor::instance().reset();
+    sourcePosition = -1;
+
+    scrubPrefetchFrom = -1;
+    if (!frameSource) {
+        mediaPlayer.setPosition(scrubTarget);
+    } else if (scrubDirection < 0) {
+        const qint64 behind = qMax<qint64>(0, scrubTarget - scrubWindowMsecs);
+        const qint64 keyframe = keyframes.keyframeBefore(behind * 1000);
+        scrubPrefetchFrom = keyframe >= 0 ? keyframe / 1000 : behind;
+        frameSource->scrub(scrubTarget, scrubTarget);
+    } else {
+        frameSource->scrub(scrubTarget, scrubTarget + scrubWindowMsecs);
+    }
+}
+
+void VideoPlayer::scrubFinished()
+{
+    if (benchmark) {
+        return;
+    }
+    scrubTimer->stop();
+    scheduler.discardPending();
+    scheduler.clearStill();
+    SyncMonitor::instance().reset();
+    sourcePosition = -1;
+    scrubTarget = -1;
+    scrubShown = -1;
+    scrubPrefetchFrom = -1;
+    // What is left of the window would only flash past, and a source
+    // waiting on the full ring would not get to the seek.
+    FrameHandle stale;
+    while (frameRing.pop(&stale)) {
+    }
+
+    // The exact frame, processed in full, replaces whatever stood in.
+    const qint64 position = positionSlider->value();
+    if (frameSource) {
+        if (resumeAfterScrub) {
+            frameSource->seek(position);
+            frameSource->setPaused(false);
+        } else {
+            frameSource->scrub(position, position);
+        }
+    } else {
+        mediaPlayer.setPosition(position);
+        if (resumeAfterScrub) {
+            mediaPlayer.play();
+        }
+    }
+}
+
+bool VideoPlayer::isScrubbing() const
+{
+    return scrubTarget >= 0;
+}
+
+void VideoPlayer::sourceFinished()
+{
+    mediaStateChanged(QMediaPlayer::StoppedState);
+    if (benchmark) {
+        checkBenchmarkDone();
+    }
+}
+
+void VideoPlayer::sourceFailed(const QString &message)
+{
+    qWarning() << message;
+    if (benchmark) {
+        benchmark->fail(message);
+    }
+}
+
+void VideoPlayer::attachSource(FrameSource *source)
+{
+    source->setFrameRing(&frameRing);
+    connect(source, SIGNAL(positionChanged(qint64)), this, SLOT(positionChanged(qint64)));
+    connect(source, SIGNAL(finished()), this, SLOT(sourceFinished()));
+    connect(source, SIGNAL(error(QString)), this, SLOT(sourceFailed(QString)));
+}
+
+// Stops the current source and lets its frames through the workers before
+// the cache is emptied; a new source reuses the same timestamps, so a late
+// frame of the old one would otherwise be cached as the new one's.
+void VideoPlayer::dropSource()
+{
+    if (frameSource) {
+        frameSource->stop();
+    } else {
+        mediaPlayer.stop();
+    }
+    FrameHandle stale;
+    while (frameRing.pop(&stale)) {
+    }
+    scheduler.discardPending();
+    scheduler.waitForDone();
+    scheduler.clearStill();
+    frameCache.clear();
+}
+
+void VideoPlayer::useNativeDecoder(int decodeThreads)
+{
+    if (!nativeSource) {
+        nativeSource.reset(new NativeDecoder());
+        attachSource(nativeSource.data());
+    }
+    nativeSource->setDecodeThreads(decodeThreads);
+    frameSource = nativeSource.data();
+}
+
+bool VideoPlayer::useSyntheticSource(const QString &spec)
+{
+    if (!syntheticSource) {
+        syntheticSource.reset(new SyntheticSource());
+        attachSource(syntheticSource.data());
+    }
+    dropSource();
+    if (!syntheticSource->configure(spec)) {
+        qWarning() << syntheticSource->errorString();
+        return false;
+    }
+    frameSource = syntheticSource.data();
+    keyframes.clear();
+    durationChanged(qMax<qint64>(0, syntheticSource->duration()));
+    playButton->setEnabled(true);
+    return true;
+}
+
+bool VideoPlayer::runBenchmark(const QString &fileName)
+{
+    if (!fileName.isEmpty()) {
+        // QMediaPlayer only plays in real time, so a file is always decoded
+        // natively.
+        if (!nativeSource) {
+            useNativeDecoder(0);
+        }
+        frameSource = nativeSource.data();
+        if (!nativeSource->open(fileName)) {
+            qWarning() << nativeSource->errorString();
+            return false;
+        }
+    } else if (!frameSource || frameSource->duration() < 0) {
+        qWarning() << "benchmark: needs a file, or a synthetic source with a frame count";
+        return false;
+    }
+
+    // The periodic log would otherwise take the stage stats the report needs.
+    processingStatsTimer->stop();
+    scheduler.takeStageStats();
+    if (pipeline) {
+        pipeline->takeStats();
+    }
+
+    benchmark.reset(new BenchmarkRun());
+    frameSource->setPaced(false);
+    durationChanged(frameSource->duration());
+    framePlane->show();
+
+    benchmark->start();
+    frameSource->start();
+    return true;
+}
+
+void VideoPlayer::checkBenchmarkDone()
+{
+    const int inFlight = pipeline ? pipeline->framesInFlight() : scheduler.framesInFlight();
+    if (!frameSource->atEnd() || frameRing.size() > 0 || inFlight > 0) {
+        return;
+    }
+    // Results already posted by the workers are delivered before this.
+    if (benchmark->beginFinish()) {
+        QMetaObject::invokeMethod(this, "finishBenchmark", Qt::QueuedConnection);
+    }
+}
+
+void VideoPlayer::finishBenchmark()
+{
+    scheduler.waitForDone();
+
+    benchmark->addStageTime("decode", frameSource->busyNsecs(), frameSource->deliveredFrames());
+    benchmark->addStageStats(pipeline ? pipeline->takeStats() : scheduler.takeStageStats());
+
+    QTextStream out(stdout);
+    benchmark->report(out, frameSource->deliveredFrames());
+    out.flush();
+
+    qApp->exit(benchmark->exitCode(frameSource->deliveredFrames()));
+}
+
+void VideoPlayer::setProcessingMode(ProcessingMode mode)
+{
+    processingMode = mode;
+
+    if(mode == StagePipelined && !pipeline) {
+        pipeline.reset(new StagePipeline());
+        connect(pipeline.data(), SIGNAL(frameReady()), this, SLOT(presentPipelineFrames()));
+    } else if(mode != StagePipelined && pipeline) {
+        pipeline.reset();
+    }
+}
+
+void VideoPlayer::drainFrames()
+{
+    FrameHandle frame;
+    // A benchmark run must not drop, so frames wait in the ring (and the
+    // source waits on the ring) until there is room downstream. Neither
+    // should a scrub window, which is kept in the frame cache.
+    while((!(benchmark || isScrubbing()) || hasProcessingCapacity()) && frameRing.pop(&frame)) {
+        processFrame(frame);
+    }
+}
+
+bool VideoPlayer::hasProcessingCapacity() const
+{
+    return pipeline ? pipeline->hasCapacity() : scheduler.hasCapacity();
+}
+
+void VideoPlayer::setWorkerThreads(int threads)
+{
+    scheduler.waitForDone();
+    tasks.setThreadCount(threads);
+    scheduler.setMaxFramesInFlight(tasks.threadCount());
+}
+
+void VideoPlayer::setLineBuffered(bool enabled)
+{
+    scheduler.waitForDone();
+    foreach (FilterStage *stage, opticStages.values() + methodStages.values()) {
+        stage->setLineBuffered(enabled);
+    }
+}
+
+void VideoPlayer::setStatsLogging(bool enabled)
+{
+    if (enabled) {
+        processingStatsTimer->start();
+    } else {
+        processingStatsTimer->stop();
+    }
+}
+
+bool VideoPlayer::setFrameCache(qint64 budgetBytes, bool compressed)
+{
+    frameCache.setBudget(budgetBytes);
+    if (!frameCache.setCompressed(compressed)) {
+        qWarning() << "frame cache: built without LZ4, frames are stored uncompressed";
+        return false;
+    }
+    return true;
+}
+
+void VideoPlayer::processFrame(const FrameHandle &frame)
+{
+    if(benchmark) {
+        benchmark->frameSubmitted(frame.startTime());
+    }
+
+    lastFrame = frame;
+
+    if(processingMode == StagePipelined) {
+        pipeline->submit(frame, currentChain());
+        return;
+    }
+
+    scheduler.submit(frame, currentChain());
+}
+
+void VideoPlayer::presentPipelineFrames()
+{
+    QImage frame;
+    qint64 startTime;
+    QElapsedTimer timer;
+
+    timer.start();
+    while(pipeline->takeFrame(&frame, &startTime)) {
+        showFrame(frame, startTime);
+        pipeline->reportPresented(timer.restart());
+    }
+
+    // Frames that failed in a stage are dropped by takeFrame() without
+    // reaching showFrame(), so the run is checked here as well.
+    if(benchmark) {
+        drainFrames();
+        checkBenchmarkDone();
+    }
+}
+
+void VideoPlayer::showFrame(QImage frame, qint64 startTime)
+{
+    // While scrubbing, only a frame nearer the playhead than the one on
+    // screen is worth a paint; the rest of the window is for the cache.
+    if(isScrubbing()) {
+        drainFrames();
+        const qint64 target = scrubTarget * 1000;
+        if(startTime < 0 || (scrubShown >= 0 && qAbs(startTime - target) >= qAbs(scrubShown - target))) {
+            return;
+        }
+        scrubShown = startTime;
+    }
+
+    TRACE_SCOPE("render");
+    static LatencyHistogram *renderLatency = Metrics::instance().histogram("stage.render");
+    QElapsedTimer timer;
+    timer.start();
+
+    paintFrame(frame);
+    renderLatency->record(timer.nsecsElapsed());
+    // A preview or a scrub is not timed against the clock.
+    SyncMonitor::instance().markPainted(startTime,
+                                        benchmark || isScrubbing() || !isPlaying() ? -1 : mediaClock());
+
+    if(benchmark) {
+        benchmark->framePresented(startTime, timer.nsecsElapsed());
+        if(!pipeline) {
+            drainFrames();
+            checkBenchmarkDone();
+        }
+    }
+}
+
+void VideoPlayer::paintFrame(const QImage &frame)
+{
+    framePlane->clear();
+    framePlane->setPixmap(QPixmap::fromImage(frame).scaled(framePlane->width(), framePlane->height()));
+}
+
+bool VideoPlayer::isPlaying() const
+{
+    if(frameSource) {
+        return frameSource->isRunning() && !frameSource->isPaused();
+    }
+    return mediaPlayer.state() == QMediaPlayer::PlayingState;
+}
+
+// The frame on screen, copied out of the backend's buffer the first time
+// a slider moves after the pause (or after a seek while paused).
+bool VideoPlayer::holdStillFrame()
+{
+    if(lastFrame.isValid()) {
+        try {
+            stillFrame = frame_to_mat(lastFrame).clone();
+            stillTime = lastFrame.startTime();
+        } catch(cv::Exception &) {
+            stillFrame = cv::Mat();
+        }
+        lastFrame = FrameHandle();
+    }
+    return !stillFrame.empty();
+}
+
+// While paused, every change is shown at once on a frame no wider than
+// 640 pixels, and refinePreview() follows in full once the sliders have
+// been still for a moment. A newer change discards the passes in flight.
+void VideoPlayer::parametersChanged()
+{
+    if(benchmark || isPlaying() || !holdStillFrame()) {
+        return;
+    }
+
+    scheduler.discardPending();
+    refineTimer->start();
+
+    // The filters may write to their input, so the held frame is copied.
+    cv::Mat preview;
+    if(stillFrame.cols > 640) {
+        const double scale = 640.0 / stillFrame.cols;
+        cv::resize(stillFrame, preview, cv::Size(), scale, scale, cv::INTER_AREA);
+    } else {
+        preview = stillFrame.clone();
+    }
+    // No start time: the frame cache must not keep the small picture.
+    scheduler.submit(preview, -1, currentChain());
+}
+
+void VideoPlayer::refinePreview()
+{
+    if(benchmark || isPlaying() || stillFrame.empty()) {
+        return;
+    }
+    scheduler.discardPending();
+    scheduler.submitStill(stillFrame, stillTime, currentChain());
+}
+
+void VideoPlayer::frameSkipped(qint64 startTime)
+{
+    Q_UNUSED(startTime);
+    if(isScrubbing()) {
+        drainFrames();
+    }
+    if(benchmark) {
+        drainFrames();
+        checkBenchmarkDone();
+    }
+}
+
+// The clock the audio follows, in ms: QMediaPlayer's position, or how far
+// a paced source has got. -1 when nothing keeps time.
+qint64 VideoPlayer::mediaClock() const
+{
+    if(!frameSource) {
+        return mediaPlayer.position();
+    }
+    return frameSource->isPaced() ? sourcePosition : -1;
+}
+
+void VideoPlayer::driftExceeded(qint64 driftMsecs)
+{
+    qWarning() << "a/v drift:" << driftMsecs << "ms"
+               << (driftMsecs > 0 ? "(picture behind)" : "(picture ahead)");
+}
+
+void VideoPlayer::driftRecovered(qint64 driftMsecs)
+{
+    qWarning() << "a/v drift back to" << driftMsecs << "ms";
+}
 
-        if(isPreProcessNeeded && opticsControlsCombo->currentIndex() != 0) {
-            applied = preProcessFrame(applied, opticsControlsCombo->currentText());
+void VideoPlayer::publishGauges()
+{
+    Metrics &metrics = Metrics::instance();
+
+    const double seconds = qMax<qint64>(1, gaugeWindow.restart()) / 1000.0;
+    const quint64 shown = metrics.histogram("stage.render")->snapshot().count;
+    const quint64 in = metrics.counter("frames.in")->get();
+    const quint64 dropped = metrics.counter("frames.dropped")->get();
+    const quint64 offered = (in - gaugeFramesIn) + (dropped - gaugeFramesDropped);
+
+    metrics.gauge("player.fps")->set((shown - gaugeFramesShown) / seconds);
+    metrics.gauge("frames.drop_rate")->set(offered > 0 ? double(dropped - gaugeFramesDropped) / offered : 0);
+    gaugeFramesShown = shown;
+    gaugeFramesIn = in;
+    gaugeFramesDropped = dropped;
+
+    metrics.gauge("ring.depth")->set(frameRing.size());
+    metrics.gauge("ring.capacity")->set(frameRing.capacity());
+    metrics.gauge("ring.high_water")->set(frameRing.highWater());
+
+    if(pipeline) {
+        foreach (const StageStats &stage, pipeline->queueStats()) {
+            metrics.gauge("queue." + stage.name + ".depth")->set(stage.queueDepth);
+            metrics.gauge("queue." + stage.name + ".capacity")->set(stage.queueCapacity);
         }
+    } else {
+        metrics.gauge("scheduler.in_flight")->set(scheduler.framesInFlight());
+        metrics.gauge("scheduler.capacity")->set(scheduler.maxFramesInFlight());
+    }
+
+    const quint64 arenasCreated = metrics.counter("arena.created")->get();
+    metrics.gauge("arena.pool_size")->set(arenasCreated);
+    metrics.gauge("cache.bytes")->set(frameCache.bytes());
+    metrics.gauge("cache.frames")->set(frameCache.count());
+    metrics.gauge("arena.in_use")->set(metrics.counter("arena.acquired")->get()
+                                       - metrics.counter("arena.released")->get());
+}
 
-        if(methodsControlsCombo->currentIndex() != 0) {
-            applied = postProcessFrame(applied, methodsControlsCombo->currentText());
+void VideoPlayer::logProcessingStats()
+{
+    qDebug() << "surface ring:" << frameRing.size() << "/" << frameRing.capacity()
+             << "high water" << frameRing.highWater()
+             << "overruns" << frameRing.overruns();
+
+    const SchedulerStats taskStats = tasks.stats();
+    qDebug() << "tasks:" << taskStats.threads << "threads"
+             << "submitted" << taskStats.submitted
+             << "executed" << taskStats.executed
+             << "stolen" << taskStats.stolen;
+    tasks.resetStats();
+
+    // Over the last interval; the histograms themselves keep running for
+    // the metrics file and endpoint.
+    const MetricsSnapshot metrics = Metrics::instance().snapshot();
+    QStringList tails;
+    for(auto it = metrics.histograms.constBegin(); it != metrics.histograms.constEnd(); ++it) {
+        const HistogramSnapshot interval = it.value().since(loggedHistograms.value(it.key()));
+        if (interval.count > 0) {
+            tails << QString("%1 %2ms").arg(it.key()).arg(interval.percentile(99) / 1e6, 0, 'f', 2);
         }
+    }
+    loggedHistograms = metrics.histograms;
+    qDebug() << "p99 (interval):" << tails.join(" | ");
+
+    const SyncStats sync = SyncMonitor::instance().stats();
+    qDebug() << "sync: latency" << sync.latencyUsecs / 1000.0 << "ms"
+             << "jitter" << sync.jitterUsecs / 1000.0 << "ms"
+             << "drift" << sync.driftUsecs / 1000.0 << "ms";
+
+    if(!pipeline) {
+        qDebug() << "frames in flight:" << scheduler.framesInFlight()
+                 << "/" << scheduler.maxFramesInFlight()
+                 << "dropped" << scheduler.droppedFrames();
+        return;
+    }
+
+    const QList<StageStats> stats = pipeline->takeStats();
+
+    QStringList parts;
+    foreach (const StageStats &stage, stats) {
+        parts << QString("%1 %2/%3 %4% %5f")
+                 .arg(stage.name)
+                 .arg(stage.queueDepth)
+                 .arg(stage.queueCapacity)
+                 .arg(qRound(stage.occupancy * 100))
+                 .arg(stage.frames);
+    }
+    qDebug() << "pipeline:" << parts.join(" | ")
+             << "bottleneck:" << StagePipeline::bottleneck(stats);
+}
+
+FilterChain VideoPlayer::currentChain()
+{
+    FilterChain chain;
+
+    if(isPreProcessNeeded && opticsControlsCombo->currentIndex() != 0) {
+        FilterStage *stage = opticStages.value(opticsControlsCombo->currentText());
+        if(stage) {
+            FilterInvocation step = { stage, sliderValues(opticalSettingsUi) };
+            chain.append(step);
+        }
+    }
 
-        framePlane->clear();
-        framePlane->setPixmap(QPixmap::fromImage(mat_to_qimage(applied)).scaled(framePlane->width(), framePlane->height()));
+    if(methodsControlsCombo->currentIndex() != 0) {
+        FilterStage *stage = methodStages.value(methodsControlsCombo->currentText());
+        if(stage) {
+            FilterInvocation step = { stage, sliderValues(methodSettingsUi) };
+            chain.append(step);
+        }
+    }
 
-//        graphicsView->scene()->clear();
-//        scene->addPixmap(image);
-//        scene->setSceneRect(image.rect());
-//        graphicsView->setScene(scene);
-//        graphicsView->fitInView(scene->sceneRect(), Qt::KeepAspectRatio);
+    return chain;
+}
 
-    } catch(Exception e) {}
+FilterParams VideoPlayer::sliderValues(const QMap<QString, QSlider*> &sliders)
+{
+    FilterParams params;
+    for(auto it = sliders.constBegin(); it != sliders.constEnd(); ++it) {
+        params.insert(it.key(), (*it.value()).value());
+    }
+    return params;
 }
 
 void VideoPlayer::loadSettings(const QString &filename)
@@ -252,6 +868,12 @@ void VideoPlayer::loadSettings(const QString &filename)
     foreach (const QJsonValue & value, settings) {
         QJsonObject obj = value.toObject();
         methodsControlsCombo->addItem(obj["name"].toString());
+
+        FilterStage *stage = createMethodStage(obj["name"].toString());
+        if(stage) {
+            stage->setTaskScheduler(&tasks);
+            methodStages.insert(stage->name(), stage);
+        }
     }
     methodsControlsCombo->setCurrentIndex(0);
 }
@@ -268,6 +890,12 @@ void VideoPlayer::loadSettingsOptics(const QString &filename)
     foreach (const QJsonValue & value, settingsOptics) {
         QJsonObject obj = value.toObject();
         opticsControlsCombo->addItem(obj["name"].toString());
+
+        FilterStage *stage = createOpticStage(obj["name"].toString());
+        if(stage) {
+            stage->setTaskScheduler(&tasks);
+            opticStages.insert(stage->name(), stage);
+        }
     }
     opticsControlsCombo->setCurrentIndex(0);
     updatePreProcessNeeded();
@@ -291,7 +919,7 @@ void VideoPlayer::cleanSettingsLayout(QLayout* layout)
 
             delete child;
         }
-    } catch (Exception e) {}
+    } catch (cv::Exception e) {}
 }
 
 void VideoPlayer::loadMethodSettings(const QString &method)
@@ -315,6 +943,8 @@ void VideoPlayer::loadMethodSettings(const QString &method)
             slider->setObjectName(obj["par_name"].toString());
             methodSettingsUi[obj["par_name"].toString()] = slider;
 
+            connect(slider, SIGNAL(valueChanged(int)), this, SLOT(parametersChanged()));
+
             QLabel *sliderLabel = new QLabel(obj["par_name"].toString());
 
             methodSettingsVBox_1->addWidget(sliderLabel);
@@ -348,6 +978,7 @@ void VideoPlayer::loadOpticSettings(const QString &method)
             opticalSettingsUi[obj["par_name"].toString()] = slider;
 
             connect(slider, SIGNAL(valueChanged(int)), this, SLOT(updatePreProcessNeeded()));
+            connect(slider, SIGNAL(valueChanged(int)), this, SLOT(parametersChanged()));
 
             QLabel *sliderLabel = new QLabel(obj["par_name"].toString());
 
@@ -436,32 +1067,11 @@ const QJsonObject VideoPlayer::getOpticsSettings(const QString &method)
 void VideoPlayer::methodChanged(const QString &method)
 {
     loadMethodSettings(method);
+    parametersChanged();
 }
 
 void VideoPlayer::opticsChanged(const QString &optic)
 {
     loadOpticSettings(optic);
+    parametersChanged();
 }
-
-cv::Mat VideoPlayer::preProcessFrame(cv::Mat frame, const QString &method)
-{
-    if(method == "SharpContrast") {
-        return SharpContrast(frame, getOSetting("DarkLight"), getOSetting("Intensity"),
-                             getOSetting("Vibrance"), getOSetting("Sharpness"), getOSetting("Contrast"));
-    }
-    else {
-        return frame;
-    }
-}
-
-cv::Mat VideoPlayer::postProcessFrame(cv::Mat frame, const QString &method)
-{
-    if(method == "NeonEdge") {
-        return NeonEdge(frame, getMSetting("intensity"), getMSetting("kernel"), getMSetting("weight"),
-                        getMSetting("scale"), getMSetting("cut"), getMSetting("hue"));
-    }
-    else {
-        return frame;
-    }
-}
-
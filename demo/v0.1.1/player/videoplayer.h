@@ -13,6 +13,18 @@
 #include <opencv/cv.hpp>
 #include <opencv/highgui.h>
 
+#include "filterstage.h"
+#include "framecache.h"
+#include "framescheduler.h"
+#include "keyframeindex.h"
+#include "stagepipeline.h"
+#include "framering.h"
+#include "taskscheduler.h"
+#include "conversioncost.h"
+#include "nativedecoder.h"
+#include "syntheticsource.h"
+#include "benchmarkrun.h"
+
 QT_BEGIN_NAMESPACE
 class QAbstractButton;
 class QSlider;
@@ -30,6 +42,26 @@ public:
 
     QSize sizeHint() const { return QSize(800, 600); }
 
+    enum ProcessingMode { FrameParallel, StagePipelined };
+    void setProcessingMode(ProcessingMode mode);
+    void setWorkerThreads(int threads);
+    void setLineBuffered(bool enabled);
+    // Ring, scheduler and latency stats on the debug log every 5 s; off
+    // unless asked for, the metrics file and endpoint carry the same.
+    void setStatsLogging(bool enabled);
+    // Processed frames kept for revisits (FrameCache); 0 bytes turns it off.
+    // Frame-parallel mode only.
+    bool setFrameCache(qint64 budgetBytes, bool compressed);
+    // Decode with NativeDecoder instead of QMediaPlayer.
+    void useNativeDecoder(int decodeThreads);
+    // Generated frames instead of a file, see SyntheticSource::configure().
+    bool useSyntheticSource(const QString &spec);
+    // Plays fileName unpaced through the whole pipeline, prints a report and
+    // exits the application with BenchmarkRun::exitCode(). With no file it
+    // runs the synthetic source, which then needs a frame count. Returns
+    // false if the run cannot start.
+    bool runBenchmark(const QString &fileName);
+
 public slots:
     void openFile();
     void play();
@@ -39,10 +71,25 @@ private slots:
     void positionChanged(qint64 position);
     void durationChanged(qint64 duration);
     void setPosition(int position);
-    void processFrame(QImage frame);
+    void scrubStarted();
+    void scrubFinished();
+    void seekScrubTarget();
+    void sourceFinished();
+    void sourceFailed(const QString &message);
+    void drainFrames();
+    void showFrame(QImage frame, qint64 startTime);
+    void frameSkipped(qint64 startTime);
+    void presentPipelineFrames();
+    void logProcessingStats();
+    void publishGauges();
+    void driftExceeded(qint64 driftMsecs);
+    void driftRecovered(qint64 driftMsecs);
+    void finishBenchmark();
     void methodChanged(const QString &method);
     void opticsChanged(const QString &optic);
     void updatePreProcessNeeded();
+    void parametersChanged();
+    void refinePreview();
 
 private:
     QMediaPlayer mediaPlayer;
@@ -64,12 +111,71 @@ private:
 
     QImage Mat2QImage(cv::Mat const& src);
     QImage applyEffect(QImage frame, const QString method);
-    cv::Mat postProcessFrame(cv::Mat frame, const QString &method);
-    cv::Mat preProcessFrame(cv::Mat frame, const QString &method);
 
     cv::Mat QImage2Mat(QImage const& src);
-    cv::Mat original;
-    cv::Mat applied;
+
+    ProcessingMode processingMode = FrameParallel;
+    FrameRing frameRing;
+    ConversionCostTable conversionCosts;
+    FrameCache frameCache;
+    TaskScheduler tasks;
+    FrameScheduler scheduler;
+    QScopedPointer<StagePipeline> pipeline;
+    QScopedPointer<NativeDecoder> nativeSource;
+    QScopedPointer<SyntheticSource> syntheticSource;
+    // Whichever of the above plays; 0 while QMediaPlayer does.
+    FrameSource *frameSource = 0;
+    // Last position a paced frameSource reported, in ms.
+    qint64 sourcePosition = -1;
+    QTimer *processingStatsTimer;
+    // Histograms as of the previous logProcessingStats().
+    QMap<QString, HistogramSnapshot> loggedHistograms;
+    QTimer *gaugeTimer;
+    QElapsedTimer gaugeWindow;
+    quint64 gaugeFramesShown = 0;
+    quint64 gaugeFramesIn = 0;
+    quint64 gaugeFramesDropped = 0;
+    QScopedPointer<BenchmarkRun> benchmark;
+
+    // Live preview while paused: the last frame submitted is held and run
+    // through the chain again on every slider move, first at preview size
+    // and then, once the sliders settle, in full.
+    FrameHandle lastFrame;
+    cv::Mat stillFrame;
+    qint64 stillTime = -1;
+    QTimer *refineTimer;
+
+    // Scrubbing: while the position slider is held, the cached frame
+    // nearest the playhead is shown at once, and the source decodes the
+    // frame at the playhead and then those around it, at most every
+    // scrubTimer interval. The exact frame follows on release.
+    KeyframeIndex keyframes;
+    QTimer *scrubTimer;
+    // The slider position in ms, and the start time of the frame on
+    // screen in us.
+    qint64 scrubTarget = -1;
+    qint64 scrubShown = -1;
+    int scrubDirection = 0;
+    // Where the frames behind a backward scrub start, in ms, once the
+    // target frame is in; -1 when there is nothing to fetch.
+    qint64 scrubPrefetchFrom = -1;
+    bool resumeAfterScrub = false;
+
+    void attachSource(FrameSource *source);
+    void dropSource();
+    void processFrame(const FrameHandle &frame);
+    void paintFrame(const QImage &frame);
+    bool isScrubbing() const;
+    bool isPlaying() const;
+    bool holdStillFrame();
+    bool hasProcessingCapacity() const;
+    qint64 mediaClock() const;
+    void checkBenchmarkDone();
+    QMap<QString, FilterStage*> opticStages;
+    QMap<QString, FilterStage*> methodStages;
+
+    FilterChain currentChain();
+    FilterParams sliderValues(const QMap<QString, QSlider*> &sliders);
 
     QVBoxLayout *methodSettingsVBox_1;
     QVBoxLayout *opticalSettingsVBox_1;
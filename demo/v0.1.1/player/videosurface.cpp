@@ -1,16 +1,22 @@
 #include "videosurface.h"
+#include "syncmonitor.h"
+#include "tracing.h"
 
 VideoSurface::VideoSurface(QWidget *widget, QObject *parent)
     : QAbstractVideoSurface(parent)
     , widget(widget)
     , imageFormat(QImage::Format_Invalid)
+    , frameRing(0)
+    , conversionCosts(0)
+    , expectedSize(1920, 1080)
+    , negotiated(QVideoFrame::Format_Invalid)
 {
 }
 
 QList<QVideoFrame::PixelFormat> VideoSurface::supportedPixelFormats(QAbstractVideoBuffer::HandleType handleType) const
 {
     Q_UNUSED(handleType);
-    return QList<QVideoFrame::PixelFormat>()
+    const QList<QVideoFrame::PixelFormat> formats = QList<QVideoFrame::PixelFormat>()
         << QVideoFrame::Format_ARGB32
         << QVideoFrame::Format_ARGB32_Premultiplied
         << QVideoFrame::Format_RGB32
@@ -43,6 +49,10 @@ QList<QVideoFrame::PixelFormat> VideoSurface::supportedPixelFormats(QAbstractVid
         << QVideoFrame::Format_Jpeg
         << QVideoFrame::Format_CameraRaw
         << QVideoFrame::Format_AdobeDng;
+
+    // The backend takes the first format it can deliver, so the order is
+    // what decides how much conversion every frame costs.
+    return conversionCosts ? conversionCosts->rank(formats, expectedSize) : formats;
 }
 
 bool VideoSurface::isFormatSupported(const QVideoSurfaceFormat &format) const
@@ -64,6 +74,14 @@ bool VideoSurface::start(const QVideoSurfaceFormat &format)
         this->imageFormat = imageFormat;
         imageSize = size;
         sourceRect = format.viewport();
+        negotiated = format.pixelFormat();
+        expectedSize = size;
+
+        if (conversionCosts) {
+            qDebug() << "VideoSurface: negotiated" << ConversionCostTable::formatName(negotiated)
+                     << size << "conversion" << conversionCosts->frameCost(negotiated, size) / 1e6 << "ms/frame";
+        }
+        emit formatNegotiated(negotiated, size);
 
         QAbstractVideoSurface::start(format);
 
@@ -78,7 +96,7 @@ bool VideoSurface::start(const QVideoSurfaceFormat &format)
 
 void VideoSurface::stop()
 {
-    currentFrame = QVideoFrame();
+    currentFrame = FrameHandle();
     targetRect = QRect();
 
     QAbstractVideoSurface::stop();
@@ -88,16 +106,17 @@ void VideoSurface::stop()
 
 bool VideoSurface::present(const QVideoFrame &frame)
 {
-    if (frame.isValid())
+    TRACE_SCOPE("surface present");
+
+    // Mapped once here and shared by painting and processing; the buffer
+    // stays mapped until the last of them lets go.
+    const FrameHandle handle(frame);
+
+    if (handle.isValid() && frameRing)
     {
-        QVideoFrame cloneFrame(frame);
-        cloneFrame.map(QAbstractVideoBuffer::ReadOnly);
-        const QImage image(cloneFrame.bits(),
-                           cloneFrame.width(),
-                           cloneFrame.height(),
-                           QVideoFrame::imageFormatFromPixelFormat(cloneFrame .pixelFormat()));
-        emit frameAvailable(image); // this is very important
-        cloneFrame.unmap();
+        // The push never blocks the decoder; a full ring drops the frame.
+        SyncMonitor::instance().markPresented(handle.startTime());
+        frameRing->push(handle); // this is very important
     }
 
     if (surfaceFormat().pixelFormat() != frame.pixelFormat()
@@ -107,7 +126,7 @@ bool VideoSurface::present(const QVideoFrame &frame)
 
         return false;
     } else {
-        currentFrame = frame;
+        currentFrame = handle;
 
         widget->repaint(targetRect);
 
@@ -126,7 +145,10 @@ void VideoSurface::updateVideoRect()
 
 void VideoSurface::paint(QPainter *painter)
 {
-    if (currentFrame.map(QAbstractVideoBuffer::ReadOnly)) {
+    TRACE_SCOPE("surface paint");
+    const QImage image = currentFrame.image();
+
+    if (!image.isNull()) {
         const QTransform oldTransform = painter->transform();
 
         if (surfaceFormat().scanLineDirection() == QVideoSurfaceFormat::BottomToTop) {
@@ -134,17 +156,8 @@ void VideoSurface::paint(QPainter *painter)
            painter->translate(0, -widget->height());
         }
 
-        QImage image(
-                currentFrame.bits(),
-                currentFrame.width(),
-                currentFrame.height(),
-                currentFrame.bytesPerLine(),
-                imageFormat);
-
         painter->drawImage(targetRect, image, sourceRect);
 
         painter->setTransform(oldTransform);
-
-        currentFrame.unmap();
     }
 }
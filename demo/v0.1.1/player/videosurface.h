@@ -5,6 +5,9 @@
 #include <QAbstractVideoSurface>
 #include <QVideoSurfaceFormat>
 
+#include "conversioncost.h"
+#include "framering.h"
+
 class VideoSurface : public QAbstractVideoSurface
 {
     Q_OBJECT
@@ -26,15 +29,27 @@ public:
 
     void paint(QPainter *painter);
 
+    void setFrameRing(FrameRing *ring) { frameRing = ring; }
+
+    // Formats are advertised cheapest-to-convert first for frames of the
+    // expected size, which follows the last negotiated size.
+    void setConversionCosts(const ConversionCostTable *costs) { conversionCosts = costs; }
+    QVideoFrame::PixelFormat negotiatedFormat() const { return negotiated; }
+
+signals:
+    void formatNegotiated(QVideoFrame::PixelFormat format, const QSize &size);
+
 private:
     QWidget *widget;
     QImage::Format imageFormat;
     QRect targetRect;
     QSize imageSize;
     QRect sourceRect;
-    QVideoFrame currentFrame;
-
-signals:
-    void frameAvailable(QImage frame);
+    FrameHandle currentFrame;
+    FrameRing *frameRing;
+    const ConversionCostTable *conversionCosts;
+    // 1080p until the first format is negotiated.
+    QSize expectedSize;
+    QVideoFrame::PixelFormat negotiated;
 };
 #endif // VIDEOSURFACE_H
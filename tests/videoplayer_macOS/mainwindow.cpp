@@ -31,7 +31,7 @@ MainWindow::MainWindow(QWidget *parent) :
                               "Qt Mirrored" << "Qt RGB Swapped");
 
     connect(player, SIGNAL(stateChanged(QMediaPlayer::State)), this, SLOT(setState(QMediaPlayer::State)));
-    connect(videoSurface, SIGNAL(frameAvailable(QImage)), this, SLOT(processFrame(QImage)));
+    connect(videoSurface, SIGNAL(frameAvailable(QImage,qint64)), this, SLOT(processFrame(QImage,qint64)));
 }
 
 MainWindow::~MainWindow()
@@ -85,7 +85,7 @@ void MainWindow::on_btnOpen_clicked()
     }
 }
 
-void MainWindow::processFrame(QImage frame)
+void MainWindow::processFrame(QImage frame, qint64 startTime)
 {
     if(ceffect != ui->cBoxEffects->currentIndex()) {
         _t_avg_t = 0;
@@ -112,9 +112,14 @@ void MainWindow::processFrame(QImage frame)
     _t_avg_t += time;
     ++_t_c_f;
 
-    ui->label_sync->setText(QString("%1 : %2 # %3").arg(QString::number( (player->position() / 1000) * 60 ))
-                            .arg(QString::number( fraren ))
-                            .arg(QString::number( ((player->position() / 1000) * 60) - fraren )));
+    // Media position against the shown frame's own timestamp, both in ms;
+    // positive drift means the picture is behind the audio.
+    if (startTime >= 0) {
+        const qint64 position = player->position();
+        ui->label_sync->setText(QString("%1 : %2 # %3").arg(QString::number( position ))
+                                .arg(QString::number( startTime / 1000 ))
+                                .arg(QString::number( position - startTime / 1000 )));
+    }
 
     ui->label_fps->setText(QString("%1").arg(QString::number( fraren / ((cv::getTickCount() - stime) /
                                                                         cv::getTickFrequency()) )));
@@ -25,7 +25,7 @@ public:
 private slots:
     void on_btnOpen_clicked();
     void on_btnPlay_clicked();
-    void processFrame(QImage frame);
+    void processFrame(QImage frame, qint64 startTime);
 
     QImage applyEffect(QImage frame);
 
@@ -57,7 +57,7 @@ bool VideoSurface::present(const QVideoFrame &frame)
                            cloneFrame.width(),
                            cloneFrame.height(),
                            QVideoFrame::imageFormatFromPixelFormat(cloneFrame.pixelFormat()));
-        emit frameAvailable(image);
+        emit frameAvailable(image, frame.startTime());
         cloneFrame.unmap();
     }
 
@@ -17,7 +17,7 @@ public:
 
 
 signals:
-    void frameAvailable(QImage frame);
+    void frameAvailable(QImage frame, qint64 startTime);
 };
 
 #endif // VIDEOSURFACE_H